@@ -68,12 +68,14 @@ function(newJuneTarget targetName)
   endif()
 
   if (NJT_BINARY)
+    # Exports the VM's symbols, modules compiled by --compile call into them
     set_target_properties(
       ${targetName}
       PROPERTIES
       OUTPUT_NAME ${targetName}
       RUNTIME_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/bin"
       INSTALL_RPATH_USE_LINK_PATH ON
+      ENABLE_EXPORTS ON
     )
 
     install(
@@ -116,3 +118,24 @@ function(newJuneTarget targetName)
   endif()
 endfunction()
 
+
+#
+# newJuneTest(
+# 	name
+#  	source1 [source2 source3 ...]
+#	)
+#
+# Builds a test executable linked with the VM and registers it with CTest,
+# it passes if it exits with 0.
+#
+function(newJuneTest testName)
+  add_executable(${testName} ${ARGN})
+  target_link_libraries(${testName} JuneVM JuneCommon ${CMAKE_DL_LIBS})
+  set_target_properties(
+    ${testName}
+    PROPERTIES
+    RUNTIME_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/tests"
+    ENABLE_EXPORTS ON
+  )
+  add_test(NAME ${testName} COMMAND ${testName})
+endfunction()
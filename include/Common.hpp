@@ -2,12 +2,16 @@
 #define common_env_hpp
 
 #include "JuneConfig.hpp"
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 #include <functional>
 
@@ -152,14 +156,22 @@ private:
   };
 
 public:
-  Result(const O ok) : isError(false), ok(ok) {}
-  Result(const E err) : isError(true), err(err) {}
+  Result(O ok) : isError(false), ok(std::move(ok)) {}
+  Result(E err) : isError(true), err(std::move(err)) {}
 
   Result(const Result &other) : isError(other.isError) {
+    // the union member is not constructed yet, assigning would read garbage
     if (isError)
-      err = other.err;
+      new (&err) E(other.err);
     else
-      ok = other.ok;
+      new (&ok) O(other.ok);
+  }
+
+  Result(Result &&other) : isError(other.isError) {
+    if (isError)
+      new (&err) E(std::move(other.err));
+    else
+      new (&ok) O(std::move(other.ok));
   }
 
   ~Result() {
@@ -171,9 +183,9 @@ public:
 
   static Result<VoidType, E> Ok() { return Result<VoidType, E>(VoidType{}); }
 
-  static Result<O, E> Ok(O ok) { return Result<O, E>(ok); }
+  static Result<O, E> Ok(O ok) { return Result<O, E>(std::move(ok)); }
 
-  static Result<O, E> Err(E err) { return Result<O, E>(err); }
+  static Result<O, E> Err(E err) { return Result<O, E>(std::move(err)); }
 
   std::ostream &operator<<(std::ostream &os) {
     if (isError)
@@ -194,6 +206,12 @@ public:
     return ok;
   }
 
+  inline O &unwrap() {
+    if (isError)
+      throw std::runtime_error("Result unwrapped an Err");
+    return ok;
+  }
+
   inline const E &unwrapErr() const {
     if (!isError)
       throw std::runtime_error("Result unwrapped an Ok");
@@ -241,6 +259,36 @@ const int kMaxPathChars = 1024;
 /// @brief Reads a file into a string.
 Result<std::string, Error> readFile(const std::string &path);
 
+/// @brief A whole file mapped read-only into memory, unmapped when destroyed.
+///        Where mapping is unsupported the file is read into a buffer.
+class MappedFile {
+  const unsigned char *_data;
+  size_t _size;
+  bool _mapped;
+
+  MappedFile() : _data(nullptr), _size(0), _mapped(false) {}
+
+public:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  /// @brief Maps the file at `path`, which must not be empty.
+  static Result<std::shared_ptr<const MappedFile>, Error>
+  open(const std::string &path);
+
+  inline const unsigned char *data() const { return _data; }
+  inline size_t size() const { return _size; }
+  /// @brief Checks if `ptr` points inside the file.
+  inline bool contains(const void *ptr) const {
+    auto p = static_cast<const unsigned char *>(ptr);
+    return p >= _data && p < _data + _size;
+  }
+};
+
+/// @brief Creates a directory and any missing parents.
+Result<bool, Error> makeDirs(const std::string &path);
+
 /// @brief Checks if a file exists.
 Result<bool, Error> exists(const std::string &path);
 
@@ -274,6 +322,32 @@ search(const std::string &dir,
        const std::function<bool(const std::string &)> &matcher);
 } // namespace fs
 
+namespace hash {
+/// @brief Value an FNV-1a hash starts from.
+const std::uint64_t kFnvInit = 0xcbf29ce484222325ULL;
+
+/// @brief Folds the `size` bytes at `data` into the FNV-1a hash `hash`, a
+///        hash computed piece by piece is the same as one of the whole.
+inline void fnv1a(std::uint64_t &hash, const void *data, const size_t &size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+/// @brief Gets the FNV-1a hash of the `size` bytes at `data`, fast but weak:
+///        for hash tables and checksums against damage, not for keys.
+inline std::uint64_t fnv1a(const void *data, const size_t &size) {
+  std::uint64_t hash = kFnvInit;
+  fnv1a(hash, data, size);
+  return hash;
+}
+
+/// @brief Gets the SHA-256 digest of `data` as 64 lowercase hex digits.
+std::string sha256(const std::string &data);
+} // namespace hash
+
 namespace env {
 /// @brief Gets the value of an environment variable.
 std::string get(const std::string &key);
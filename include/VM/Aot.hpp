@@ -0,0 +1,120 @@
+#ifndef vm_aot_hpp
+#define vm_aot_hpp
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "../Common.hpp"
+#include "Exec.hpp"
+#include "OpCodes.hpp"
+
+namespace june {
+
+class SrcFile;
+struct State;
+
+namespace aot {
+
+/// @brief Version of the sources `emit` writes, shared objects built from
+///        another one are refused when loaded.
+static const unsigned kVersion = 3;
+
+/// @brief An op of a compiled module. String operands are literals of the
+///        module, `sz` holds the size and bool operands.
+struct ModuleOp {
+  size_t idx;
+  OpCodes op;
+  OpDataType type;
+  size_t sz;
+  const char *s;
+};
+
+/// @brief What the `june_aot_module` function of a compiled module returns.
+///        The op and operand type counts are the ones the module was
+///        compiled with.
+struct Module {
+  unsigned version;
+  unsigned opCount;
+  unsigned typeCount;
+  const char *path;
+  const char *dir;
+  const ModuleOp *ops;
+  size_t count;
+  /// @brief The `or` handler table of the ops, whose region markers were
+  ///        stripped.
+  const Handler *handlers;
+  size_t handlerCount;
+  /// @brief Native code of the functions of the ops that were verified, by
+  ///        first op. It runs the ops through the `vm` functions of Exec.hpp,
+  ///        resolved against the VM loading the module.
+  const CompiledBody *bodies;
+  size_t bodyCount;
+  /// @brief Text of the source and its encoded line table, for diagnostics.
+  ///        The text is null if it was not retained when compiling, the
+  ///        lines if the source had none.
+  const char *text;
+  size_t textSize;
+  const std::uint8_t *lines;
+  size_t linesSize;
+  size_t lineCount;
+};
+
+using Result = err::Result<err::VoidType, std::string>;
+
+/// @brief Writes the C++ source of a shared object holding the bytecode of
+///        `src`, its handler table and a function per verified function of
+///        it, running its ops in order with jumps and `or` handlers resolved
+///        to gotos. The object exports `june_init`, which `load`s it. Encoded
+///        function bodies are decoded first.
+Result emit(SrcFile &src, std::ostream &out);
+
+/// @brief Compiles the source written by `emit` at `cppPath` into the shared
+///        object `soPath` with `$CXX` (`c++` if unset). The VM headers are
+///        taken from `JUNE_INCLUDE_DIR`, else from where they are installed
+///        next to `selfBase`. The VM functions the object calls are left to
+///        the program loading it, which must export them.
+Result build(const std::string &selfBase, const std::string &cppPath,
+             const std::string &soPath);
+
+using SourceResult = err::Result<SrcFile *, std::string>;
+
+/// @brief Rebuilds the source a module was compiled from, with its bytecode
+///        verified and run through the module's native code, and whatever
+///        text and lines the module has.
+SourceResult source(const Module &mod, const bool &isMain);
+
+/// @brief Runs a compiled module like an imported one, if it did not run
+///        already, it is what its `june_init` does. Compiled main programs
+///        are run from their `source` instead, as `june` does with a main
+///        source file.
+bool load(State &vm, const Module &mod, const size_t &srcId,
+          const size_t &idx);
+
+} // namespace aot
+
+} // namespace june
+
+// Steps of the functions `emit` writes: a failure an `or` caught goes on at
+// their `caught` label, which jumps to the handler, the others end them
+#define JUNE_AOT_RUN(step)                                                     \
+  do {                                                                         \
+    ::june::vm::Step res_ = (step);                                            \
+    if (res_ == ::june::vm::StepCaught)                                        \
+      goto caught;                                                             \
+    if (res_ != ::june::vm::StepNext)                                          \
+      return res_;                                                             \
+  } while (false)
+
+#define JUNE_AOT_BRANCH(step, label)                                           \
+  do {                                                                         \
+    ::june::vm::Step res_ = (step);                                            \
+    if (res_ == ::june::vm::StepJump)                                          \
+      goto label;                                                              \
+    if (res_ == ::june::vm::StepCaught)                                        \
+      goto caught;                                                             \
+    if (res_ != ::june::vm::StepNext)                                          \
+      return res_;                                                             \
+  } while (false)
+
+#endif
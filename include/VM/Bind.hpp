@@ -0,0 +1,257 @@
+#ifndef vm_bind_hpp
+#define vm_bind_hpp
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "State.hpp"
+#include "Vars/Base.hpp"
+
+namespace june {
+
+/// @brief Location of a native call, taken as optional first parameter by
+///        bound functions that need the state or want to fail.
+struct CallCtx {
+  State &vm;
+  size_t srcId;
+  size_t idx;
+};
+
+namespace bind {
+
+template <typename T> struct AlwaysFalse : std::false_type {};
+
+/// @brief How a June value is checked and unboxed into a C++ parameter. Only
+///        the specializations below can be bound, anything else fails to
+///        compile.
+template <typename T> struct Arg {
+  static_assert(AlwaysFalse<T>::value, "unsupported native argument type");
+};
+
+template <> struct Arg<long long> {
+  static inline bool check(VarBase *v) { return v->isa<VarInt>(); }
+  static inline long long get(VarBase *v) { return AsInt(v)->get(); }
+  static inline std::uintptr_t type() { return type_id<VarInt>(); }
+};
+template <> struct Arg<long> {
+  static inline bool check(VarBase *v) { return v->isa<VarInt>(); }
+  static inline long get(VarBase *v) { return AsInt(v)->get(); }
+  static inline std::uintptr_t type() { return type_id<VarInt>(); }
+};
+template <> struct Arg<int> {
+  static inline bool check(VarBase *v) { return v->isa<VarInt>(); }
+  static inline int get(VarBase *v) { return AsInt(v)->get(); }
+  static inline std::uintptr_t type() { return type_id<VarInt>(); }
+};
+// ints are accepted where a float is expected
+template <> struct Arg<double> {
+  static inline bool check(VarBase *v) {
+    return v->isa<VarFloat>() || v->isa<VarInt>();
+  }
+  static inline double get(VarBase *v) {
+    return v->isa<VarFloat>() ? AsFloat(v)->get() : AsInt(v)->get();
+  }
+  static inline std::uintptr_t type() { return type_id<VarFloat>(); }
+};
+template <> struct Arg<bool> {
+  static inline bool check(VarBase *v) { return v->isa<VarBool>(); }
+  static inline bool get(VarBase *v) { return AsBool(v)->get(); }
+  static inline std::uintptr_t type() { return type_id<VarBool>(); }
+};
+template <> struct Arg<std::string> {
+  static inline bool check(VarBase *v) { return v->isa<VarString>(); }
+  static inline const std::string &get(VarBase *v) {
+    return AsString(v)->view();
+  }
+  static inline std::uintptr_t type() { return type_id<VarString>(); }
+};
+// any value, borrowed for the duration of the call
+template <> struct Arg<VarBase *> {
+  static inline bool check(VarBase *v) { return true; }
+  static inline VarBase *get(VarBase *v) { return v; }
+  static inline std::uintptr_t type() { return type_id<VarAll>(); }
+};
+
+template <typename T>
+using ArgOf = Arg<typename std::remove_cv<
+    typename std::remove_reference<T>::type>::type>;
+
+/// @brief How a C++ return value is boxed. A null `VarBase *` means the
+///        function failed.
+template <typename T> struct Ret {
+  static_assert(AlwaysFalse<T>::value, "unsupported native return type");
+};
+
+template <> struct Ret<long long> {
+  static inline VarBase *box(const CallCtx &ctx, const long long &v) {
+    return make_all<VarInt>(v, ctx.srcId, ctx.idx);
+  }
+};
+template <> struct Ret<long> {
+  static inline VarBase *box(const CallCtx &ctx, const long &v) {
+    return make_all<VarInt>((long long)v, ctx.srcId, ctx.idx);
+  }
+};
+template <> struct Ret<int> {
+  static inline VarBase *box(const CallCtx &ctx, const int &v) {
+    return make_all<VarInt>((long long)v, ctx.srcId, ctx.idx);
+  }
+};
+template <> struct Ret<double> {
+  static inline VarBase *box(const CallCtx &ctx, const double &v) {
+    return make_all<VarFloat>(v, ctx.srcId, ctx.idx);
+  }
+};
+template <> struct Ret<bool> {
+  static inline VarBase *box(const CallCtx &ctx, const bool &v) {
+    return v ? ctx.vm.tru : ctx.vm.fals;
+  }
+};
+template <> struct Ret<std::string> {
+  static inline VarBase *box(const CallCtx &ctx, const std::string &v) {
+    return make_all<VarString>(v, ctx.srcId, ctx.idx);
+  }
+};
+template <> struct Ret<VarBase *> {
+  static inline VarBase *box(const CallCtx &ctx, VarBase *v) { return v; }
+};
+
+template <typename R> struct Invoke {
+  template <typename Call>
+  static inline VarBase *run(const CallCtx &ctx, Call &&call) {
+    return Ret<typename std::decay<R>::type>::box(ctx, call());
+  }
+};
+template <> struct Invoke<void> {
+  template <typename Call>
+  static inline VarBase *run(const CallCtx &ctx, Call &&call) {
+    call();
+    return ctx.vm.nil;
+  }
+};
+
+// `first` is the index in `FnData::args` the C++ parameters start at: 1 for
+// functions, 0 for methods which take `self` as first parameter
+template <typename... A> struct Params {
+  static constexpr size_t count = sizeof...(A);
+
+  template <size_t... I>
+  static bool check(const CallCtx &ctx, const FnData &fd, const size_t first,
+                    std::index_sequence<I...>) {
+    VarBase *args[] = {fd.args[first + I]..., nullptr};
+    bool ok[] = {(args[I] && ArgOf<A>::check(args[I]))..., true};
+    std::uintptr_t types[] = {ArgOf<A>::type()..., 0};
+    for (size_t i = 0; i < count; i++) {
+      if (ok[i])
+        continue;
+      if (!args[i]) {
+        ctx.vm.fail(ctx.srcId, ctx.idx, "expected a value to call on");
+        return false;
+      }
+      ctx.vm.fail(args[i]->srcId(), args[i]->idx(),
+                  "argument %zu: expected %s, found %s", first + i,
+                  failType(types[i]), failType(args[i]));
+      return false;
+    }
+    return true;
+  }
+};
+
+template <typename F, F Fn, bool Method> struct Native;
+
+template <typename R, typename... A, R (*Fn)(A...), bool Method>
+struct Native<R (*)(A...), Fn, Method> {
+  static constexpr size_t first = Method ? 0 : 1;
+  static_assert(!Method || sizeof...(A) > 0, "a method must take `self`");
+  /// @brief Number of arguments as seen from June (`self` excluded).
+  static constexpr size_t arity = sizeof...(A) - (Method ? 1 : 0);
+
+  template <size_t... I>
+  static VarBase *unbox(const CallCtx &ctx, const FnData &fd,
+                        std::index_sequence<I...> seq) {
+    if (!Params<A...>::check(ctx, fd, first, seq))
+      return nullptr;
+    return Invoke<R>::run(
+        ctx, [&]() -> R { return Fn(ArgOf<A>::get(fd.args[first + I])...); });
+  }
+
+  static VarBase *call(State &vm, const FnData &fd) {
+    CallCtx ctx{vm, fd.srcId, fd.idx};
+    return unbox(ctx, fd, std::index_sequence_for<A...>());
+  }
+};
+
+template <typename R, typename... A, R (*Fn)(const CallCtx &, A...),
+          bool Method>
+struct Native<R (*)(const CallCtx &, A...), Fn, Method> {
+  static constexpr size_t first = Method ? 0 : 1;
+  static_assert(!Method || sizeof...(A) > 0, "a method must take `self`");
+  static constexpr size_t arity = sizeof...(A) - (Method ? 1 : 0);
+
+  template <size_t... I>
+  static VarBase *unbox(const CallCtx &ctx, const FnData &fd,
+                        std::index_sequence<I...> seq) {
+    if (!Params<A...>::check(ctx, fd, first, seq))
+      return nullptr;
+    return Invoke<R>::run(ctx, [&]() -> R {
+      return Fn(ctx, ArgOf<A>::get(fd.args[first + I])...);
+    });
+  }
+
+  static VarBase *call(State &vm, const FnData &fd) {
+    CallCtx ctx{vm, fd.srcId, fd.idx};
+    return unbox(ctx, fd, std::index_sequence_for<A...>());
+  }
+};
+
+static constexpr int kAnyArity = -1;
+
+/// @brief Creates a function object calling `Fn` through its trampoline.
+///        `Arity`, if given, must match what is deduced from `Fn`.
+template <typename F, F Fn, int Arity = kAnyArity, bool Method = false>
+VarFunc *native(const std::string &srcName, const size_t &srcId,
+                const size_t &idx) {
+  using N = Native<F, Fn, Method>;
+  static_assert(Arity == kAnyArity || (size_t)Arity == N::arity,
+                "native function arity does not match its registration");
+  return new VarFunc(srcName, "", std::vector<std::string>(N::arity, ""),
+                     {.native = N::call}, true, srcId, idx);
+}
+
+/// @brief Adds `Fn` as a function of a source (module).
+template <typename F, F Fn, int Arity = kAnyArity>
+void addFn(VarSrc *src, const std::string &name) {
+  src->vars()->add(name,
+                   native<F, Fn, Arity>(src->src()->path(), src->src()->id(), 0),
+                   false);
+}
+
+/// @brief Adds `Fn` as a global function.
+template <typename F, F Fn, int Arity = kAnyArity>
+void addGlobal(State &vm, const std::string &name, const size_t &srcId,
+               const size_t &idx) {
+  vm.globalAdd(name,
+               native<F, Fn, Arity>(vm.currentSourceFile()->path(), srcId, idx),
+               false);
+}
+
+/// @brief Adds `Fn` as a method of type `T`, its first parameter is `self`.
+template <typename T, typename F, F Fn, int Arity = kAnyArity>
+void addTypeFn(State &vm, const std::string &name, const size_t &srcId,
+               const size_t &idx) {
+  vm.addTypeFn(type_id<T>(), name,
+               native<F, Fn, Arity, true>(vm.currentSourceFile()->path(),
+                                          srcId, idx),
+               false);
+}
+
+} // namespace bind
+} // namespace june
+
+/// @brief Expands to the template arguments binding a C++ function, e.g.
+///        `bind::addGlobal<JuneBind(fn)>(vm, "fn", srcId, idx)`.
+#define JuneBind(fn) decltype(&fn), &fn
+
+#endif
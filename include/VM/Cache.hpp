@@ -0,0 +1,39 @@
+#ifndef vm_cache_hpp
+#define vm_cache_hpp
+
+#include <string>
+
+#include "SrcFile.hpp"
+
+namespace june {
+
+namespace cache {
+
+/// @brief Enables or disables the cache, it is enabled unless `JUNE_NO_CACHE`
+///        is set.
+void setEnabled(const bool &enabled);
+bool enabled();
+
+/// @brief Directory of the cache entries this VM can read: `JUNE_CACHE_DIR`,
+///        else `$XDG_CACHE_HOME/june`, else `~/.cache/june`, followed by the
+///        VM version and revision, the bytecode version and the version of the
+///        passes. Empty if there is none.
+std::string dir();
+
+/// @brief Path of the entry for `src`, named after the SHA-256 digest and
+///        length of its text. Empty if `src` was not read from a source file.
+std::string entryPath(const SrcFile &src);
+
+/// @brief Loads the bytecode of `src` from the cache, returns false if there
+///        is no usable entry and `src` needs compiling.
+bool fetch(SrcFile &src);
+
+/// @brief Stores the compiled bytecode of `src`. The entry is written to a
+///        temporary file and renamed into place, so concurrent readers see
+///        either no entry or a complete one.
+bool store(const SrcFile &src);
+
+} // namespace cache
+} // namespace june
+
+#endif
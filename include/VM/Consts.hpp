@@ -7,6 +7,7 @@
 
 namespace june {
 namespace constants {
+// returns an owned reference (the singletons are immortal)
 VarBase *get(State &vm, const OpDataType type, const OpData &opData,
              const size_t &srcId, const size_t &idx);
 }
@@ -0,0 +1,83 @@
+#ifndef vm_exec_hpp
+#define vm_exec_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../Common.hpp"
+#include "OpCodes.hpp"
+#include "State.hpp"
+
+namespace june {
+
+namespace vm {
+
+/// @brief What running an op left to do. A failure an `or` caught already
+///        moved `Frame::i` to the handler.
+enum Step : std::uint8_t {
+  StepNext,
+  /// @brief Go on at the target of the op.
+  StepJump,
+  StepCaught,
+  /// @brief The function returned, or `exit` was called.
+  StepReturn,
+  /// @brief The function failed, `Frame::err` says why when running a whole
+  ///        source.
+  StepFail,
+};
+
+/// @brief A running `exec`: the function body, or top level of a source, in
+///        [begin, end) of `bcode`, and the op it is at.
+struct Frame {
+  State &vm;
+  const Bytecode *customBytecode;
+  const Bytecode *bcode;
+  VarSrc *src;
+  Vars *vars;
+  Stack *vms;
+  size_t begin;
+  size_t end;
+  size_t base;
+  size_t i;
+  /// @brief Set if the function passed `verify::function`.
+  bool verified;
+  std::vector<FnBodySpan> bodies;
+  std::vector<VarBase *> args;
+  std::vector<bool> argsOwned;
+  std::string err;
+};
+
+// The ops as the interpreter runs them, `pos` is where the op is in the
+// bytecode. Code compiled by `aot` calls them in place of the interpreter and
+// jumps itself, `Verified` variants skip the checks `verify` made once.
+
+/// @brief Fails once the calls running nest deeper than the VM allows.
+Step guardStack(Frame &f, const size_t &pos);
+Step load(Frame &f, const size_t &pos);
+void unload(Frame &f);
+template <bool Verified> Step create(Frame &f, const size_t &pos);
+Step store(Frame &f, const size_t &pos);
+void blockAdd(Frame &f, const size_t &count);
+void blockRem(Frame &f, const size_t &count);
+/// @brief OpJumpTrue, OpJumpFalse, their popping variants and OpJumpNil.
+Step branch(Frame &f, const size_t &pos);
+void bodyMarker(Frame &f, const size_t &pos);
+template <bool Verified> Step makeFunc(Frame &f, const size_t &pos);
+/// @brief OpCall and OpMemberCall.
+template <bool Verified> Step call(Frame &f, const size_t &pos);
+Step attr(Frame &f, const size_t &pos);
+/// @brief OpReturn, the result is left for `exec` to return.
+Step ret(Frame &f, const size_t &pos);
+/// @brief What falling off the end of the function does.
+Step finish(Frame &f);
+void pushLoop(Frame &f);
+void popLoop(Frame &f);
+void loopContinue(Frame &f);
+void guardFn(Frame &f, const size_t &pos);
+
+} // namespace vm
+
+} // namespace june
+
+#endif
@@ -1,33 +1,45 @@
 #ifndef vm_failstack_hpp
 #define vm_failstack_hpp
 
-#include <deque>
 #include <vector>
 
+#include "OpCodes.hpp"
 #include "Vars/Base.hpp"
 
 namespace june {
 
+// `or` regions cost nothing while nothing fails: instead of marking each
+// region as it is entered, every running `exec` registers its position once
+// and the bytecode's handler table is consulted when a failure happens
 class FailStack {
-  std::vector<std::deque<VarBase *>> _stack;
+  struct Frame {
+    const Bytecode *bc;
+    size_t begin;
+    const size_t *pos;
+  };
+
+  std::vector<Frame> _frames;
+  std::vector<VarBase *> _pending;
 
 public:
   FailStack();
   ~FailStack();
 
-  inline void blka() { _stack.push_back(std::deque<VarBase *>()); }
-  inline void blkr() {
-    for (auto &e : _stack.back())
-      varDref(e);
-    _stack.pop_back();
+  inline void enter(const Bytecode *bc, const size_t &begin,
+                    const size_t *pos) {
+    _frames.push_back({bc, begin, pos});
   }
+  inline void leave() { _frames.pop_back(); }
 
-  void push(VarBase *val, const bool iref = true);
-  VarBase *pop(const bool dref = true);
+  // checks whether a failure right now would be handled by an `or` in any of
+  // the running frames
+  bool caught() const;
 
-  inline size_t size() const { return _stack.size(); }
-  inline bool empty() const { return _stack.empty(); }
-  inline bool backEmpty() const { return _stack.back().empty(); }
+  void push(VarBase *val, const bool iref = true);
+  // returns the first failure since the last one was handled and releases
+  // the others, nullptr if there was none
+  VarBase *take();
+  void clear();
 };
 } // namespace june
 
@@ -0,0 +1,75 @@
+#ifndef vm_feedback_hpp
+#define vm_feedback_hpp
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../Common.hpp"
+#include "OpCodes.hpp"
+
+namespace june {
+
+struct State;
+
+namespace feedback {
+
+enum Kind {
+  KindUnseen,      // the op never ran
+  KindMonomorphic, // always the same type
+  KindPolymorphic, // a few types, up to `TypeFeedback::kMaxTypes`
+  KindMegamorphic, // more than that
+
+  _KindLast
+};
+
+extern const char *KindStrs[_KindLast];
+
+/// @brief Whether ops record the types they see, off unless enabled.
+extern bool recording;
+void setRecording(const bool &enabled);
+
+/// @brief Checks if `op` has a feedback slot. It records the callee of
+///        OpCall, the object of OpMemberCall and OpAttr, the value assigned by
+///        OpStore and the value jumps test.
+bool records(const OpCodes op);
+
+void observe(TypeFeedback &slot, const std::uintptr_t &type);
+Kind kind(const TypeFeedback &slot);
+
+/// @brief What the ops of one kind at a position of a source saw, merged
+///        over every copy of them (inlined bodies keep their positions).
+struct Site {
+  size_t idx;
+  OpCodes op;
+  Kind kind;
+  /// @brief Names of the types seen, the first few of them if megamorphic.
+  std::vector<std::string> types;
+};
+
+/// @brief Sites of one source, sorted by position then op.
+using Sites = std::vector<Site>;
+
+/// @brief Gets the site of `op` at `idx`, null if nothing was recorded there.
+const Site *find(const Sites &sites, const size_t &idx, const OpCodes op);
+
+/// @brief Feedback of a run, by source path.
+using Profile = std::unordered_map<std::string, Sites>;
+
+using DumpResult = err::Result<size_t, std::string>;
+using ReadResult = err::Result<Profile, std::string>;
+
+/// @brief Writes the feedback recorded in every loaded source to `path`, one
+///        line per site:
+///            <source path> TAB <position> TAB <op> TAB <kind> TAB <types>
+///        with the type names separated by commas. Returns the sites written.
+DumpResult dump(State &vm, const std::string &path);
+/// @brief Reads feedback written by `dump`.
+ReadResult read(const std::string &path);
+
+} // namespace feedback
+
+} // namespace june
+
+#endif
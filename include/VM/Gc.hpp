@@ -0,0 +1,76 @@
+#ifndef vm_gc_hpp
+#define vm_gc_hpp
+
+#include <cstddef>
+#include <vector>
+
+#include "Vars/Base.hpp"
+
+namespace june {
+
+/// @brief Walks the references a container holds, see `VarBase::traverse`.
+class GcVisitor {
+public:
+  virtual ~GcVisitor() = default;
+
+  /// @brief Called before visiting storage that may be shared between
+  ///        several values (copy-on-write buffers, module scopes), returns
+  ///        false if it was already visited during this pass.
+  virtual bool enter(const void *storage) = 0;
+  virtual void visit(VarBase *child) = 0;
+};
+
+namespace gc {
+
+struct Stats {
+  /// @brief Containers examined.
+  size_t tracked;
+  /// @brief Containers freed because they were only kept alive by cycles.
+  size_t reclaimed;
+};
+
+static constexpr size_t kThresholdDefault = 10000;
+
+/// @brief Registers a container with the cycle collector.
+void track(VarBase *var);
+/// @brief Unregisters a container, called when it is destroyed.
+void untrack(VarBase *var);
+
+/// @brief Sets how many containers may be allocated between automatic
+///        collections, 0 disables them.
+void setThreshold(const size_t &threshold);
+/// @brief Checks whether enough containers were allocated since the last
+///        collection to warrant an automatic one.
+bool pending();
+
+/// @brief Runs a synchronous trial-deletion pass over every tracked container
+///        and frees the ones that are only referenced by cycles.
+///
+/// This must not run concurrently with other threads using June values.
+Stats collect();
+
+/// @brief Values a chain of releases frees inline, counted from the
+///        outermost one over every container it frees. The elements past it
+///        go to the deferred free queue.
+static constexpr size_t kFreeBudget = 1024;
+/// @brief Nesting depth of inline releases after which elements are deferred
+///        as well, keeps deep structures from overflowing the native stack.
+static constexpr size_t kFreeDepth = 64;
+/// @brief How many deferred values a safe point in `vm::exec` releases.
+static constexpr size_t kReclaimBudget = 256;
+
+/// @brief Releases the elements of a container that is being destroyed,
+///        either inline or by moving them onto the deferred free queue.
+void release(std::vector<VarBase *> &vals);
+/// @brief Checks whether the deferred free queue holds anything.
+bool deferred();
+/// @brief Releases up to `budget` values from the deferred free queue, or all
+///        of them (including the ones queued meanwhile) if `budget` is 0.
+///        Each batch taken is one release chain. Returns the number of values
+///        released.
+size_t reclaim(const size_t &budget);
+
+} // namespace gc
+} // namespace june
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef vm_linetable_hpp
+#define vm_linetable_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace june {
+
+/// @brief Maps source indices onto lines. Lines are stored as LEB128 encoded
+///        (gap from the previous line's end, length) pairs, with the absolute
+///        start of every `kBlockLines`th line kept aside so a lookup is a
+///        binary search over blocks followed by a short scan of one block.
+///
+/// The encoded stream is also the line table section of `.junec` files.
+class LineTable {
+  static constexpr size_t kBlockLines = 64;
+
+  size_t _count;
+  size_t _lastEnd;
+  std::vector<std::uint8_t> _deltas;
+  std::vector<size_t> _blockBegin;
+  std::vector<size_t> _blockOffset;
+
+public:
+  LineTable();
+
+  /// @brief Appends a line, lines must be added in increasing order.
+  void add(const size_t &begin, const size_t &end);
+  void clear();
+
+  /// @brief Finds the line containing `idx`, returns false if there is none.
+  bool find(const size_t &idx, size_t &line, size_t &begin,
+            size_t &end) const;
+
+  inline size_t size() const { return _count; }
+  inline bool empty() const { return _count == 0; }
+  inline const std::vector<std::uint8_t> &encoded() const { return _deltas; }
+
+  /// @brief Rebuilds a table from `count` lines of an encoded stream, returns
+  ///        false if the stream is truncated or malformed.
+  static bool decode(const std::uint8_t *data, const size_t &size,
+                     const size_t &count, LineTable &table);
+};
+
+} // namespace june
+
+#endif
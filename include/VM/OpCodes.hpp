@@ -2,9 +2,14 @@
 #define vm_opcodes_hpp
 
 #include "Common.hpp"
+#include "LineTable.hpp"
+#include "StringArena.hpp"
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace june {
@@ -51,6 +56,9 @@ enum OpCodes {
                    // OpPushJump)
   OpPopJump, // unmarks the position to jump to if `or` exists in an expression
 
+  OpGuardFn, // pushes whether the top element is the function whose body
+             // starts at `n` (guards inlined calls)
+
   _OpLast
 };
 
@@ -86,12 +94,158 @@ struct Op {
 
 std::string opAsString(Op op);
 
+/// @brief Checks if the `data.sz` operand of `op` is the position of an op:
+///        jumps, body markers, `or` handlers and function guards.
+bool hasOpTarget(const OpCodes op);
+
+/// @brief Ops inserted before the op at `at`, which must not end a function
+///        body. They are only reached from the op before them or through their
+///        own jumps: the targets of ops flagged in `local` are indices into
+///        `ops`, the others positions in the bytecode.
+struct Splice {
+  size_t at;
+  std::vector<Op> ops;
+  std::vector<bool> local;
+};
+
+/// @brief An `or` protected region, the ops in [begin, end) jump to `target`
+///        on failure. It is what an OpPushJump/OpPopJump pair marked, from the
+///        op after the OpPushJump (and its OpPushJumpNamed) to the OpPopJump.
+struct Handler {
+  size_t begin;
+  size_t end;
+  size_t target;
+  /// @brief Variable the failure is stored in (OpPushJumpNamed), or null.
+  const char *name;
+  /// @brief First op of the function body the region belongs to, 0 for the
+  ///        top level of the source.
+  size_t owner;
+};
+
+class VarBase;
+
+namespace vm {
+struct Frame;
+enum Step : std::uint8_t;
+} // namespace vm
+
+/// @brief A function body, or the top level of a source, compiled by `aot`
+///        into native code running it from its first op.
+struct CompiledBody {
+  size_t begin;
+  vm::Step (*run)(vm::Frame &f);
+};
+
+/// @brief What a lookup in a loop last resolved to: the variable loaded by an
+///        OpLoad, or the module attribute of an OpAttr/OpMemberCall, which it
+///        holds a reference to. It holds while the lookup runs in the same
+///        function frame (the module's current one for attributes) and the
+///        `Vars::epoch` of the module looked in has not changed.
+struct LookupCache {
+  VarBase *val;
+  size_t frame;
+  size_t epoch;
+  std::string name;
+
+  LookupCache();
+  LookupCache(const LookupCache &other);
+  LookupCache &operator=(const LookupCache &other);
+  ~LookupCache();
+
+  /// @brief Releases the value, the cache misses until filled again.
+  void drop();
+};
+
+/// @brief Types of the values an op worked on, see `feedback::observe`.
+struct TypeFeedback {
+  static constexpr size_t kMaxTypes = 4;
+
+  std::uintptr_t types[kMaxTypes];
+  unsigned char count;
+  /// @brief Set once more than `kMaxTypes` types were seen.
+  bool megamorphic;
+};
+
+namespace fs {
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long long u64;
+typedef long long i64;
+typedef double f64;
+
+/// @brief Version of the .junec format written and read by this VM.
+static const u32 kBytecodeVersion = 5;
+
+typedef std::pair<OpData, OpDataType> Const;
+
+/// @brief A function body kept encoded in a loaded file until it is first
+///        called, it decodes to the ops in [begin, begin + count).
+struct CodeBlock {
+  size_t begin;
+  size_t count;
+  const u8 *data;
+  size_t size;
+  /// @brief Checksum of the `size` bytes, checked when they are decoded.
+  u64 sum;
+};
+
+/// @brief Checks the bytes of `block` against its checksum.
+bool intact(const CodeBlock &block);
+
+/// @brief Decodes `count` ops from the `size` bytes at `data` into `out`,
+///        resolving operands through `consts`. Fails on malformed input. The
+///        bytes read are stored in `used` if given, else they must be `size`.
+bool decodeOps(const u8 *data, const size_t &size, const size_t &count,
+               const std::vector<Const> &consts, Op *out,
+               size_t *used = nullptr);
+
+} // namespace fs
+
 struct Bytecode {
 private:
   std::vector<Op> bytecode;
 
+  // built once the bytecode is loaded, by where the regions begin, and
+  // extended as bodies are decoded; the markers they were built from are
+  // stripped from the ops then
+  std::vector<Handler> handlers;
+  bool handlersBuilt = false;
+
+  // file the ops were loaded from, string operands pointing into it are
+  // borrowed from it
+  std::shared_ptr<const fs::MappedFile> backing;
+  // holds every other string operand, shared with copies of the bytecode
+  std::shared_ptr<StringArena> strings;
+  // operands of the loaded file, and its function bodies not decoded yet
+  std::vector<fs::Const> consts;
+  std::vector<fs::CodeBlock> pending;
+
+  // functions that passed `verify::function`, by first op (0 for the top
+  // level), with their max stack depth, and the depth each of their `or`
+  // handlers cuts the stack back to, by the first op of their region; stale
+  // once ops are added
+  std::unordered_map<size_t, size_t> verified;
+  std::unordered_map<size_t, size_t> handlerDepths;
+  size_t verifiedFor = -1;
+  // caches of the loop lookups of verified functions, by op: 0 for none,
+  // else the index of the cache + 1
+  std::vector<size_t> lookupAt;
+  mutable std::vector<LookupCache> lookups;
+  // by op, allocated on the first type recorded
+  mutable std::vector<TypeFeedback> feedback;
+  // native code of functions, by first op, owned by the shared object it
+  // was loaded from
+  const CompiledBody *compiled = nullptr;
+  size_t compiledCount = 0;
+
+  void verifyFn(const size_t &begin, const size_t &end);
+  bool isPending(const size_t &begin) const;
+  void stripRegions(const size_t &from, const size_t &to, const size_t &owner,
+                    std::vector<Handler> &found);
+
 public:
-  ~Bytecode();
 
   void add(const size_t &idx, const OpCodes op);
   void adds(const size_t &idx, const OpCodes op, const OpDataType dtype,
@@ -102,31 +256,86 @@ public:
   void addf(const size_t &idx, const OpCodes op, const std::string &data);
 
   OpCodes at(const size_t &pos) const;
+
+  /// @brief Builds the `or` handler table from the OpPushJump/OpPopJump pairs
+  ///        and strips the pairs from the ops, the last step of loading them.
+  ///        Ops only move up to the next body marker or body end, jumping
+  ///        there where the pairs were. Bodies still encoded are done once
+  ///        decoded. Does nothing if the table was built already.
+  void buildHandlers();
+  /// @brief Takes `table` as the handler table of ops whose pairs were
+  ///        stripped already, names are interned in the bytecode.
+  void assignHandlers(std::vector<Handler> &&table);
+  /// @brief Finds the innermost handler covering the op at `pos` that belongs
+  ///        to the function body starting at `owner`.
+  const Handler *handlerAt(const size_t &pos, const size_t &owner) const;
+  inline const std::vector<Handler> &handlerTable() const { return handlers; }
+  inline bool hasHandlers() const { return handlersBuilt; }
   void updatesz(const size_t &pos, const size_t &value);
 
+  /// @brief Replaces the ops with ones loaded from `file`, the ones of the
+  ///        `pending` function bodies are decoded when first needed. The
+  ///        handler table is dropped until built again.
+  void assign(std::vector<Op> &&ops, std::shared_ptr<const fs::MappedFile> file,
+              std::vector<fs::Const> &&consts = {},
+              std::vector<fs::CodeBlock> &&pending = {});
+  /// @brief Decodes the function body starting at `begin` if it was left
+  ///        encoded on load. Fails if the body turns out to be damaged or
+  ///        malformed.
+  bool decodeBody(const size_t &begin);
+  /// @brief Decodes every function body left encoded.
+  bool decodeAll();
+  /// @brief Removes the ops flagged in `dead`, ops targeting a removed one
+  ///        target the op that followed it. Fails if bodies are still encoded
+  ///        or the handler table was built, the regions are not marked then.
+  bool erase(const std::vector<bool> &dead);
+  /// @brief Same as `erase`, then inserts `splices`, sorted by position. The
+  ///        string operands of their ops are interned in the bytecode.
+  bool rewrite(const std::vector<bool> &dead, std::vector<Splice> &&splices);
+  inline bool hasPending() const { return !pending.empty(); }
+
+  /// @brief Gets the bytecode's copy of `str`, for use as a string operand of
+  ///        its ops. Operands are stored once however many ops use them.
+  char *intern(const char *str);
+
+  /// @brief Verifies the top level and every decoded function body, bodies
+  ///        decoded later are verified then. Functions that fail it keep
+  ///        running through the checked interpreter.
+  void verify();
+  /// @brief Gets the max stack depth of the function starting at `begin` if
+  ///        it was verified.
+  bool verifiedDepth(const size_t &begin, size_t &depth) const;
+  /// @brief Gets the stack depth the verified handler of the `or` region
+  ///        starting at `pushJump` begins with.
+  bool handlerDepth(const size_t &pushJump, size_t &depth) const;
+  /// @brief Gets the cache of the op at `pos` if it is a lookup of a verified
+  ///        function's loop, null otherwise.
+  LookupCache *lookupCache(const size_t &pos) const;
+  /// @brief Visits the values the lookup caches hold.
+  void eachCached(const std::function<void(VarBase *)> &fn) const;
+  /// @brief Releases the values the lookup caches hold, they miss until
+  ///        filled again.
+  void dropCached();
+
+  /// @brief Gets the type feedback slot of the op at `pos`, the slots are
+  ///        cleared if ops were added or removed since they were allocated.
+  TypeFeedback &feedbackAt(const size_t &pos) const;
+  inline const std::vector<TypeFeedback> &feedbackSlots() const {
+    return feedback;
+  }
+
+  /// @brief Runs the functions of `bodies`, sorted by first op, through their
+  ///        native code once verified. Dropped when the ops are replaced.
+  void assignCompiled(const CompiledBody *bodies, const size_t &count);
+  /// @brief Gets the compiled code of the function starting at `begin`, null
+  ///        if it has none.
+  const CompiledBody *compiledAt(const size_t &begin) const;
+
   inline const std::vector<Op> &get() const { return bytecode; }
   inline std::vector<Op> &getMut() { return bytecode; }
   inline size_t size() const { return bytecode.size(); }
 };
 
-struct FileCompatibleOp {
-  size_t srcId;
-  size_t idx;
-  OpCodes op;
-  OpDataType type;
-  size_t dataIndex;
-};
-
-struct FileCompatibleBytecode {
-  std::vector<std::pair<OpData, OpDataType>> compressedData;
-  std::vector<FileCompatibleOp> bytecode;
-};
-
-using DecompressResult = err::Result<std::vector<Op>, std::string>;
-
-FileCompatibleBytecode compressBytecode(const std::vector<Op> &bytecode);
-DecompressResult decompressBytecode(const FileCompatibleBytecode &bytecode);
-
 struct SrcColRange {
   size_t begin;
   size_t end;
@@ -134,23 +343,27 @@ struct SrcColRange {
 
 namespace fs {
 
-typedef unsigned char u8;
-typedef unsigned short u16;
-typedef unsigned int u32;
-typedef unsigned long long u64;
-typedef long long i64;
-typedef double f64;
-
 struct ValidRead {
   std::vector<Op> bytecode;
-  std::vector<SrcColRange> srcRanges;
+  LineTable lines;
+  std::vector<Const> consts;
+  /// @brief Function bodies left encoded, sorted by position.
+  std::vector<CodeBlock> pending;
 };
 
 using ReadResult = err::Result<ValidRead, std::string>;
 
-u8 *writeBytecode(const std::vector<Op> &bytecode,
-                  const std::vector<SrcColRange> &srcRanges);
-ReadResult readBytecode(const u8 *bytecode);
+using WriteResult = err::Result<size_t, std::string>;
+
+/// @brief Writes the bytecode to `fd` from its current position, streamed
+///        through a bounded buffer. `fd` must be seekable, the header is
+///        filled in last. Returns the number of bytes written.
+WriteResult writeBytecode(int fd, const std::vector<Op> &bytecode,
+                          const LineTable &lines);
+/// @brief Decodes the `size` bytes at `bytecode`, checking every read against
+///        the end. String operands point into `bytecode`, which must outlive
+///        the ops.
+ReadResult readBytecode(const u8 *bytecode, const size_t &size);
 
 } // namespace fs
 
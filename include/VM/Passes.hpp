@@ -0,0 +1,135 @@
+#ifndef vm_passes_hpp
+#define vm_passes_hpp
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Feedback.hpp"
+#include "OpCodes.hpp"
+
+namespace june {
+
+namespace passes {
+
+/// @brief What a pass changed, summed over every function it ran on.
+struct Stats {
+  /// @brief Ops rewritten in place.
+  size_t rewritten;
+  /// @brief Ops removed.
+  size_t removed;
+};
+
+/// @brief The ops of one function, [begin, end) without the bodies nested in
+///        it. Passes flag ops in `dead` rather than erasing them, and queue
+///        ops to insert in `splices`, they are removed or inserted (and jumps
+///        retargeted) once the pass ran over every function.
+struct Function {
+  std::vector<Op> &ops;
+  size_t begin;
+  size_t end;
+  /// @brief First op of the function each op of the bytecode belongs to.
+  const std::vector<size_t> &owners;
+  /// @brief Ops of the bytecode something jumps to, or a handler starts at.
+  const std::vector<bool> &targets;
+  std::vector<bool> &dead;
+  std::vector<Splice> &splices;
+  /// @brief Types the ops of the source saw in a recorded run, or null.
+  const feedback::Sites *feedback;
+
+  /// @brief Gets what the op at `pos` saw in the recorded run, null if
+  ///        nothing was recorded for it. The cache is keyed by the source
+  ///        alone, a pass specializing on this must keep what it compiles
+  ///        out of it.
+  inline const feedback::Site *seen(const size_t &pos) const {
+    return feedback ? feedback::find(*feedback, ops[pos].idx, ops[pos].op)
+                    : nullptr;
+  }
+  /// @brief The op of the function after `pos`, nested bodies are skipped.
+  inline size_t next(const size_t &pos) const {
+    return ops[pos].op == OpBodyMarker ? ops[pos].data.sz : pos + 1;
+  }
+  /// @brief Checks if `pos` is an op of the function.
+  inline bool owns(const size_t &pos) const {
+    return pos < ops.size() && owners[pos] == begin;
+  }
+};
+
+/// @brief A transformation of function bodies, it must leave each function
+///        as valid as it found it.
+class Pass {
+public:
+  virtual ~Pass() = default;
+
+  virtual const char *name() const = 0;
+  /// @brief Called with the whole bytecode before the pass runs on each of
+  ///        its functions.
+  virtual void start(const std::vector<Op> &ops) {}
+  virtual void run(Function &fn, Stats &stats) = 0;
+};
+
+/// @brief Jumps to an OpJump go to where it jumps instead, an OpJump to the
+///        op after it is removed.
+std::unique_ptr<Pass> jumpThreading();
+/// @brief Removes the ops no path of the function reaches.
+std::unique_ptr<Pass> deadCode();
+/// @brief Resolves conditional jumps on a bool or nil constant loaded just
+///        before them.
+std::unique_ptr<Pass> constantConditions();
+/// @brief Removes OpBlkA/OpBlkR pairs around straight-line code that binds
+///        nothing.
+std::unique_ptr<Pass> emptyBlocks();
+/// @brief Removes constants loaded only to be unloaded.
+std::unique_ptr<Pass> unusedLoads();
+/// @brief Copies the bodies of small functions into the calls of them by
+///        name, behind a guard falling back to the call if the name holds
+///        another value when run. A call is inlined if:
+///         - its arguments are constants or variables, each loaded by one op,
+///         - the function takes exactly those, never binds or assigns to a
+///           name, calls nothing but members, has no loops or `or` regions,
+///         - it loads each parameter once, in order, before anything but
+///           constants, so arguments are evaluated as the call would,
+///         - the names it loads mean the same in the caller,
+///         - its body is at most `kMaxInlineOps` long.
+std::unique_ptr<Pass> inlineCalls();
+
+/// @brief Longest function body `inlineCalls` copies.
+static constexpr size_t kMaxInlineOps = 32;
+
+/// @brief Version of what `Manager::standard` makes of a bytecode, bumped with
+///        every change to the output of a pass. Cached bytecode of another
+///        version is compiled again.
+static const unsigned kVersion = 1;
+
+/// @brief Runs its passes over every function of a bytecode, in the order
+///        they were added, until none changes anything.
+class Manager {
+  std::vector<std::unique_ptr<Pass>> _passes;
+  std::vector<Stats> _stats;
+
+public:
+  /// @brief Rounds of the whole pipeline run at most on a bytecode.
+  static constexpr size_t kMaxRounds = 4;
+
+  void add(std::unique_ptr<Pass> pass);
+
+  /// @brief Optimizes `bc`, which must have no encoded bodies left, with the
+  ///        type feedback of its source if there is some. Returns whether
+  ///        anything changed.
+  bool run(Bytecode &bc, const feedback::Sites *feedback = nullptr);
+
+  /// @brief Prints what each pass did, over every bytecode it ran on.
+  void print(std::ostream &out) const;
+  /// @brief What the pass added `pass`-th did, over every bytecode it ran on.
+  inline const Stats &stats(const size_t &pass) const { return _stats[pass]; }
+
+  /// @brief The pipeline sources are compiled with, holding every pass above.
+  static Manager &standard();
+};
+
+} // namespace passes
+
+} // namespace june
+
+#endif
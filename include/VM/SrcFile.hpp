@@ -2,6 +2,7 @@
 #define vm_srcfile_hpp
 
 #include <cassert>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -15,7 +16,12 @@ class SrcFile {
   std::string _dir;
   std::string _path;
   std::string _data;
-  std::vector<SrcColRange> _cols;
+  LineTable _lines;
+  // hash of the text read from `_path`, checked when it is re-read after
+  // `dropData`
+  std::uint64_t _hash;
+  bool _dataFromFile;
+  bool _dataDropped;
 
   Bytecode _bytecode;
 
@@ -27,17 +33,28 @@ public:
           const bool isMain = false);
 
   err::Errors loadFile();
+  /// @brief Replaces the bytecode with the one stored in the .junec at `path`.
+  err::Errors loadBytecode(const std::string &path);
 
   void addData(const std::string &data);
+  // releases the source text once the file is compiled, unless sources are
+  // retained (the default), diagnostics then re-read the line from disk
+  void dropData();
+  static void setRetainData(const bool &retain);
   void addCols(const std::vector<SrcColRange> &cols);
+  void setLines(const LineTable &lines);
   void addBytecode(const std::vector<june::Op> &bytecode);
 
   inline size_t id() const { return _id; }
   inline const std::string &dir() const { return _dir; }
   inline const std::string &path() const { return _path; }
   inline const std::string &data() const { return _data; }
+  inline const LineTable &lines() const { return _lines; }
+  /// @brief Hash of the text read from the file, 0 if it wasn't read from one.
+  inline std::uint64_t hash() const { return _hash; }
 
   Bytecode &bytecode() { return _bytecode; }
+  inline const Bytecode &bytecode() const { return _bytecode; }
   inline bool isMain() const { return _isMain; }
   inline bool isBytecode() const { return _isBytecode; }
 
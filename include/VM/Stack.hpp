@@ -7,21 +7,57 @@
 
 namespace june {
 
+/// @brief A slot on the VM stack. Owned slots hold a reference that is
+///        released when popped, borrowed slots point at a value owned by
+///        something else (usually a variable) and release nothing.
+struct StackSlot {
+  VarBase *val;
+  bool owned;
+};
+
+/// @brief The VM stack.
+///
+/// Values loaded from variables are pushed as borrowed references, everything
+/// else is owned by the stack. A borrowed value is only promoted to an owned
+/// one when it is stored (see `pop`) or when the bindings it was borrowed from
+/// may go away (see `own`).
 class Stack {
-  std::vector<VarBase *> _vec;
+  std::vector<StackSlot> _vec;
+  size_t _borrowed;
 
 public:
   Stack();
   ~Stack();
 
   void push(VarBase *val, const bool iref = true);
-  VarBase *pop(const bool dref = true);
+  // pushes a borrowed reference, `val` must outlive the slot or be promoted
+  // through `own()` first
+  void pushBorrowed(VarBase *val);
 
-  inline VarBase *&back() { return _vec.back(); }
-  inline std::vector<VarBase *> &get() { return _vec; }
+  // when `dref` is false, the caller receives an owned reference (borrowed
+  // slots are promoted)
+  VarBase *pop(const bool dref = true);
+  // pops without touching the reference count, `owned` tells whether the
+  // caller must release the value
+  VarBase *popRef(bool &owned);
+
+  // promotes every borrowed slot to an owned one
+  void own();
+
+  // pops (releasing) until `size` values are left
+  void trim(const size_t &size);
+  // makes room for `size` values, growing geometrically so that reserving a
+  // little more for every call doesn't reallocate each time
+  void reserve(const size_t &size);
+
+  inline VarBase *back() const { return _vec.back().val; }
+  inline VarBase *at(const size_t &pos) const { return _vec[pos].val; }
+  inline bool backOwned() const { return _vec.back().owned; }
+  inline bool hasBorrowed() const { return _borrowed > 0; }
   inline size_t size() const { return _vec.size(); }
   inline bool empty() const { return _vec.empty(); }
 };
+
 } // namespace june
 
 #endif
@@ -9,6 +9,7 @@
 #include "Common.hpp"
 #include "Dylib.hpp"
 #include "FailStack.hpp"
+#include "Gc.hpp"
 #include "SrcFile.hpp"
 #include "Stack.hpp"
 #include "VM/Vars/Base.hpp"
@@ -51,6 +52,9 @@ template <typename T, typename... Args> T *make_all(Args... args) {
   return res;
 }
 
+// method names interned by every `State` in this order
+enum MethodSym : std::uint32_t { MsToStr, MsToBool, MsApply, _MsLast };
+
 struct State {
   bool exitCalled;
   bool execStackCountExceeded;
@@ -78,6 +82,7 @@ struct State {
 
   void pushSrc(SrcFile *src, const size_t &idx);
   void pushSrc(const std::string &srcPath);
+  void pushSrc(VarSrc *src);
   void popSrc();
 
   bool juneModuleExists(std::string &mod, const std::string &ext,
@@ -98,6 +103,14 @@ struct State {
 
   inline VarSrc *currentSource() const { return srcStack.back(); }
   inline SrcFile *currentSourceFile() const { return srcStack.back()->src(); }
+  // looks up a loaded source by the id of its SrcFile, nullptr if none
+  inline VarSrc *srcById(const size_t &srcId) const {
+    return srcId < _srcsById.size() ? _srcsById[srcId] : nullptr;
+  }
+
+  // marks a value as immortal, the state takes ownership and frees it on
+  // destruction
+  void immortalize(VarBase *val);
 
   void globalAdd(const std::string &name, VarBase *val, const bool iref = true);
   VarBase *globalGet(const std::string &name);
@@ -107,6 +120,7 @@ struct State {
                     const size_t &idx = 0) {
     setTypeName(type_id<T...>(), name);
     VarTypeId *typeVar = make_all<VarTypeId>(type_id<T...>(), srcId, idx);
+    immortalize(typeVar);
     if (srcStack.empty())
       globalAdd(name, typeVar);
     else
@@ -126,6 +140,10 @@ struct State {
               true);
   }
   VarBase *getTypeFn(VarBase *val, const std::string &name);
+  // resolves a method through the type's flattened table, a single probe
+  VarBase *getTypeFn(VarBase *val, const std::uint32_t &sym);
+  // interns a method name, the names in `MethodSym` are interned up front
+  std::uint32_t methodSym(const std::string &name);
 
   void setTypeName(const std::uintptr_t &type, const std::string &name);
   std::string getTypeName(const std::uintptr_t &type);
@@ -134,19 +152,49 @@ struct State {
   inline const std::string &selfBin() const { return _selfBin; }
   inline const std::string &selfBase() const { return _selfBase; }
 
-  void fail(const size_t &srcId, const size_t &idx, const char *msg, ...);
+  // `fmt` is a printf style format literal, a failure caught by an `or` keeps
+  // pointing at it with the raw arguments and is only rendered on demand.
+  // Taking an array keeps formats built at run time, which may not outlive
+  // the failure, from compiling
+  template <size_t N, typename... Args>
+  void fail(const size_t &srcId, const size_t &idx, const char (&fmt)[N],
+            const Args &...args) {
+    if (!fails.caught() || this->exitCalled) {
+      report(srcId, idx, failRender(*this, fmt, {failArg(args)...}));
+      return;
+    }
+    fails.push(new VarFailure(*this, fmt, {failArg(args)...}, srcId, idx),
+               false);
+  }
   // `msg` is nullable
   void fail(const size_t &srcId, const size_t &idx, VarBase *val,
             const char *msg, const bool &iref = true);
 
   bool loadCoreModules();
 
+  // runs the cycle collector, see `gc::collect`
+  gc::Stats collectCycles();
+
 private:
+  // prints a failure with the location it happened at
+  void report(const size_t &srcId, const size_t &idx, const std::string &msg);
+
   LoadCodeFn srcLoadCodeFn;
   ReadCodeFn srcReadCodeFn;
 
   std::unordered_map<std::string, VarBase *> _globals;
+  // dense index over `allSrcs`, which still owns the sources
+  std::vector<VarSrc *> _srcsById;
+  std::vector<VarBase *> _immortals;
   std::unordered_map<std::uintptr_t, VarsFrame *> _typeFns;
+  // method tables indexed by type slot (see `types::index`) then method
+  // symbol, the `VarAll` methods are merged into each of them. `_typeFns`
+  // still owns the functions.
+  std::unordered_map<std::string, std::uint32_t> _methodSyms;
+  std::vector<std::vector<VarBase *>> _methodTables;
+  std::vector<bool> _hasMethods;
+
+  std::vector<VarBase *> &methodTable(const std::uint16_t &slot);
   std::unordered_map<std::uintptr_t, std::string> _typeNames;
   std::unordered_map<std::string, ModDeInitFn> _modDeInitFns;
   std::string _selfBin;
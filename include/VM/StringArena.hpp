@@ -0,0 +1,50 @@
+#ifndef vm_stringarena_hpp
+#define vm_stringarena_hpp
+
+#include <cstddef>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace june {
+
+/// @brief Owns NUL terminated strings packed one after the other in large
+///        blocks, each distinct string stored once. The strings live as long
+///        as the arena and are released with it, all at once.
+class StringArena {
+  struct Hash {
+    size_t operator()(const char *str) const;
+  };
+  struct Equal {
+    bool operator()(const char *a, const char *b) const;
+  };
+
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  // free space at the end of the block strings are packed into
+  char *_head;
+  size_t _left;
+  size_t _bytes;
+  std::unordered_set<const char *, Hash, Equal> _strings;
+
+public:
+  /// @brief Size of the blocks strings are packed into, strings longer than
+  ///        a quarter of it get a block of their own.
+  static constexpr size_t kBlockSize = 4 * 1024;
+
+  StringArena();
+  StringArena(const StringArena &) = delete;
+  StringArena &operator=(const StringArena &) = delete;
+
+  /// @brief Gets the arena's copy of `str`, storing it if it is not there
+  ///        yet. A string of the arena is its own copy.
+  const char *intern(const char *str);
+
+  /// @brief Distinct strings stored.
+  inline size_t size() const { return _strings.size(); }
+  /// @brief Bytes taken by the strings, terminators included.
+  inline size_t bytes() const { return _bytes; }
+};
+
+} // namespace june
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef vm_varint_hpp
+#define vm_varint_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace june {
+
+/// @brief LEB128 encoding, as used by the line table and .junec files.
+namespace varint {
+
+/// @brief Longest encoding of a 64 bit value.
+static constexpr size_t kMaxBytes = 10;
+
+inline void write(std::vector<std::uint8_t> &out, std::uint64_t val) {
+  while (val >= 0x80) {
+    out.push_back((std::uint8_t)(val | 0x80));
+    val >>= 7;
+  }
+  out.push_back((std::uint8_t)val);
+}
+
+/// @brief Encodes into `out`, which holds at least `kMaxBytes`, returns the
+///        number of bytes used.
+inline size_t write(std::uint8_t *out, std::uint64_t val) {
+  size_t n = 0;
+  while (val >= 0x80) {
+    out[n++] = (std::uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  out[n++] = (std::uint8_t)val;
+  return n;
+}
+
+/// @brief Reads a value at `pos` and moves past it, returns false if it runs
+///        past `size` or doesn't fit 64 bits.
+template <typename T>
+inline bool read(const std::uint8_t *data, const size_t &size, size_t &pos,
+                 T &val) {
+  std::uint64_t res = 0;
+  for (size_t shift = 0; pos < size && shift < 64; shift += 7) {
+    std::uint8_t b = data[pos++];
+    res |= (std::uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      val = (T)res;
+      return true;
+    }
+  }
+  return false;
+}
+
+// signed values are zigzag encoded so small negative ones stay short
+inline std::uint64_t zigzag(const std::int64_t &val) {
+  return ((std::uint64_t)val << 1) ^ (std::uint64_t)(val >> 63);
+}
+
+inline void writeSigned(std::vector<std::uint8_t> &out, std::int64_t val) {
+  write(out, zigzag(val));
+}
+
+inline bool readSigned(const std::uint8_t *data, const size_t &size,
+                       size_t &pos, std::int64_t &val) {
+  std::uint64_t raw;
+  if (!read(data, size, pos, raw))
+    return false;
+  val = (std::int64_t)(raw >> 1) ^ -(std::int64_t)(raw & 1);
+  return true;
+}
+
+} // namespace varint
+} // namespace june
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef vm_vars_hpp
 #define vm_vars_hpp
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -27,6 +29,7 @@ public:
 
   void add(const std::string &name, VarBase *val, const bool iref);
   void rem(const std::string &name, const bool dref);
+  void clear();
 
   static void *operator new(size_t sz);
   static void operator delete(void *ptr, size_t sz);
@@ -36,11 +39,16 @@ class VarsStack {
   std::vector<size_t> _loopsFrom;
   std::vector<VarsFrame *> _stack;
   size_t _top;
+  size_t _serial;
 
 public:
   VarsStack();
   ~VarsStack();
 
+  // unique to this stack among all created, never reused
+  inline size_t serial() const { return _serial; }
+  inline size_t top() const { return _top; }
+
   // checks if a variable exists in the current scope
   bool exists(const std::string &name);
 
@@ -58,17 +66,30 @@ public:
 
   void add(const std::string &name, VarBase *val, const bool iref);
   void rem(const std::string &name, const bool dref);
+
+  void each(const std::function<void(VarBase *)> &fn) const;
+  void clear();
 };
 
 class Vars {
   size_t _fnStack;
+  size_t _frame;
   std::unordered_map<std::string, VarBase *> _stash;
   std::unordered_map<size_t, VarsStack *> _fnVars;
+  std::atomic<size_t> _epoch;
 
 public:
   Vars();
   ~Vars();
 
+  // serial of the current function's stack, see `LookupCache`
+  inline size_t frame() const { return _frame; }
+  // changes whenever a binding of the module is added or removed where a
+  // function's ops cannot see it happen: at module level, through natives or
+  // from another module
+  inline size_t epoch() const { return _epoch.load(std::memory_order_acquire); }
+  inline void bumpEpoch() { _epoch.fetch_add(1, std::memory_order_acq_rel); }
+
   // checks if a variable exists in the current scope
   bool exists(const std::string &name);
 
@@ -76,6 +97,9 @@ public:
   bool existsGlobal(const std::string &name);
 
   VarBase *get(const std::string &name);
+  // same as above, `fromFn` tells if it was found in the current function's
+  // scopes rather than at module level
+  VarBase *get(const std::string &name, bool &fromFn);
 
   void blkAdd(const size_t &count);
   void blkRem(const size_t &count);
@@ -94,6 +118,11 @@ public:
   // add a variable to module level unconditionally
   void addm(const std::string &name, VarBase *val, const bool &iref);
   void rem(const std::string &name, const bool &dref);
+
+  // visits every value held in any scope (including stashed ones)
+  void each(const std::function<void(VarBase *)> &fn) const;
+  // releases every value held in any scope, the scopes themselves are kept
+  void clear();
 };
 
 } // namespace june
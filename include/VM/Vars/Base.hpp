@@ -1,9 +1,9 @@
 #ifndef vm_vars_base_hpp
 #define vm_vars_base_hpp
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
-#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -17,23 +17,110 @@ enum VarInfo {
   ViAttrBased = 1 << 1,
   ViLoadAsRef = 1 << 2,
   // ViUnmanaged = 1 << 3
+  ViImmortal = 1 << 4, // never refcounted nor freed by varDref
 };
 
+/// @brief Tags for the builtin types, used to skip virtual dispatch and the
+///        type table on hot paths. Any other type is tagged `VtOther`.
+enum VarTag : std::uint8_t {
+  VtOther,
+  VtAll,
+  VtNil,
+  VtTypeId,
+  VtBool,
+  VtInt,
+  VtFloat,
+  VtString,
+  VtVec,
+  VtFunc,
+  VtSrc,
+  VtFailure,
+  _VtLast
+};
+
+class VarAll;
+class VarNil;
+class VarTypeId;
+class VarBool;
+class VarInt;
+class VarFloat;
+class VarString;
+class VarVec;
+class VarFunc;
+class VarSrc;
+class VarFailure;
+
+template <typename T> struct VarTagOf {
+  static constexpr VarTag value = VtOther;
+};
+template <> struct VarTagOf<VarAll> { static constexpr VarTag value = VtAll; };
+template <> struct VarTagOf<VarNil> { static constexpr VarTag value = VtNil; };
+template <> struct VarTagOf<VarTypeId> {
+  static constexpr VarTag value = VtTypeId;
+};
+template <> struct VarTagOf<VarBool> {
+  static constexpr VarTag value = VtBool;
+};
+template <> struct VarTagOf<VarInt> { static constexpr VarTag value = VtInt; };
+template <> struct VarTagOf<VarFloat> {
+  static constexpr VarTag value = VtFloat;
+};
+template <> struct VarTagOf<VarString> {
+  static constexpr VarTag value = VtString;
+};
+template <> struct VarTagOf<VarVec> { static constexpr VarTag value = VtVec; };
+template <> struct VarTagOf<VarFunc> {
+  static constexpr VarTag value = VtFunc;
+};
+template <> struct VarTagOf<VarSrc> { static constexpr VarTag value = VtSrc; };
+template <> struct VarTagOf<VarFailure> {
+  static constexpr VarTag value = VtFailure;
+};
+
+namespace origins {
+/// @brief Interns a (srcId, idx) pair, returning its index in the origin
+///        table. Index 0 is always (0, 0).
+std::uint32_t intern(const size_t &srcId, const size_t &idx);
+/// @brief Gets the (srcId, idx) pair for an interned origin, without taking
+///        the lock `intern` adds them under.
+void get(const std::uint32_t &origin, size_t &srcId, size_t &idx);
+} // namespace origins
+
+#if JuneMemDebug == true
+// reference count operations, printed when the `State` is destroyed
+namespace stats {
+extern std::atomic<size_t> irefs;
+extern std::atomic<size_t> drefs;
+extern std::atomic<size_t> borrows;
+} // namespace stats
+#endif
+
+namespace types {
+static constexpr size_t kMaxTypes = 4096;
+/// @brief Maps a type id onto its slot in the type table, registering it if
+///        it hasn't been seen before. Builtin types use their tag as slot.
+std::uint16_t index(const std::uintptr_t &type);
+/// @brief Gets the type id stored in a slot of the type table.
+std::uintptr_t at(const std::uint16_t &index);
+} // namespace types
+
 struct State;
+class GcVisitor;
+// The header is kept to 16 bytes (plus the vtable): a 32-bit reference count,
+// a 32-bit index into the origin table in place of srcId/idx, a 16-bit slot in
+// the type table in place of the full type id, the builtin tag and the flags.
 class VarBase {
-  std::mutex mtx; // TODO: remove/replace
-  std::uintptr_t _type;
-  size_t _srcId;
-  size_t _idx;
-  size_t _refCount;
-
+  std::atomic<std::uint32_t> _refCount;
+  std::uint32_t _origin;
+  std::uint16_t _typeIdx;
+  VarTag _tag;
   char _info;
 
   template <typename T> static inline std::uintptr_t _type_id() {
     return reinterpret_cast<std::uintptr_t>(&_type_id<T>);
   }
 
-  template <typename T> friend size_t type_id();
+  template <typename T> friend std::uintptr_t type_id();
 
 public:
   VarBase(const std::uintptr_t &type, const size_t &srcId, const size_t &idx,
@@ -41,7 +128,9 @@ public:
   virtual ~VarBase();
 
   template <typename T> bool isa() const {
-    return _type == VarBase::_type_id<T>();
+    if (VarTagOf<T>::value != VtOther)
+      return _tag == VarTagOf<T>::value;
+    return type() == VarBase::_type_id<T>();
   }
 
   template <typename T> T *as() {
@@ -58,29 +147,49 @@ public:
   bool toBool(State &vm, bool &data, const size_t &srcId, const size_t &idx);
 
   inline void setSrcIdAndIdx(const size_t &srcId, const size_t &idx) {
-    _srcId = srcId;
-    _idx = idx;
+    _origin = origins::intern(srcId, idx);
   }
 
-  inline std::uintptr_t type() const { return _type; }
+  inline VarTag tag() const { return _tag; }
+  inline std::uint16_t typeIdx() const { return _typeIdx; }
+  inline std::uintptr_t type() const { return types::at(_typeIdx); }
   virtual std::uintptr_t typeFnId() const;
 
-  inline size_t srcId() const { return _srcId; }
-  inline size_t idx() const { return _idx; }
+  inline size_t srcId() const {
+    size_t srcId, idx;
+    origins::get(_origin, srcId, idx);
+    return srcId;
+  }
+  inline size_t idx() const {
+    size_t srcId, idx;
+    origins::get(_origin, srcId, idx);
+    return idx;
+  }
 
   inline void iref() {
-    std::lock_guard<std::mutex> lock(mtx);
-    _refCount++;
+    if (_info & ViImmortal)
+      return;
+#if JuneMemDebug == true
+    ++stats::irefs;
+#endif
+    _refCount.fetch_add(1, std::memory_order_relaxed);
   }
 
+  // returns the remaining count, which is never 0 for immortal values
   inline size_t dref() {
-    std::lock_guard<std::mutex> lock(mtx);
-    assert(_refCount > 0);
-    _refCount--;
-    return _refCount;
+    if (_info & ViImmortal)
+      return 1;
+#if JuneMemDebug == true
+    ++stats::drefs;
+#endif
+    std::uint32_t prev = _refCount.fetch_sub(1, std::memory_order_acq_rel);
+    assert(prev > 0);
+    return prev - 1;
   }
 
-  inline size_t refCount() const { return _refCount; }
+  inline size_t refCount() const {
+    return _refCount.load(std::memory_order_acquire);
+  }
 
   inline bool isCallable() const { return _info & VarInfo::ViCallable; }
   inline bool isAttrBased() const { return _info & VarInfo::ViAttrBased; }
@@ -89,6 +198,11 @@ public:
   inline void setLoadAsRef() { _info |= VarInfo::ViLoadAsRef; }
   inline void unsetLoadAsRef() { _info &= ~VarInfo::ViLoadAsRef; }
 
+  // immortal values (singletons, type objects) are owned by the `State` and
+  // may be shared between threads without touching the reference count
+  inline bool isImmortal() const { return _info & VarInfo::ViImmortal; }
+  inline void setImmortal() { _info |= VarInfo::ViImmortal; }
+
   virtual VarBase *call(State &vm, const std::vector<VarBase *> &args,
                         const size_t &srcId, const size_t &idx);
 
@@ -96,6 +210,11 @@ public:
   virtual void attrSet(const std::string &attr, VarBase *val, const bool iref);
   virtual VarBase *attrGet(const std::string &attr);
 
+  // used by the cycle collector (see Gc.hpp): containers report the
+  // references they hold and drop them all on request
+  virtual void traverse(GcVisitor &visitor);
+  virtual void clearRefs();
+
   static void *operator new(size_t sz);
   static void operator delete(void *ptr, size_t sz);
 };
@@ -113,8 +232,7 @@ template <typename T> inline void varIref(T *var) {
 template <typename T> inline void varDref(T *&var) {
   if (var == nullptr)
     return;
-  var->dref();
-  if (var->refCount() == 0) {
+  if (var->dref() == 0) {
     delete var;
     var = nullptr;
   }
@@ -124,8 +242,7 @@ template <typename T> inline void varDref(T *&var) {
 template <typename T> inline void varDrefConst(const T *var) {
   if (var == nullptr)
     return;
-  var->dref();
-  if (var->refCount() == 0) {
+  if (var->dref() == 0) {
     delete var;
   }
 }
@@ -203,23 +320,52 @@ public:
 };
 #define AsFloat(x) static_cast<VarFloat *>(x)
 
+// Strings and vectors share their storage between copies, it is only copied
+// when one of the sharing values is mutated through `get()`. Read-only users
+// should go through `view()`.
 class VarString : public VarBase {
-  std::string _data;
+  struct Buf {
+    std::atomic<std::uint32_t> refs;
+    std::string data;
+
+    static void *operator new(size_t sz);
+    static void operator delete(void *ptr, size_t sz);
+  };
+  Buf *_buf;
+
+  VarString(Buf *buf, const size_t &srcId, const size_t &idx);
+  void unshare();
 
 public:
   VarString(const std::string &val, const size_t &srcId, const size_t &idx);
+  ~VarString();
 
   VarBase *copy(const size_t &srcId, const size_t &idx);
   void set(VarBase *from);
 
   std::string &get();
+  inline const std::string &view() const { return _buf->data; }
+  inline bool isShared() const {
+    return _buf->refs.load(std::memory_order_acquire) > 1;
+  }
 };
 #define AsString(x) static_cast<VarString *>(x)
 
 class VarVec : public VarBase {
-  std::vector<VarBase *> _data;
+  struct Buf {
+    std::atomic<std::uint32_t> refs;
+    std::vector<VarBase *> data;
+
+    static void *operator new(size_t sz);
+    static void operator delete(void *ptr, size_t sz);
+  };
+  Buf *_buf;
   bool _refs;
 
+  VarVec(Buf *buf, const bool &refs, const size_t &srcId, const size_t &idx);
+  void unshare();
+  static void release(Buf *buf);
+
 public:
   VarVec(const std::vector<VarBase *> &val, const bool &refs,
          const size_t &srcId, const size_t &idx);
@@ -232,11 +378,105 @@ public:
   VarBase *attrGet(const std::string &attr);
   bool attrExists(const std::string &attr) const;
 
+  void traverse(GcVisitor &visitor);
+  void clearRefs();
+
+  // mutable access, this also covers mutating the elements in place
   std::vector<VarBase *> &get();
+  inline const std::vector<VarBase *> &view() const { return _buf->data; }
+  inline bool isShared() const {
+    return _buf->refs.load(std::memory_order_acquire) > 1;
+  }
   bool isRefVec();
 };
 #define AsVec(x) static_cast<VarVec *>(x)
 
+// A raw argument of a failure message, kept as is until the message is
+// rendered. Type names are stored as type ids and only looked up then.
+struct FailArg {
+  enum Kind : char { FaInt, FaUInt, FaFloat, FaStr, FaType } kind;
+  union {
+    long long i;
+    unsigned long long u;
+    double f;
+    std::uintptr_t type;
+  };
+  std::string s;
+};
+
+// wraps a value whose type name is part of a failure message
+struct FailType {
+  std::uintptr_t type;
+};
+FailType failType(const VarBase *val);
+inline FailType failType(const std::uintptr_t &type) { return {type}; }
+
+inline FailArg failArg(const long long &v) {
+  FailArg a{FailArg::FaInt, {}, {}};
+  a.i = v;
+  return a;
+}
+inline FailArg failArg(const long &v) { return failArg((long long)v); }
+inline FailArg failArg(const int &v) { return failArg((long long)v); }
+inline FailArg failArg(const unsigned long long &v) {
+  FailArg a{FailArg::FaUInt, {}, {}};
+  a.u = v;
+  return a;
+}
+inline FailArg failArg(const unsigned long &v) {
+  return failArg((unsigned long long)v);
+}
+inline FailArg failArg(const unsigned int &v) {
+  return failArg((unsigned long long)v);
+}
+inline FailArg failArg(const double &v) {
+  FailArg a{FailArg::FaFloat, {}, {}};
+  a.f = v;
+  return a;
+}
+inline FailArg failArg(const char *v) {
+  return FailArg{FailArg::FaStr, {}, v ? v : "(null)"};
+}
+inline FailArg failArg(const std::string &v) {
+  return FailArg{FailArg::FaStr, {}, v};
+}
+inline FailArg failArg(const FailType &v) {
+  FailArg a{FailArg::FaType, {}, {}};
+  a.type = v.type;
+  return a;
+}
+
+// renders a printf style format with the recorded arguments
+std::string failRender(State &vm, const char *fmt,
+                       const std::vector<FailArg> &args);
+
+// A failure caught by an `or`. The message is only rendered when it is
+// needed: an `or` naming the failure binds the message as a string, one that
+// does not drops the failure as is.
+class VarFailure : public VarBase {
+  State *_vm;
+  // a format literal, `State::fail` takes nothing else
+  const char *_fmt;
+  std::vector<FailArg> _args;
+  std::string _msg;
+  bool _rendered;
+
+public:
+  VarFailure(State &vm, const char *fmt, std::vector<FailArg> &&args,
+             const size_t &srcId, const size_t &idx);
+
+  VarBase *copy(const size_t &srcId, const size_t &idx);
+  void set(VarBase *from);
+
+  bool attrExists(const std::string &attr) const;
+  void attrSet(const std::string &attr, VarBase *val, const bool iref);
+  VarBase *attrGet(const std::string &attr);
+
+  inline const char *fmt() const { return _fmt; }
+  const std::string &msg();
+};
+#define AsFailure(x) static_cast<VarFailure *>(x)
+
 struct FnBodySpan {
   size_t begin;
   size_t end;
@@ -253,6 +493,8 @@ struct FnBodySpan {
 //   VarBase *val;
 // };
 
+// `args` are borrowed references: they stay valid for the duration of the
+// call, a native function that keeps one must `iref` it
 struct FnData {
   size_t srcId;
   size_t idx;
@@ -268,13 +510,33 @@ union FnBody {
   FnBodySpan june;
 };
 
+// Everything about a function that doesn't change between its copies, shared
+// by all of them. `src` is resolved from `srcName` on the first call of a June
+// function if it wasn't known when the prototype was made; it is borrowed,
+// `State::allSrcs` keeps sources alive.
+struct FnProto {
+  std::atomic<std::uint32_t> refs;
+  std::string srcName;
+  std::string varArg;
+  std::vector<std::string> args;
+  FnBody body;
+  bool isNative;
+  VarSrc *src;
+
+  FnProto(const std::string &srcName, const std::string &varArg,
+          const std::vector<std::string> &args, const FnBody &body,
+          const bool isNative, VarSrc *src = nullptr);
+
+  inline size_t arity() const { return args.size(); }
+
+  static void *operator new(size_t sz);
+  static void operator delete(void *ptr, size_t sz);
+};
+
 class VarFunc : public VarBase {
-  std::string _srcName;
-  std::vector<std::string> _args;
-  // std::unordered_map<std::string, VarBase *> _assnArgs;
-  FnBody _body;
-  std::string _varArg;
-  bool _isNative;
+  FnProto *_proto;
+
+  static void release(FnProto *proto);
 
 public:
   VarFunc(const std::string &srcName,
@@ -282,17 +544,21 @@ public:
           // const std::unordered_map<std::string, VarBase *> &assnArgs,
           const FnBody &body, const bool isNative, const size_t &srcId,
           const size_t &idx);
+  // adopts the caller's reference to `proto`
+  VarFunc(FnProto *proto, const size_t &srcId, const size_t &idx);
+  ~VarFunc();
 
   VarBase *copy(const size_t &srcId, const size_t &idx);
   void set(VarBase *from);
 
-  bool isNative() const;
-  bool isJune() const;
+  inline bool isNative() const { return _proto->isNative; }
+  inline bool isJune() const { return !_proto->isNative; }
 
-  std::string &srcName();
-  std::string &varArg();
-  std::vector<std::string> &args();
-  FnBody &body();
+  inline const std::string &srcName() const { return _proto->srcName; }
+  inline const std::string &varArg() const { return _proto->varArg; }
+  inline const std::vector<std::string> &args() const { return _proto->args; }
+  inline const FnBody &body() const { return _proto->body; }
+  inline FnProto *proto() const { return _proto; }
 
   VarBase *call(State &vm, const std::vector<VarBase *> &args,
                 const size_t &srcId, const size_t &idx);
@@ -317,6 +583,9 @@ public:
   void attrSet(const std::string &name, VarBase *val, const bool iref);
   VarBase *attrGet(const std::string &name);
 
+  void traverse(GcVisitor &visitor);
+  void clearRefs();
+
   void addNativeFn(const std::string &name, NativeFnPtr fn,
                    const size_t &argsCount = 0, const bool &isVarArgs = false);
   void addNativeVar(const std::string &name, VarBase *var,
@@ -327,6 +596,52 @@ public:
 };
 #define AsSrc(x) static_cast<VarSrc *>(x)
 
+// Devirtualized `copy` and `set` for the builtin types; anything else goes
+// through the vtable.
+inline VarBase *varCopy(VarBase *var, const size_t &srcId, const size_t &idx) {
+  switch (var->tag()) {
+  case VtNil:
+    return AsNil(var)->VarNil::copy(srcId, idx);
+  case VtTypeId:
+    return AsTypeId(var)->VarTypeId::copy(srcId, idx);
+  case VtBool:
+    return AsBool(var)->VarBool::copy(srcId, idx);
+  case VtInt:
+    return AsInt(var)->VarInt::copy(srcId, idx);
+  case VtFloat:
+    return AsFloat(var)->VarFloat::copy(srcId, idx);
+  case VtString:
+    return AsString(var)->VarString::copy(srcId, idx);
+  case VtVec:
+    return AsVec(var)->VarVec::copy(srcId, idx);
+  default:
+    return var->copy(srcId, idx);
+  }
+}
+
+inline void varSet(VarBase *var, VarBase *from) {
+  switch (var->tag()) {
+  case VtBool:
+    AsBool(var)->VarBool::set(from);
+    break;
+  case VtInt:
+    AsInt(var)->VarInt::set(from);
+    break;
+  case VtFloat:
+    AsFloat(var)->VarFloat::set(from);
+    break;
+  case VtString:
+    AsString(var)->VarString::set(from);
+    break;
+  case VtVec:
+    AsVec(var)->VarVec::set(from);
+    break;
+  default:
+    var->set(from);
+    break;
+  }
+}
+
 void initTypenames(State &vm);
 
 } // namespace june
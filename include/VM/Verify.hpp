@@ -0,0 +1,72 @@
+#ifndef vm_verify_hpp
+#define vm_verify_hpp
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../Common.hpp"
+#include "OpCodes.hpp"
+
+namespace june {
+
+namespace verify {
+
+/// @brief What is known about a verified function.
+struct FnInfo {
+  /// @brief Deepest the function's own part of the stack gets.
+  size_t maxDepth;
+  /// @brief Depth the stack is cut back to when each `or` handler of the
+  ///        function is entered, by the first op of the handler's region.
+  std::vector<std::pair<size_t, size_t>> handlers;
+  /// @brief Lookups inside the function's loops whose result may be kept
+  ///        across iterations: loads of names the function never binds, and
+  ///        attributes and member calls (kept only for modules).
+  std::vector<size_t> lookups;
+};
+
+using Result = err::Result<FnInfo, std::string>;
+
+/// @brief The most values `op` pops off the stack. Ops with malformed
+///        operands pop nothing, they are rejected by `function`.
+size_t pops(const Op &op);
+/// @brief The values `op` pushes onto the stack, jumps aside.
+size_t pushes(const Op &op);
+/// @brief Whether the conditional jump `op` leaves the value it tests on the
+///        stack when it jumps (`taken`) or falls through. OpJumpTrue and
+///        OpJumpFalse pop it when it is false, so one keeps it when jumping
+///        and the other when falling through; OpJumpNil pops it when jumping
+///        and the popping variants always do.
+inline bool keeps(const OpCodes &op, const bool &taken) {
+  switch (op) {
+  case OpJumpTrue:
+    return taken;
+  case OpJumpFalse:
+  case OpJumpNil:
+    return !taken;
+  default:
+    return false;
+  }
+}
+
+/// @brief Checks the function whose ops are [begin, end), the top level of
+///        the source if `begin` is 0, once and for all so that it can run
+///        without the interpreter's per-op checks:
+///         - jump targets are ops of the function, or its end, and so are
+///           the regions and targets of its `or` handlers in the handler
+///           table, which must be built,
+///         - the stack depth is the same on every path into an op and never
+///           drops below what an op pops, nor below the depth an `or` region
+///           began at while inside it,
+///         - every OpMakeFunc has a body marked before it, and the names it
+///           (and OpCreate and OpMemberCall) take are string constants,
+///         - operands have the type their op reads.
+///        Bodies nested in the function are skipped, they are checked on
+///        their own.
+Result function(const Bytecode &bc, const size_t &begin, const size_t &end);
+
+} // namespace verify
+
+} // namespace june
+
+#endif
@@ -48,6 +48,9 @@ enum OpCodes {
                    // OpPushJump)
   OpPopJump, // unmarks the position to jump to if `or` exists in an expression
 
+  OpGuardFn, // pushes whether the top element is the function whose body
+             // starts at `n` (guards inlined calls)
+
   _OpLast
 };
 
@@ -56,7 +59,7 @@ static const char *OpCodeCStrs[_OpLast] = {
     "JumpTrue",      "JumpFalse", "JumpTruePop", "JumpFalsePop", "JumpNil",
     "BodyMarker",    "MakeFunc",  "BlkA",        "BlkR",         "Call",
     "MemberCall",    "Attr",  "Return",     "PushLoop",    "PopLoop", "Continue", "Break",      "PushJump",
-    "PushJumpNamed", "PopJump"};
+    "PushJumpNamed", "PopJump", "GuardFn"};
 
 enum OpDataType {
   OdtInt,
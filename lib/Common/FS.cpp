@@ -4,13 +4,16 @@
 
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstdio>
 #include <fstream>
 #include <filesystem>
 
 #ifndef _WIN32
 #include <dirent.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #else
@@ -33,6 +36,55 @@ Result<std::string, Error> june::fs::readFile(const std::string &path){
   return Res::Ok(buffer.str());
 }
 
+june::fs::MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (_mapped) {
+    munmap(const_cast<unsigned char *>(_data), _size);
+    return;
+  }
+#endif
+  delete[] _data;
+}
+
+Result<std::shared_ptr<const june::fs::MappedFile>, Error>
+june::fs::MappedFile::open(const std::string &path) {
+  using Res = Result<std::shared_ptr<const MappedFile>, Error>;
+  std::shared_ptr<MappedFile> file(new MappedFile());
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return Res::Err(Error(ErrFileIo, "failed to open file for reading: " + path));
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return Res::Err(Error(ErrFileIo, "not a non-empty regular file: " + path));
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file alive
+  if (data == MAP_FAILED)
+    return Res::Err(Error(ErrFileIo, "failed to map file: " + path));
+  file->_data = static_cast<const unsigned char *>(data);
+  file->_size = st.st_size;
+  file->_mapped = true;
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+    return Res::Err(Error(ErrFileIo, "failed to open file for reading: " + path));
+  std::streamsize size = in.tellg();
+  if (size <= 0)
+    return Res::Err(Error(ErrFileIo, "not a non-empty regular file: " + path));
+  unsigned char *data = new unsigned char[size];
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(data), size)) {
+    delete[] data;
+    return Res::Err(Error(ErrFileIo, "failed to read file: " + path));
+  }
+  file->_data = data;
+  file->_size = size;
+#endif
+  return Res::Ok(file);
+}
+
 Result<bool, Error> june::fs::exists(const std::string &path) {
 #if defined(_WIN32)
   return _access(path.c_str(), 0) == 0;
@@ -46,6 +98,23 @@ Result<bool, Error> june::fs::exists(const std::string &path) {
 #endif
 }
 
+Result<bool, Error> june::fs::makeDirs(const std::string &path) {
+  using Res = Result<bool, Error>;
+  for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1)) {
+    std::string dir = path.substr(0, pos);
+#if defined(_WIN32)
+    int res = _mkdir(dir.c_str());
+#else
+    int res = mkdir(dir.c_str(), 0755);
+#endif
+    if (res != 0 && errno != EEXIST)
+      return Res::Err(Error(ErrFileIo, "failed to create directory: " + dir));
+    if (pos == std::string::npos)
+      break;
+  }
+  return Res::Ok(true);
+}
+
 std::string june::fs::absPath(const std::string &path, std::string *parentDir,
                               const bool &dirAddDoubleDot) {
   char abs[kMaxPathChars];
@@ -1,3 +1,4 @@
+#include <VM/Bind.hpp>
 #include <VM/State.hpp>
 #include <cstdio>
 
@@ -16,43 +17,31 @@ VarBase *print(State &vm, const FnData &fd) {
   return vm.nil;
 }
 
-VarBase *import(State &vm, const FnData &fd) {
-  VarBase *entry = fd.args[1];
-  if (!entry->isa<VarString>()) {
-    vm.fail(entry->srcId(), entry->idx(),
-            "expected argument to be of type string, found: %s",
-            vm.getTypeName(entry->type()).c_str());
-    return nullptr;
-  }
-  VarString *importFile = entry->as<VarString>();
-
-  auto err = vm.juneModuleLoad(importFile->get(), fd.srcId, fd.idx);
+VarBase *import(const CallCtx &ctx, const std::string &file) {
+  // resolved in place to the loaded module's path
+  std::string mod = file;
+  auto err = ctx.vm.juneModuleLoad(mod, ctx.srcId, ctx.idx);
   if (err.isErr()) {
-    vm.fail(fd.srcId, fd.idx, "failed to import module '%s': %s",
-            importFile->get().c_str(), err.unwrapErr().toString().c_str());
+    ctx.vm.fail(ctx.srcId, ctx.idx, "failed to import module '%s': %s",
+                file.c_str(), err.unwrapErr().toString().c_str());
     return nullptr;
   }
 
-  return vm.allSrcs[importFile->get()];
+  return ctx.vm.allSrcs[mod];
 }
 
-VarBase *importNative(State &vm, const FnData &fd) {
-  VarBase *entry = fd.args[1];
-  if (!entry->isa<VarString>()) {
-    vm.fail(entry->srcId(), entry->idx(),
-            "expected argument to be of type string, found: %s",
-            vm.getTypeName(entry->type()).c_str());
+VarBase *importNative(const CallCtx &ctx, const std::string &file) {
+  if (!ctx.vm.nativeModuleLoad(file, ctx.srcId, ctx.idx)) {
+    ctx.vm.fail(ctx.srcId, ctx.idx, "failed to load native module '%s'",
+                file.c_str());
     return nullptr;
   }
-  VarString *importFile = entry->as<VarString>();
 
-  if (!vm.nativeModuleLoad(importFile->get(), fd.srcId, fd.idx)) {
-    vm.fail(fd.srcId, fd.idx, "failed to load native module '%s'",
-            importFile->get().c_str());
-    return nullptr;
-  }
+  return ctx.vm.nil;
+}
 
-  return vm.nil;
+long long collectCycles(const CallCtx &ctx) {
+  return ctx.vm.collectCycles().reclaimed;
 }
 
 extern "C" bool june_init(State &vm, const size_t srcId, const size_t &idx) {
@@ -60,11 +49,9 @@ extern "C" bool june_init(State &vm, const size_t srcId, const size_t &idx) {
 
   vm.globalAdd("print", new VarFunc(srcName, ".", {}, {.native = print}, true,
                                     srcId, idx));
-  vm.globalAdd("import", new VarFunc(srcName, "", {""}, {.native = import},
-                                     true, srcId, idx));
-  vm.globalAdd("importNative", new VarFunc(srcName, "", {""},
-                                                {.native = importNative},
-                                                true, srcId, idx));
+  bind::addGlobal<JuneBind(import), 1>(vm, "import", srcId, idx);
+  bind::addGlobal<JuneBind(importNative), 1>(vm, "importNative", srcId, idx);
+  bind::addGlobal<JuneBind(collectCycles), 0>(vm, "collectCycles", srcId, idx);
 
   return true;
 }
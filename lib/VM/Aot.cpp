@@ -0,0 +1,399 @@
+#include "VM/Aot.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+#include "Common.hpp"
+#include "VM/SrcFile.hpp"
+#include "VM/State.hpp"
+
+namespace june {
+
+namespace aot {
+
+// writes `size` bytes at `data` as a string literal, broken after each newline
+// onto a line starting with `indent` if one is given
+static void literal(std::ostream &out, const char *data, const size_t &size,
+                    const char *indent = nullptr) {
+  out << '"';
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = data[i];
+    switch (c) {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    case '?': // no trigraphs
+      out << "\\?";
+      break;
+    case '\t':
+      out << "\\t";
+      break;
+    case '\n':
+      out << "\\n";
+      if (indent && i + 1 < size)
+        out << "\"\n" << indent << '"';
+      break;
+    default:
+      if (c < 0x20 || c >= 0x7f) {
+        char esc[5];
+        snprintf(esc, sizeof(esc), "\\%03o", c);
+        out << esc;
+      } else {
+        out << c;
+      }
+    }
+  }
+  out << '"';
+}
+
+static void literal(std::ostream &out, const std::string &str) {
+  literal(out, str.data(), str.size());
+}
+
+// quotes `arg` for the shell
+static std::string quote(const std::string &arg) {
+  std::string quoted = "'";
+  for (char c : arg) {
+    if (c == '\'')
+      quoted += "'\\''";
+    else
+      quoted += c;
+  }
+  return quoted + "'";
+}
+
+// writes the function running the ops in [begin, end) of `bc` as `exec` runs
+// a verified function, bodies nested in it are functions of their own
+static void function(std::ostream &out, const Bytecode &bc,
+                     const size_t &begin, const size_t &end) {
+  const std::vector<Op> &ops = bc.get();
+  // only the ops jumped to get a label
+  std::set<size_t> targets;
+  std::set<size_t> handlers;
+  for (auto &h : bc.handlerTable()) {
+    if (h.owner == begin)
+      handlers.insert(h.target);
+  }
+  for (size_t i = begin; i < end; i++) {
+    // OpGuardFn names a body rather than jumping to it
+    if (hasOpTarget(ops[i].op) && ops[i].op != OpGuardFn)
+      targets.insert(ops[i].data.sz);
+    if (ops[i].op == OpBodyMarker)
+      i = ops[i].data.sz - 1;
+  }
+  targets.insert(handlers.begin(), handlers.end());
+
+  out << "static vm::Step Fn" << begin << "(vm::Frame &f) {\n"
+      << "  JUNE_AOT_RUN(vm::guardStack(f, " << begin << "));\n";
+  for (size_t i = begin; i <= end; i++) {
+    if (targets.count(i))
+      out << "L" << i << ":\n";
+    if (i == end)
+      break;
+    const Op &op = ops[i];
+    size_t target = hasOpTarget(op.op) ? op.data.sz : 0;
+    out << "  ";
+    switch (op.op) {
+    case OpLoad:
+      out << "JUNE_AOT_RUN(vm::load(f, " << i << "));\n";
+      break;
+    case OpUnload:
+      out << "vm::unload(f);\n";
+      break;
+    case OpCreate:
+      out << "JUNE_AOT_RUN(vm::create<true>(f, " << i << "));\n";
+      break;
+    case OpStore:
+      out << "JUNE_AOT_RUN(vm::store(f, " << i << "));\n";
+      break;
+    case OpBlkA:
+      out << "vm::blockAdd(f, " << op.data.sz << ");\n";
+      break;
+    case OpBlkR:
+      out << "vm::blockRem(f, " << op.data.sz << ");\n";
+      break;
+    case OpJump:
+    case OpBreak:
+      out << "goto L" << target << ";\n";
+      break;
+    case OpJumpTrue:
+    case OpJumpTruePop:
+    case OpJumpFalse:
+    case OpJumpFalsePop:
+    case OpJumpNil:
+      out << "JUNE_AOT_BRANCH(vm::branch(f, " << i << "), L" << target
+          << ");\n";
+      break;
+    case OpBodyMarker:
+      out << "vm::bodyMarker(f, " << i << ");\n  goto L" << target << ";\n";
+      i = target - 1;
+      break;
+    case OpMakeFunc:
+      out << "JUNE_AOT_RUN(vm::makeFunc<true>(f, " << i << "));\n";
+      break;
+    case OpMemberCall:
+    case OpCall:
+      out << "JUNE_AOT_RUN(vm::call<true>(f, " << i << "));\n";
+      break;
+    case OpAttr:
+      out << "JUNE_AOT_RUN(vm::attr(f, " << i << "));\n";
+      break;
+    case OpReturn:
+      out << "return vm::ret(f, " << i << ");\n";
+      break;
+    case OpPushLoop:
+      out << "vm::pushLoop(f);\n";
+      break;
+    case OpPopLoop:
+      out << "vm::popLoop(f);\n";
+      break;
+    case OpContinue:
+      out << "vm::loopContinue(f);\n  goto L" << target << ";\n";
+      break;
+    case OpGuardFn:
+      out << "vm::guardFn(f, " << i << ");\n";
+      break;
+    default:
+      // the region markers were stripped with the handler table built
+      out << ";\n";
+    }
+  }
+  out << "  return vm::finish(f);\n";
+
+  // a handler is run like any op, the call nesting is checked again there
+  out << "caught:\n"
+      << "  JUNE_AOT_RUN(vm::guardStack(f, f.i));\n";
+  if (!handlers.empty()) {
+    out << "  switch (f.i) {\n";
+    for (auto &target : handlers)
+      out << "  case " << target << ":\n    goto L" << target << ";\n";
+    out << "  }\n";
+  }
+  out << "  return vm::StepFail;\n"
+      << "}\n\n";
+}
+
+Result emit(SrcFile &src, std::ostream &out) {
+  Bytecode &bc = src.bytecode();
+  bc.buildHandlers();
+  if (!bc.decodeAll())
+    return Result::Err("malformed function body in " + src.path());
+
+  // the functions the verifier rejected are left to the interpreter
+  bc.verify();
+  std::vector<size_t> compiled;
+
+  out << "// Compiled by june from " << src.path() << ", do not edit.\n"
+      << "#include \"VM/Aot.hpp\"\n\n"
+      << "using namespace june;\n\n";
+
+  const std::vector<Op> &ops = bc.get();
+  if (!ops.empty()) {
+    out << "static const aot::ModuleOp Ops[] = {\n";
+    for (auto &op : ops) {
+      out << "    {" << op.idx << ", Op" << OpCodeStrs[op.op] << ", Odt"
+          << OpDataTypeStrs[op.type] << ", ";
+      switch (op.type) {
+      case OdtSize:
+        out << op.data.sz << ", nullptr";
+        break;
+      case OdtBool:
+        out << (op.data.b ? 1 : 0) << ", nullptr";
+        break;
+      case OdtNil:
+        out << "0, nullptr";
+        break;
+      default:
+        out << "0, ";
+        literal(out, op.data.s, strlen(op.data.s));
+      }
+      out << "},\n";
+    }
+    out << "};\n\n";
+  }
+
+  const std::vector<Handler> &handlers = bc.handlerTable();
+  if (!handlers.empty()) {
+    out << "static const Handler Handlers[] = {\n";
+    for (auto &h : handlers) {
+      out << "    {" << h.begin << ", " << h.end << ", " << h.target << ", ";
+      if (h.name)
+        literal(out, h.name, strlen(h.name));
+      else
+        out << "nullptr";
+      out << ", " << h.owner << "},\n";
+    }
+    out << "};\n\n";
+  }
+
+  size_t depth = 0;
+  if (bc.verifiedDepth(0, depth)) {
+    function(out, bc, 0, ops.size());
+    compiled.push_back(0);
+  }
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (ops[i].op == OpBodyMarker && bc.verifiedDepth(i + 1, depth)) {
+      function(out, bc, i + 1, ops[i].data.sz);
+      compiled.push_back(i + 1);
+    }
+  }
+  if (!compiled.empty()) {
+    out << "static const CompiledBody Bodies[] = {\n";
+    for (auto &begin : compiled)
+      out << "    {" << begin << ", Fn" << begin << "},\n";
+    out << "};\n\n";
+  }
+
+  const std::string &text = src.data();
+  if (!text.empty()) {
+    out << "static const char Text[] =\n    ";
+    literal(out, text.data(), text.size(), "    ");
+    out << ";\n\n";
+  }
+  const auto &lines = src.lines().encoded();
+  if (!lines.empty()) {
+    out << "static const std::uint8_t Lines[] = {";
+    for (size_t i = 0; i < lines.size(); i++)
+      out << (i % 12 == 0 ? "\n    " : " ") << (unsigned)lines[i] << ",";
+    out << "\n};\n\n";
+  }
+
+  out << "static const aot::Module Module = {\n"
+      << "    aot::kVersion,\n"
+      << "    _OpLast,\n"
+      << "    _OdtLast,\n    ";
+  literal(out, src.path());
+  out << ",\n    ";
+  literal(out, src.dir());
+  out << ",\n"
+      << "    " << (ops.empty() ? "nullptr" : "Ops") << ",\n"
+      << "    " << ops.size() << ",\n"
+      << "    " << (handlers.empty() ? "nullptr" : "Handlers") << ",\n"
+      << "    " << handlers.size() << ",\n"
+      << "    " << (compiled.empty() ? "nullptr" : "Bodies") << ",\n"
+      << "    " << compiled.size() << ",\n";
+  if (!text.empty())
+    out << "    Text,\n    " << text.size() << ",\n";
+  else
+    out << "    nullptr,\n    0,\n";
+  if (!lines.empty())
+    out << "    Lines,\n    " << lines.size() << ",\n    "
+        << src.lines().size() << ",\n";
+  else
+    out << "    nullptr,\n    0,\n    0,\n";
+  out << "};\n\n"
+      << "extern \"C\" const aot::Module *june_aot_module() { return &Module; "
+         "}\n\n"
+      << "extern \"C\" bool june_init(State &vm, const size_t srcId,\n"
+      << "                          const size_t &idx) {\n"
+      << "  return aot::load(vm, Module, srcId, idx);\n"
+      << "}\n";
+
+  if (!out)
+    return Result::Err("failed writing the source of " + src.path());
+  return Result::Ok();
+}
+
+Result build(const std::string &selfBase, const std::string &cppPath,
+             const std::string &soPath) {
+  std::string cxx = env::get("CXX");
+  if (cxx.empty())
+    cxx = "c++";
+  std::string include = env::get("JUNE_INCLUDE_DIR");
+  if (include.empty())
+    include = selfBase + "/include/june";
+  auto found = fs::exists(include + "/VM/Aot.hpp");
+  if (found.isErr() || !found.unwrap())
+    return Result::Err("VM headers not found in " + include +
+                       ", set JUNE_INCLUDE_DIR to where they are");
+
+  std::string cmd = cxx + " -std=c++14 -O2 -shared -fPIC -I" + quote(include) +
+                    " -o " + quote(soPath) + " " + quote(cppPath);
+#if defined(__APPLE__)
+  // the VM functions it calls are the ones of the program loading it
+  cmd += " -undefined dynamic_lookup";
+#endif
+  if (std::system(cmd.c_str()) != 0)
+    return Result::Err("failed to compile " + cppPath + " with " + cxx);
+  return Result::Ok();
+}
+
+SourceResult source(const Module &mod, const bool &isMain) {
+  if (mod.version != kVersion || mod.opCount != _OpLast ||
+      mod.typeCount != _OdtLast) {
+    return SourceResult::Err(std::string(mod.path) +
+                             " was compiled for another version of the VM");
+  }
+
+  auto src = new SrcFile(mod.dir, mod.path, isMain);
+  Bytecode &bc = src->bytecode();
+  for (size_t i = 0; i < mod.count; i++) {
+    const ModuleOp &op = mod.ops[i];
+    if (op.op >= _OpLast || op.type >= _OdtLast) {
+      delete src;
+      return SourceResult::Err("invalid op in " + std::string(mod.path));
+    }
+    switch (op.type) {
+    case OdtSize:
+      bc.addsz(op.idx, op.op, op.sz);
+      break;
+    case OdtBool:
+      bc.addb(op.idx, op.op, op.sz != 0);
+      break;
+    case OdtNil:
+      bc.add(op.idx, op.op);
+      break;
+    default:
+      bc.adds(op.idx, op.op, op.type, op.s);
+    }
+  }
+  for (auto &op : bc.getMut())
+    op.srcId = src->id();
+  bc.assignHandlers(
+      std::vector<Handler>(mod.handlers, mod.handlers + mod.handlerCount));
+  bc.verify();
+  bc.assignCompiled(mod.bodies, mod.bodyCount);
+
+  if (mod.lines) {
+    LineTable lines;
+    if (!LineTable::decode(mod.lines, mod.linesSize, mod.lineCount, lines)) {
+      delete src;
+      return SourceResult::Err("invalid line table in " +
+                               std::string(mod.path));
+    }
+    src->setLines(lines);
+  }
+  if (mod.text)
+    src->addData(std::string(mod.text, mod.textSize));
+  return SourceResult::Ok(src);
+}
+
+bool load(State &vm, const Module &mod, const size_t &srcId,
+          const size_t &idx) {
+  if (vm.allSrcs.find(mod.path) != vm.allSrcs.end())
+    return true;
+
+  auto res = source(mod, false);
+  if (res.isErr()) {
+    vm.fail(srcId, idx, "%s", res.unwrapErr());
+    return false;
+  }
+
+  vm.pushSrc(res.unwrap(), 0);
+  auto execRes = vm::exec(vm);
+  vm.popSrc();
+  if (execRes.isErr()) {
+    vm.fail(srcId, idx, "module '%s' failed to load", mod.path);
+    return false;
+  }
+  return true;
+}
+
+} // namespace aot
+
+} // namespace june
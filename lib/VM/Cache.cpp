@@ -0,0 +1,82 @@
+#include "VM/Cache.hpp"
+#include "Common.hpp"
+#include "JuneConfig.hpp"
+#include "VM/Passes.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace june {
+namespace cache {
+
+static bool Enabled = env::get("JUNE_NO_CACHE").empty();
+
+void setEnabled(const bool &enabled) { Enabled = enabled; }
+bool enabled() { return Enabled; }
+
+std::string dir() {
+  std::string base = env::get("JUNE_CACHE_DIR");
+  if (base.empty()) {
+    std::string xdg = env::get("XDG_CACHE_HOME");
+    if (!xdg.empty()) {
+      base = xdg + "/june";
+    } else {
+      auto home = fs::home();
+      if (home.isErr())
+        return "";
+      base = home.unwrap() + "/.cache/june";
+    }
+  }
+  // entries of other VMs, instruction sets or optimizations are never looked
+  // at, the revision covers compiler changes no version was bumped for
+  std::string rev = JuneGitRev;
+  return base + "/" + JuneVersion + (rev.empty() ? "" : "-" + rev) + "-b" +
+         std::to_string(fs::kBytecodeVersion) + "-o" +
+         std::to_string(_OpLast) + "-p" + std::to_string(passes::kVersion);
+}
+
+std::string entryPath(const SrcFile &src) {
+  if (src.isBytecode() || src.hash() == 0 || src.data().empty())
+    return "";
+  std::string base = dir();
+  if (base.empty())
+    return "";
+  // a strong digest, so a changed source never finds the entry of another
+  char size[32];
+  snprintf(size, sizeof(size), "-%zx.junec", src.data().size());
+  return base + "/" + hash::sha256(src.data()) + size;
+}
+
+bool fetch(SrcFile &src) {
+  if (!Enabled)
+    return false;
+  std::string path = entryPath(src);
+  if (path.empty() || access(path.c_str(), R_OK) != 0)
+    return false;
+  // a damaged entry fails its checksum and is replaced once recompiled,
+  // damaged function bodies only fail once called
+  return src.loadBytecode(path).isOk();
+}
+
+bool store(const SrcFile &src) {
+  if (!Enabled)
+    return false;
+  std::string path = entryPath(src);
+  if (path.empty() || fs::makeDirs(path.substr(0, path.rfind('/'))).isErr())
+    return false;
+
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    return false;
+  auto res = fs::writeBytecode(fd, src.bytecode().get(), src.lines());
+  if (close(fd) != 0 || res.isErr() ||
+      rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace cache
+} // namespace june
@@ -12,11 +12,11 @@ VarBase *get(State &vm, const OpDataType type, const OpData &opData,
   case OdtNil:
     return vm.nil;
   case OdtInt:
-    return make_all<VarInt>(opData.s, srcId, idx);
+    return new VarInt(opData.s, srcId, idx);
   case OdtFloat:
-    return make_all<VarFloat>(opData.s, srcId, idx);
+    return new VarFloat(opData.s, srcId, idx);
   case OdtString:
-    return make_all<VarString>(opData.s, srcId, idx);
+    return new VarString(opData.s, srcId, idx);
   default:
     return nullptr;
   }
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstdarg>
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
@@ -7,457 +8,768 @@
 #include "Common.hpp"
 #include "JuneConfig.hpp"
 #include "VM/Consts.hpp"
+#include "VM/Exec.hpp"
+#include "VM/Feedback.hpp"
 #include "VM/OpCodes.hpp"
 #include "VM/State.hpp"
 #include "VM/Vars.hpp"
 #include "VM/Vars/Base.hpp"
+#include "VM/Verify.hpp"
 #include "c/OpCodes.h"
 
 namespace june {
 
-struct JumpData {
-  const char *name;
-  size_t pos;
-};
-
 using namespace err;
 
 namespace vm {
 
-char *execFailFmt(const char *fmt, ...) {
+std::string execFailFmt(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  char *msg;
-  vasprintf(&msg, fmt, args);
+  char *msg = nullptr;
+  if (vasprintf(&msg, fmt, args) < 0)
+    msg = nullptr;
   va_end(args);
-  return msg;
+  std::string res = msg ? msg : fmt;
+  free(msg);
+  return res;
 }
 
+// jumps to the `or` handler covering the op if there is one, fails the call
+// otherwise. The details were already reported through `vm.fail`, so the
+// message the call fails with is only rendered when running a whole source,
+// the ones of function bodies are discarded by `VarFunc::call`.
 #define execFail(failure, ...)                                                 \
-  do {                                                                         \
-    handleError(vm, jumps, vars, op, i);                                       \
-    if (!customBytecode)                                                       \
-      vars->popFn();                                                           \
-    vm.execStackCount--;                                                       \
-    return Error(ErrExecFail, execFailFmt(failure, ##__VA_ARGS__));            \
-  } while (0)
-
-void handleError(State &vm, std::vector<JumpData> &jumps, Vars *vars,
-                 const Op &op, size_t &i) {
-  if (!jumps.empty() && !vm.exitCalled) {
-    i = jumps.back().pos - 1;
-    if (jumps.back().name) {
-      if (!vm.fails.backEmpty()) {
-        vars->stash(jumps.back().name, vm.fails.pop(false), false);
-      } else {
-        vars->stash(jumps.back().name,
+  {                                                                            \
+    if (handleError(f))                                                        \
+      return StepCaught;                                                       \
+    if (f.begin == 0)                                                          \
+      f.err = execFailFmt(failure, ##__VA_ARGS__);                             \
+    return StepFail;                                                           \
+  }
+
+bool handleError(Frame &f) {
+  State &vm = f.vm;
+  if (vm.exitCalled)
+    return false;
+  const Handler *handler = f.bcode->handlerAt(f.i, f.begin);
+  if (!handler)
+    return false;
+
+  const Op &op = f.bcode->get()[f.i];
+  f.i = handler->target;
+  // verified code resumes with the stack its region began with, dropping
+  // what the failed expression left
+  size_t depth = 0;
+  if (f.verified && f.bcode->handlerDepth(handler->begin, depth))
+    f.vms->trim(f.base + depth);
+  VarBase *failure = vm.fails.take();
+  if (handler->name) {
+    // the name reads as the message, a string like what code catching a
+    // failure expects; failures only dropped are never rendered
+    if (failure && failure->isa<VarFailure>()) {
+      VarBase *msg = new VarString(AsFailure(failure)->msg(), failure->srcId(),
+                                   failure->idx());
+      varDref(failure);
+      failure = msg;
+    }
+    if (failure) {
+      f.vars->stash(handler->name, failure, false);
+    } else {
+      f.vars->stash(handler->name,
                     make_all<VarString>("Unknown failure", op.srcId, op.idx));
-      }
     }
-    jumps.pop_back();
-    vm.fails.blkr();
-    vm.execStackCountExceeded = false;
+  } else if (failure) {
+    varDref(failure);
   }
+  vm.execStackCountExceeded = false;
+  return true;
 }
 
-ExecResult exec(State &vm, const Bytecode *customBytecode, const size_t &begin,
-                const size_t &end) {
-  vm.execStackCount++;
+// a function leaves nothing but its result on the stack, a source nothing at
+// all, whatever its ops left below
+void settleStack(Stack *vms, const size_t &base, const size_t &begin) {
+  if (begin == 0) {
+    vms->trim(base);
+    return;
+  }
+  if (vms->size() <= base + 1)
+    return;
+  bool owned = false;
+  VarBase *res = vms->popRef(owned);
+  vms->trim(base);
+  if (owned)
+    vms->push(res, false);
+  else
+    vms->pushBorrowed(res);
+}
 
-  VarSrc *src = vm.currentSource();
-  Vars *vars = src->vars();
-  SrcFile *srcFile = src->src();
-  size_t srcId = srcFile->id();
-  Stack *vms = vm.stack;
-  const auto &bc =
-      customBytecode ? customBytecode->get() : srcFile->bytecode().get();
-  size_t bytecodeSize = end == 0 ? bc.size() : end;
-
-  std::vector<FnBodySpan> bodies;
-  std::vector<VarBase *> args;
-  std::vector<JumpData> jumps;
+// names taken by OpCreate/OpMakeFunc/OpMemberCall are string constants in
+// verified bytecode, `count` values are checked from `fromTop`
+bool namesOnStack(const Stack *vms, const size_t &fromTop,
+                  const size_t &count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!vms->at(vms->size() - 1 - fromTop - i)->isa<VarString>())
+      return false;
+  }
+  return true;
+}
 
-  if (!customBytecode)
-    vars->pushFn();
-
-  for (size_t i = begin; i < bytecodeSize; i++) {
-    const Op &op = bc[i];
-    if (vm.execStackCount >= vm.execStackMax) {
-      vm.fail(bc[i].srcId, bc[i].idx,
-              "exceeded call stack size, currently: %zu", vm.execStackCount);
-      vm.execStackCountExceeded = true;
-      execFail("exceeded call stack size");
-    }
+// points `cache` at `val`, found in a module at `epoch`; the value it held
+// may still be borrowed further down the stack
+void fillCache(Stack *vms, LookupCache *cache, VarBase *val,
+               const size_t &frame, const size_t &epoch) {
+  if (cache->val != val) {
+    if (cache->val != nullptr && vms->hasBorrowed())
+      vms->own();
+    varIref(val);
+    varDref(cache->val);
+    cache->val = val;
+  }
+  cache->frame = frame;
+  cache->epoch = epoch;
+}
 
-    if (JuneDebug) {
-      printf("%s [%zu] : %*s: ", srcFile->path().c_str(), i, 12,
-             OpCodeStrs[op.op]);
+// gets a module's attribute through the cache of the op looking it up, null
+// if the op has none or the module has no such binding
+VarBase *cachedAttr(Stack *vms, const Bytecode *bcode, const size_t &pos,
+                    VarBase *ctx, const char *name) {
+  if (!ctx->isa<VarSrc>())
+    return nullptr;
+  Vars *mod = AsSrc(ctx)->vars();
+  LookupCache *cache = mod ? bcode->lookupCache(pos) : nullptr;
+  if (!cache)
+    return nullptr;
+  size_t epoch = mod->epoch();
+  if (cache->frame == mod->frame() && cache->epoch == epoch &&
+      cache->name == name)
+    return cache->val;
+  // bindings of the module's functions go with their scopes
+  bool fromFn = false;
+  VarBase *val = mod->get(name, fromFn);
+  if (val != nullptr && !fromFn) {
+    fillCache(vms, cache, val, mod->frame(), epoch);
+    cache->name = name;
+  }
+  return val;
+}
 
-      for (auto &e : vms->get()) {
-        printf("%s ", vm.getTypeName(e).c_str());
-      }
+// records the type of `val` in the feedback slot of the op at `pos`
+inline void observe(const Bytecode *bcode, const size_t &pos,
+                    const VarBase *val) {
+  if (feedback::recording)
+    feedback::observe(bcode->feedbackAt(pos), val->type());
+}
 
-      printf("\n");
-    }
+void releaseArgs(std::vector<VarBase *> &args,
+                 const std::vector<bool> &owned) {
+  for (size_t i = 0; i < args.size(); i++) {
+    if (owned[i])
+      varDref(args[i]);
+  }
+}
 
-    switch (op.op) {
-    case OpLoad: {
-      if (op.type != OdtIdent) {
-        VarBase *res = constants::get(vm, op.type, op.data, op.srcId, op.idx);
-        if (res == nullptr) {
-          vm.fail(op.srcId, op.idx, "invalid data recieved as a constant");
-          execFail("invalid data recieved as a constant");
-        }
-        vms->push(res);
-      } else {
-        VarBase *res = vars->get(op.data.s);
-        if (res == nullptr) {
-          res = vm.globalGet(op.data.s);
-          if (res == nullptr) {
-            vm.fail(op.srcId, op.idx, "variable '%s' does not exist",
-                    op.data.s);
-            execFail("variable '%s' does not exist", op.data.s);
-          }
-        }
-        vms->push(res, true);
-      }
-      break;
+Step guardStack(Frame &f, const size_t &pos) {
+  State &vm = f.vm;
+  if (vm.execStackCount < vm.execStackMax)
+    return StepNext;
+  f.i = pos;
+  const Op &op = f.bcode->get()[pos];
+  vm.fail(op.srcId, op.idx, "exceeded call stack size, currently: %zu",
+          vm.execStackCount);
+  vm.execStackCountExceeded = true;
+  execFail("exceeded call stack size");
+}
+
+// the check verified functions made once for all of their ops
+Step guardDepth(Frame &f, const size_t &pos) {
+  const Op &op = f.bcode->get()[pos];
+  size_t depth = f.vms->size() > f.base ? f.vms->size() - f.base : 0;
+  size_t taken = verify::pops(op);
+  if (depth >= taken)
+    return StepNext;
+  f.i = pos;
+  f.vm.fail(op.srcId, op.idx,
+            "vm stack has %zu elements, expected at least %zu", depth, taken);
+  execFail("vm stack has %zu elements, expected at least %zu", depth, taken);
+}
+
+Step load(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Vars *vars = f.vars;
+  const Op &op = f.bcode->get()[pos];
+  if (op.type != OdtIdent) {
+    VarBase *res = constants::get(vm, op.type, op.data, op.srcId, op.idx);
+    if (res == nullptr) {
+      vm.fail(op.srcId, op.idx, "invalid data recieved as a constant");
+      execFail("invalid data recieved as a constant");
     }
-    case OpUnload: {
-      vms->pop();
-      break;
+    f.vms->push(res, false);
+    return StepNext;
+  }
+  // loads in loops reuse what they found while nothing they could see was
+  // rebound, the function itself never binds the name
+  LookupCache *cache = f.bcode->lookupCache(pos);
+  size_t epoch = vars->epoch();
+  if (cache && cache->frame == vars->frame() && cache->epoch == epoch) {
+    f.vms->pushBorrowed(cache->val);
+    return StepNext;
+  }
+  bool fromFn = false;
+  VarBase *res = vars->get(op.data.s, fromFn);
+  if (res == nullptr) {
+    res = vm.globalGet(op.data.s);
+    if (res == nullptr) {
+      vm.fail(op.srcId, op.idx, "variable '%s' does not exist", op.data.s);
+      execFail("variable '%s' does not exist", op.data.s);
     }
-    case OpCreate: {
-      const std::string name = vms->back()->as<VarString>()->get();
-      vms->pop();
-      VarBase *ctx = nullptr;
-      if (op.data.b) {
-        ctx = vms->pop(false);
-      }
-      VarBase *val = vms->pop(false);
-      if (!ctx) {
-        if (val->isLoadAsRef() || val->refCount() == 1) {
-          vars->add(name, val, true);
-          val->unsetLoadAsRef();
-        } else {
-          vars->add(name, val->copy(op.srcId, op.idx), false);
-        }
+  }
+  // but a function's arguments may be bound in a scope of the loop
+  if (cache && !fromFn)
+    fillCache(f.vms, cache, res, vars->frame(), epoch);
+  f.vms->pushBorrowed(res);
+  return StepNext;
+}
+
+void unload(Frame &f) { f.vms->pop(); }
+
+template <bool Verified> Step create(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  Vars *vars = f.vars;
+  const Op &op = f.bcode->get()[pos];
+  if (!Verified && !namesOnStack(vms, 0, 1)) {
+    vm.fail(op.srcId, op.idx, "expected a variable name, found %s",
+            failType(vms->back()));
+    execFail("expected a variable name, found %s",
+             vm.getTypeName(vms->back()).c_str());
+  }
+  const std::string name = vms->back()->as<VarString>()->view();
+  vms->pop();
+  VarBase *ctx = nullptr;
+  if (op.data.b) {
+    ctx = vms->pop(false);
+  }
+  bool owned = false;
+  VarBase *val = vms->popRef(owned);
+  if (!ctx) {
+    // replacing a binding releases its value, which may still be borrowed
+    // further down the stack
+    if (vms->hasBorrowed() && vars->exists(name))
+      vms->own();
+    // a value only the stack holds is a temporary and is bound as is,
+    // borrowed values belong to another variable and are copied
+    if (!val->isImmortal() &&
+        (val->isLoadAsRef() || (owned && val->refCount() == 1))) {
+      if (!owned)
+        varIref(val);
+      vars->add(name, val, false);
+      val->unsetLoadAsRef();
+    } else {
+      vars->add(name, varCopy(val, op.srcId, op.idx), false);
+      if (owned)
         varDref(val);
-        break;
-      }
+    }
+    return StepNext;
+  }
 
-      if (ctx->isAttrBased()) {
-        if (val->isLoadAsRef() || val->refCount() == 1) {
-          ctx->attrSet(name, val, true);
-          val->unsetLoadAsRef();
-        } else {
-          ctx->attrSet(name, val->copy(op.srcId, op.idx), false);
-        }
-      }
+  if (ctx->isAttrBased()) {
+    if (!val->isImmortal() &&
+        (val->isLoadAsRef() || (owned && val->refCount() == 1))) {
+      ctx->attrSet(name, val, true);
+      val->unsetLoadAsRef();
+    } else {
+      ctx->attrSet(name, varCopy(val, op.srcId, op.idx), false);
+    }
+  }
 
-      if (!val->isCallable()) {
-        varDref(ctx);
-        varDref(val);
-        vm.fail(
-            op.srcId, op.idx,
-            "only callable values can be added to non-attribute based types");
-        execFail(
+  if (!val->isCallable()) {
+    varDref(ctx);
+    if (owned)
+      varDref(val);
+    vm.fail(op.srcId, op.idx,
             "only callable values can be added to non-attribute based types");
-      }
+    execFail("only callable values can be added to non-attribute based types");
+  }
 
-      vm.addTypeFn(ctx->isa<VarTypeId>() ? ctx->as<VarTypeId>()->get()
-                                         : ctx->typeFnId(),
-                   name, val, true);
-      varDref(ctx);
+  vm.addTypeFn(ctx->isa<VarTypeId>() ? ctx->as<VarTypeId>()->get()
+                                     : ctx->typeFnId(),
+               name, val, true);
+  varDref(ctx);
+  if (owned)
+    varDref(val);
+  return StepNext;
+}
+
+Step store(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  const Op &op = f.bcode->get()[pos];
+  bool varOwned = false, valOwned = false;
+  VarBase *var = vms->popRef(varOwned);
+  VarBase *val = vms->popRef(valOwned);
+  observe(f.bcode, pos, val);
+  if (var->isImmortal()) {
+    if (valOwned)
       varDref(val);
-      break;
-    }
-    case OpStore: {
-      if (vms->size() < 2) {
-        vm.fail(op.srcId, op.idx,
-                "vm stack has %zu elements, expected at least "
-                "2",
-                vms->size());
-        execFail("vm stack has %zu elements, expected at least 2", vms->size());
-      }
+    vm.fail(op.srcId, op.idx, "cannot assign to a constant value of type %s",
+            failType(var));
+    execFail("cannot assign to a constant value of type %s",
+             vm.getTypeName(var).c_str());
+  }
+  if (var->type() != val->type()) {
+    if (valOwned)
+      varDref(val);
+    if (varOwned)
+      varDref(var);
+    vm.fail(op.srcId, op.idx,
+            "type mismatch: %s cannot be assigned to variable "
+            "of type %s",
+            failType(var), failType(val));
+    execFail("type mismatch: %s cannot be assigned to variable of type %s",
+             vm.getTypeName(var).c_str(), vm.getTypeName(val).c_str());
+  }
 
-      VarBase *var = vms->pop(false);
-      VarBase *val = vms->pop(false);
-      if (var->type() != val->type()) {
-        varDref(val);
-        varDref(var);
-        vm.fail(op.srcId, op.idx,
-                "type mismatch: %s cannot be assigned to variable "
-                "of type %s",
-                vm.getTypeName(var).c_str(), vm.getTypeName(val).c_str());
-        execFail("type mismatch: %s cannot be assigned to variable of type %s",
-                 vm.getTypeName(var).c_str(), vm.getTypeName(val).c_str());
-      }
+  varSet(var, val);
+  if (varOwned)
+    vms->push(var, false);
+  else
+    vms->pushBorrowed(var);
+  if (valOwned)
+    varDref(val);
+  return StepNext;
+}
 
-      var->set(val);
-      vms->push(var, false);
-      varDref(val);
-      break;
-    }
-    case OpBlkA: {
-      vars->blkAdd(op.data.sz);
-      break;
-    }
-    case OpBlkR: {
-      vars->blkRem(op.data.sz);
-      break;
-    }
-    case OpJump: {
-      i = op.data.sz - 1;
-      break;
-    }
-    case OpJumpTrue:
-    case OpJumpTruePop: {
-      assert(!vms->empty());
-      VarBase *var = vms->back();
-      bool res = false;
-      if (!var->toBool(vm, res, op.srcId, op.idx)) {
-        vm.fail(op.srcId, op.idx, "cannot convert %s to bool",
-                vm.getTypeName(var).c_str());
-        vms->pop();
-        execFail("cannot convert %s to bool", vm.getTypeName(var).c_str());
-      }
-      if (res)
-        i = op.data.sz - 1;
-      if (!res || op.op == OpJumpTruePop)
-        vms->pop();
-      break;
-    }
-    case OpJumpFalse:
-    case OpJumpFalsePop: {
-      assert(!vms->empty());
-      VarBase *var = vms->back();
-      bool res = false;
-      if (!var->toBool(vm, res, op.srcId, op.idx)) {
-        vm.fail(op.srcId, op.idx, "cannot convert %s to bool",
-                vm.getTypeName(var).c_str());
-        vms->pop();
-        execFail("cannot convert %s to bool", vm.getTypeName(var).c_str());
-      }
-      if (!res)
-        i = op.data.sz - 1;
-      if (!res || op.op == OpJumpFalsePop)
-        vms->pop();
-      break;
-    }
-    case OpJumpNil: {
-      if (vms->back()->isa<VarNil>()) {
-        vms->pop();
-        i = op.data.sz - 1;
-      }
-      break;
+void blockAdd(Frame &f, const size_t &count) { f.vars->blkAdd(count); }
+
+void blockRem(Frame &f, const size_t &count) {
+  f.vms->own();
+  f.vars->blkRem(count);
+  if (gc::pending())
+    f.vm.collectCycles();
+  if (gc::deferred())
+    gc::reclaim(gc::kReclaimBudget);
+}
+
+Step branch(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  const Op &op = f.bcode->get()[pos];
+  VarBase *var = vms->back();
+  observe(f.bcode, pos, var);
+  if (op.op == OpJumpNil) {
+    if (!var->isa<VarNil>())
+      return StepNext;
+    vms->pop();
+    return StepJump;
+  }
+  bool res = false;
+  if (!var->toBool(vm, res, op.srcId, op.idx)) {
+    vm.fail(op.srcId, op.idx, "cannot convert %s to bool", failType(var));
+    vms->pop();
+    execFail("cannot convert %s to bool", vm.getTypeName(var).c_str());
+  }
+  bool taken = res == (op.op == OpJumpTrue || op.op == OpJumpTruePop);
+  if (!verify::keeps(op.op, taken))
+    vms->pop();
+  return taken ? StepJump : StepNext;
+}
+
+void bodyMarker(Frame &f, const size_t &pos) {
+  f.bodies.push_back({pos + 1, f.bcode->get()[pos].data.sz});
+}
+
+template <bool Verified> Step makeFunc(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  const Op &op = f.bcode->get()[pos];
+  if (!Verified && !namesOnStack(vms, 0, verify::pops(op))) {
+    vm.fail(op.srcId, op.idx, "expected parameter names");
+    execFail("expected parameter names");
+  }
+  if (!Verified && f.bodies.empty()) {
+    vm.fail(op.srcId, op.idx, "no function body was marked");
+    execFail("no function body was marked");
+  }
+  std::string varArg;
+  std::vector<std::string> args;
+  if (op.data.s[0] == '1') {
+    varArg = vms->back()->as<VarString>()->view();
+    vms->pop();
+  }
+
+  size_t argSz = strlen(op.data.s);
+  for (size_t i = 1; i < argSz; i++) {
+    std::string name = vms->back()->as<VarString>()->view();
+    vms->pop();
+    args.push_back(name);
+  }
+
+  FnBodySpan body = f.bodies.back();
+  f.bodies.pop_back();
+
+  // the prototype is shared by every copy of the function, and already knows
+  // which source it runs in
+  FnProto *proto = new FnProto(f.src->src()->path(), varArg, args,
+                               FnBody{.june = body}, false, f.src);
+  vms->push(new VarFunc(proto, op.srcId, op.idx));
+  return StepNext;
+}
+
+template <bool Verified> Step call(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  const Op &op = f.bcode->get()[pos];
+  std::vector<VarBase *> &args = f.args;
+  std::vector<bool> &argsOwned = f.argsOwned;
+  // arguments are passed on borrowed, only the references the stack owned
+  // are released once the call is done
+  args.clear();
+  argsOwned.clear();
+  size_t len = strlen(op.data.s);
+  bool memCall = op.op == OpMemberCall;
+  bool vaUnpack = op.data.s[0] == '1';
+  if (!Verified && memCall && !namesOnStack(vms, len - 1, 1)) {
+    vm.fail(op.srcId, op.idx, "expected a member name");
+    execFail("expected a member name");
+  }
+  for (size_t i = 1; i < len; i++) {
+    bool owned = false;
+    args.push_back(vms->popRef(owned));
+    argsOwned.push_back(owned);
+  }
+
+  VarBase *ctxBase = nullptr;
+  VarBase *fnBase = nullptr;
+  VarBase *res = nullptr;
+  bool ctxOwned = false;
+  bool fnOwned = false;
+  std::string fnName;
+  if (vaUnpack) {
+    if (!args.back()->isa<VarVec>()) {
+      vm.fail(args.back()->srcId(), args.back()->idx(),
+              "cannot unpack non-vector value");
+      releaseArgs(args, argsOwned);
+      execFail("cannot unpack non-vector value");
     }
-    case OpBodyMarker: {
-      bodies.push_back({i + 1, op.data.sz});
-      i = op.data.sz - 1;
-      break;
+    VarBase *vec = args.back();
+    bool vecOwned = argsOwned.back();
+    args.pop_back();
+    argsOwned.pop_back();
+    for (auto &e : AsVec(vec)->view()) {
+      varIref(e);
+      args.push_back(e);
+      argsOwned.push_back(true);
     }
-    case OpMakeFunc: {
-      std::string varArg;
-      std::vector<std::string> args;
-      if (op.data.s[0] == '1') {
-        varArg = vms->back()->as<VarString>()->get();
-        vms->pop();
-      }
+    if (vecOwned)
+      varDref(vec);
+  }
 
-      size_t argSz = strlen(op.data.s);
-      for (size_t i = 1; i < argSz; i++) {
-        std::string name = vms->back()->as<VarString>()->get();
-        vms->pop();
-        args.push_back(name);
-      }
+  if (memCall) {
+    fnName = vms->back()->as<VarString>()->view();
+    vms->pop();
+    ctxBase = vms->popRef(ctxOwned);
+    observe(f.bcode, pos, ctxBase);
+    if (ctxBase->isAttrBased())
+      fnBase = cachedAttr(vms, f.bcode, pos, ctxBase, fnName.c_str());
+    if (fnBase == nullptr && ctxBase->isAttrBased())
+      fnBase = ctxBase->attrGet(fnName);
+    if (fnBase == nullptr)
+      fnBase = vm.getTypeFn(ctxBase, fnName);
+  } else {
+    fnBase = vms->popRef(fnOwned);
+    observe(f.bcode, pos, fnBase);
+  }
 
-      FnBodySpan body = bodies.back();
-      bodies.pop_back();
+  if (!fnBase) {
+    if (memCall)
+      vm.fail(ctxBase->srcId(), ctxBase->idx(),
+              "cannot find member '%s' on '%s'", fnName.c_str(),
+              failType(ctxBase));
+    else
+      vm.fail(fnBase->srcId(), fnBase->idx(), "cannot find function '%s'",
+              fnBase->as<VarString>()->view().c_str());
+    if (ctxOwned)
+      varDref(ctxBase);
+    releaseArgs(args, argsOwned);
+    execFail("cannot find function '%s'", fnName.c_str());
+  }
 
-      vms->push(new VarFunc(srcFile->path(), varArg, args, FnBody{.june = body},
-                          false, op.srcId, op.idx));
-      break;
+  if (!fnBase->isCallable()) {
+    vm.fail(op.srcId, op.idx, "'%s' is not a function or struct definition",
+            failType(fnBase));
+    // the name is needed after the value is released
+    std::string fnType = vm.getTypeName(fnBase);
+    if (ctxOwned)
+      varDref(ctxBase);
+    releaseArgs(args, argsOwned);
+    if (fnOwned)
+      varDref(fnBase);
+    execFail("'%s' is not a function or struct definition", fnType.c_str());
+  }
+
+  args.insert(args.begin(), ctxBase);
+  argsOwned.insert(argsOwned.begin(), ctxOwned);
+  res = fnBase->call(vm, args, op.srcId, op.idx);
+
+  if (!res) {
+    // prevent showing the failure if the exec stack is too full or we'll get
+    // an enourmous stack trace
+    if (!vm.execStackCountExceeded) {
+      vm.fail(op.srcId, op.idx, "'%s' call failed, see above",
+              failType(fnBase));
     }
-    case OpMemberCall:
-    case OpCall: {
-      args.clear();
-      size_t len = strlen(op.data.s);
-      bool memCall = op.op == OpMemberCall;
-      bool vaUnpack = op.data.s[0] == '1';
-      for (size_t i = 1; i < len; i++) {
-        args.push_back(vms->pop(false));
-      }
+    releaseArgs(args, argsOwned);
+    if (fnOwned)
+      varDref(fnBase);
+    execFail("'%s' call failed, see above", vm.getTypeName(fnBase).c_str());
+  }
 
-      VarBase *ctxBase = nullptr;
-      VarBase *fnBase = nullptr;
-      VarBase *res = nullptr;
-      std::string fnName;
-      if (vaUnpack) {
-        if (!args.back()->isa<VarVec>()) {
-          vm.fail(args.back()->srcId(), args.back()->idx(),
-                  "cannot unpack non-vector value");
-          for (auto &arg : args)
-            varDref(arg);
-          if (!memCall)
-            varDref(fnBase);
-          execFail("cannot unpack non-vector value");
-        }
-        VarVec *vec = args.back()->as<VarVec>();
-        args.pop_back();
-        for (auto &e : vec->get()) {
-          varIref(e);
-          args.push_back(e);
-        }
-        varDref(vec);
-      }
+  if (!res->isa<VarNil>()) {
+    vms->push(res, false);
+  }
+  releaseArgs(args, argsOwned);
+  if (fnOwned)
+    varDref(fnBase);
+  if (gc::pending())
+    vm.collectCycles();
+  if (gc::deferred())
+    gc::reclaim(gc::kReclaimBudget);
+  return vm.exitCalled ? StepReturn : StepNext;
+}
 
-      if (memCall) {
-        fnName = vms->back()->as<VarString>()->get();
-        vms->pop();
-        ctxBase = vms->pop(false);
-        if (ctxBase->isAttrBased())
-          fnBase = ctxBase->attrGet(fnName);
-        if (fnBase == nullptr)
-          fnBase = vm.getTypeFn(ctxBase, fnName);
-      } else {
-        fnBase = vms->pop(false);
-      }
+Step attr(Frame &f, const size_t &pos) {
+  f.i = pos;
+  State &vm = f.vm;
+  Stack *vms = f.vms;
+  const Op &op = f.bcode->get()[pos];
+  bool ctxOwned = false;
+  VarBase *ctxBase = vms->popRef(ctxOwned);
+  observe(f.bcode, pos, ctxBase);
+  VarBase *val = nullptr;
+  if (ctxBase->isAttrBased())
+    val = cachedAttr(vms, f.bcode, pos, ctxBase, op.data.s);
+  if (val != nullptr) {
+    vms->push(val);
+    if (ctxOwned)
+      varDref(ctxBase);
+    return StepNext;
+  }
+  const std::string attr = op.data.s;
+  if (ctxBase->isAttrBased())
+    val = ctxBase->attrGet(attr);
+  if (val == nullptr)
+    val = vm.getTypeFn(ctxBase, attr);
+  if (val == nullptr) {
+    vm.fail(op.srcId, op.idx, "type '%s' does not have attribute '%s'",
+            failType(ctxBase), attr.c_str());
+    if (ctxOwned)
+      varDref(ctxBase);
+    execFail("type '%s' does not have attribute '%s'",
+             vm.getTypeName(ctxBase).c_str(), attr.c_str());
+  }
+  vms->push(val);
+  if (ctxOwned)
+    varDref(ctxBase);
+  return StepNext;
+}
 
-      if (!fnBase) {
-        if (memCall)
-          vm.fail(ctxBase->srcId(), ctxBase->idx(),
-                  "cannot find member '%s' on '%s'", fnName.c_str(),
-                  vm.getTypeName(ctxBase).c_str());
-        else
-          vm.fail(fnBase->srcId(), fnBase->idx(), "cannot find function '%s'",
-                  fnBase->as<VarString>()->get().c_str());
-        varDref(ctxBase);
-        for (auto &arg : args)
-          varDref(arg);
-        if (!memCall)
-          varDref(fnBase);
-        execFail("cannot find function '%s'",
-                 fnBase->as<VarString>()->get().c_str());
-      }
+Step ret(Frame &f, const size_t &pos) {
+  if (!f.bcode->get()[pos].data.b)
+    f.vms->push(f.vm.nil);
+  settleStack(f.vms, f.base, f.begin);
+  return StepReturn;
+}
 
-      if (!fnBase->isCallable()) {
-        vm.fail(op.srcId, op.idx, "'%s' is not a function or struct definition",
-                vm.getTypeName(fnBase).c_str());
-        varDref(ctxBase);
-        for (auto &arg : args)
-          varDref(arg);
-        if (!memCall)
-          varDref(fnBase);
-        execFail("'%s' is not a function or struct definition",
-                 vm.getTypeName(fnBase).c_str());
-      }
+Step finish(Frame &f) {
+  // falling off the end of a function returns nil
+  if (f.begin != 0)
+    f.vms->push(f.vm.nil);
+  settleStack(f.vms, f.base, f.begin);
+  return StepReturn;
+}
 
-      args.insert(args.begin(), ctxBase);
-      res = fnBase->call(vm, args, op.srcId, op.idx);
-
-      if (!res) {
-        // prevent showing the failure if the exec stack is too full
-        // or we'll get an enourmous stack trace
-        if (!vm.execStackCountExceeded) {
-          vm.fail(op.srcId, op.idx, "'%s' call failed, see above",
-                  vm.getTypeName(fnBase).c_str());
-        }
-        varDref(ctxBase);
-        for (auto &arg : args)
-          varDref(arg);
-        if (!memCall)
-          varDref(fnBase);
-        execFail("'%s' call failed, see above", vm.getTypeName(fnBase).c_str());
-      }
+void pushLoop(Frame &f) { f.vars->pushLoop(); }
 
-      if (!res->isa<VarNil>()) {
-        vms->push(res, false);
-      }
-      for (auto &arg : args)
-        varDref(arg);
-      if (!memCall)
-        varDref(fnBase);
-      if (vm.exitCalled) {
-        assert(jumps.size() == 0);
-        if (!customBytecode)
-          vars->popFn();
-        vm.execStackCount--;
-        return vm.exitCode;
-      }
-      break;
-    }
-    case OpAttr: {
-      const std::string attr = op.data.s;
-      VarBase *ctxBase = vms->pop(false);
-      VarBase *val = nullptr;
-      if (ctxBase->isAttrBased())
-        val = ctxBase->attrGet(attr);
-      if (val == nullptr)
-        val = vm.getTypeFn(ctxBase, attr);
-      if (val == nullptr) {
-        vm.fail(op.srcId, op.idx, "type '%s' does not have attribute '%s'",
-                vm.getTypeName(ctxBase).c_str(), attr.c_str());
-        varDref(ctxBase);
-        execFail("type '%s' does not have attribute '%s'",
-                 vm.getTypeName(ctxBase).c_str(), attr.c_str());
+void popLoop(Frame &f) {
+  f.vms->own();
+  f.vars->popLoop();
+}
+
+void loopContinue(Frame &f) {
+  f.vms->own();
+  f.vars->loopContinue();
+}
+
+void guardFn(Frame &f, const size_t &pos) {
+  // an inlined copy of a body stands in for calls of the function it was
+  // copied from only
+  VarBase *fn = f.vms->back();
+  bool same = false;
+  if (fn->isa<VarFunc>()) {
+    FnProto *proto = AsFunc(fn)->proto();
+    same = !proto->isNative && proto->src == f.src &&
+           proto->body.june.begin == f.bcode->get()[pos].data.sz;
+  }
+  f.vms->push(same ? f.vm.tru : f.vm.fals, false);
+}
+
+template Step create<true>(Frame &f, const size_t &pos);
+template Step create<false>(Frame &f, const size_t &pos);
+template Step makeFunc<true>(Frame &f, const size_t &pos);
+template Step makeFunc<false>(Frame &f, const size_t &pos);
+template Step call<true>(Frame &f, const size_t &pos);
+template Step call<false>(Frame &f, const size_t &pos);
+
+// `Verified` bytecode passed `verify::function`, the checks it makes once
+// are compiled out
+template <bool Verified> Step interpret(Frame &f) {
+  const auto &bc = f.bcode->get();
+  size_t size = f.end == 0 ? bc.size() : f.end;
+
+  while (f.i < size) {
+    const Op &op = bc[f.i];
+    Step step = guardStack(f, f.i);
+    if (!Verified && step == StepNext)
+      step = guardDepth(f, f.i);
+
+    if (JuneDebug && step == StepNext) {
+      printf("%s [%zu] : %*s: ", f.src->src()->path().c_str(), f.i, 12,
+             OpCodeStrs[op.op]);
+
+      for (size_t s = 0; s < f.vms->size(); s++) {
+        printf("%s ", f.vm.getTypeName(f.vms->at(s)).c_str());
       }
-      varDref(ctxBase);
-      vms->push(val);
-      break;
+
+      printf("\n");
     }
-    case OpReturn: {
-      if (!op.data.b) {
-        vms->push(vm.nil);
+
+    if (step == StepNext) {
+      switch (op.op) {
+      case OpLoad:
+        step = load(f, f.i);
+        break;
+      case OpUnload:
+        unload(f);
+        break;
+      case OpCreate:
+        step = create<Verified>(f, f.i);
+        break;
+      case OpStore:
+        step = store(f, f.i);
+        break;
+      case OpBlkA:
+        blockAdd(f, op.data.sz);
+        break;
+      case OpBlkR:
+        blockRem(f, op.data.sz);
+        break;
+      case OpJump:
+      case OpBreak:
+        step = StepJump;
+        break;
+      case OpJumpTrue:
+      case OpJumpTruePop:
+      case OpJumpFalse:
+      case OpJumpFalsePop:
+      case OpJumpNil:
+        step = branch(f, f.i);
+        break;
+      case OpBodyMarker:
+        bodyMarker(f, f.i);
+        step = StepJump;
+        break;
+      case OpMakeFunc:
+        step = makeFunc<Verified>(f, f.i);
+        break;
+      case OpMemberCall:
+      case OpCall:
+        step = call<Verified>(f, f.i);
+        break;
+      case OpAttr:
+        step = attr(f, f.i);
+        break;
+      case OpReturn:
+        step = ret(f, f.i);
+        break;
+      case OpPushLoop:
+        pushLoop(f);
+        break;
+      case OpPopLoop:
+        popLoop(f);
+        break;
+      case OpContinue:
+        loopContinue(f);
+        step = StepJump;
+        break;
+      case OpGuardFn:
+        guardFn(f, f.i);
+        break;
+      case OpPushJump:
+      case OpPushJumpNamed:
+      case OpPopJump:
+        // stripped once the handler table is built, see handleError
+        break;
+      case _OpLast:
+        assert(false);
+        break;
       }
-      assert(jumps.size() == 0);
-      if (!customBytecode)
-        vars->popFn();
-      vm.execStackCount--;
-      return vm.exitCode;
-    }
-    case OpPushLoop: {
-      vars->pushLoop();
-      break;
-    }
-    case OpPopLoop: {
-      vars->popLoop();
-      break;
-    }
-    case OpContinue: {
-      vars->loopContinue();
-      i = op.data.sz - 1;
-      break;
-    }
-    case OpBreak: {
-      i = op.data.sz - 1;
-      break;
-    }
-    case OpPushJump: {
-      jumps.push_back({nullptr, op.data.sz});
-      vm.fails.blka();
-      break;
     }
-    case OpPushJumpNamed: {
-      jumps.back().name = op.data.s;
+
+    switch (step) {
+    case StepNext:
+      f.i++;
       break;
-    }
-    case OpPopJump: {
-      jumps.pop_back();
-      vm.fails.blkr();
+    case StepJump:
+      f.i = op.data.sz;
       break;
-    }
-    case _OpLast: {
-      assert(false);
+    case StepCaught:
       break;
-    }
+    default:
+      return step;
     }
   }
+  return finish(f);
+}
 
-  assert(jumps.size() == 0);
+ExecResult exec(State &vm, const Bytecode *customBytecode, const size_t &begin,
+                const size_t &end) {
+  VarSrc *src = vm.currentSource();
+  const Bytecode *bcode =
+      customBytecode ? customBytecode : &src->src()->bytecode();
+  size_t depth = 0;
+  bool verified = bcode->verifiedDepth(begin, depth);
+  if (verified)
+    vm.stack->reserve(vm.stack->size() + depth);
+  vm.execStackCount++;
+
+  Frame f{vm, customBytecode, bcode, src, src->vars(), vm.stack, begin, end,
+          vm.stack->size(), begin, verified, {}, {}, {}, {}};
   if (!customBytecode)
-    vars->popFn();
+    f.vars->pushFn();
+  vm.fails.enter(bcode, begin, &f.i);
+
+  // compiled code relies on the checks of the verifier as much as the
+  // verified interpreter does
+  const CompiledBody *compiled = verified ? bcode->compiledAt(begin) : nullptr;
+  Step step = compiled   ? compiled->run(f)
+              : verified ? interpret<true>(f)
+                         : interpret<false>(f);
+
+  vm.fails.leave();
+  if (!customBytecode) {
+    f.vms->own();
+    f.vars->popFn();
+  }
   vm.execStackCount--;
+  if (step == StepFail)
+    return Error(ErrExecFail, f.err);
   return vm.exitCode;
 }
 
@@ -4,22 +4,39 @@ namespace june {
 
 FailStack::FailStack() {}
 
-FailStack::~FailStack() { assert(_stack.size() == 0); }
+FailStack::~FailStack() {
+  assert(_frames.size() == 0);
+  clear();
+}
+
+bool FailStack::caught() const {
+  for (auto it = _frames.rbegin(); it != _frames.rend(); ++it) {
+    if (it->bc->handlerAt(*it->pos, it->begin))
+      return true;
+  }
+  return false;
+}
 
 void FailStack::push(VarBase *val, const bool iref) {
   if (iref)
     varIref(val);
-  _stack.back().push_back(val);
+  _pending.push_back(val);
 }
 
-VarBase *FailStack::pop(const bool dref) {
-  if (_stack.size() == 0 || _stack.back().size() == 0)
+VarBase *FailStack::take() {
+  if (_pending.empty())
     return nullptr;
-  VarBase *front = _stack.back().front();
-  _stack.back().pop_front();
-  if (dref)
-    varDref(front);
+  VarBase *front = _pending.front();
+  for (size_t i = 1; i < _pending.size(); i++)
+    varDref(_pending[i]);
+  _pending.clear();
   return front;
 }
 
+void FailStack::clear() {
+  for (auto &val : _pending)
+    varDref(val);
+  _pending.clear();
+}
+
 } // namespace june
@@ -0,0 +1,173 @@
+#include "VM/Feedback.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "Common.hpp"
+#include "VM/State.hpp"
+
+namespace june {
+
+namespace feedback {
+
+const char *KindStrs[_KindLast] = {
+    "unseen",
+    "monomorphic",
+    "polymorphic",
+    "megamorphic",
+};
+
+bool recording = false;
+
+void setRecording(const bool &enabled) { recording = enabled; }
+
+bool records(const OpCodes op) {
+  switch (op) {
+  case OpCall:
+  case OpMemberCall:
+  case OpAttr:
+  case OpStore:
+  case OpJumpTrue:
+  case OpJumpFalse:
+  case OpJumpTruePop:
+  case OpJumpFalsePop:
+  case OpJumpNil:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void observe(TypeFeedback &slot, const std::uintptr_t &type) {
+  if (slot.megamorphic)
+    return;
+  for (size_t i = 0; i < slot.count; i++) {
+    if (slot.types[i] == type)
+      return;
+  }
+  if (slot.count == TypeFeedback::kMaxTypes) {
+    slot.megamorphic = true;
+    return;
+  }
+  slot.types[slot.count++] = type;
+}
+
+Kind kind(const TypeFeedback &slot) {
+  if (slot.megamorphic)
+    return KindMegamorphic;
+  if (slot.count == 0)
+    return KindUnseen;
+  return slot.count == 1 ? KindMonomorphic : KindPolymorphic;
+}
+
+static bool before(const Site &site, const size_t &idx, const OpCodes op) {
+  return site.idx < idx || (site.idx == idx && site.op < op);
+}
+
+const Site *find(const Sites &sites, const size_t &idx, const OpCodes op) {
+  auto it = std::lower_bound(
+      sites.begin(), sites.end(), idx,
+      [&](const Site &site, const size_t &at) { return before(site, at, op); });
+  if (it == sites.end() || it->idx != idx || it->op != op)
+    return nullptr;
+  return &*it;
+}
+
+DumpResult dump(State &vm, const std::string &path) {
+  std::ofstream out(path);
+  if (!out)
+    return DumpResult::Err("cannot open " + path + " for writing");
+
+  size_t count = 0;
+  for (auto &entry : vm.allSrcs) {
+    const Bytecode &bc = entry.second->src()->bytecode();
+    const auto &slots = bc.feedbackSlots();
+    if (slots.size() != bc.size())
+      continue;
+    // copies of an op (inlined bodies) share its position
+    std::map<std::pair<size_t, OpCodes>, TypeFeedback> merged;
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (slots[i].count == 0)
+        continue;
+      const Op &op = bc.get()[i];
+      TypeFeedback &site = merged[{op.idx, op.op}];
+      for (size_t t = 0; t < slots[i].count; t++)
+        observe(site, slots[i].types[t]);
+      site.megamorphic |= slots[i].megamorphic;
+    }
+    for (auto &site : merged) {
+      out << entry.first << "\t" << site.first.first << "\t"
+          << OpCodeStrs[site.first.second] << "\t"
+          << KindStrs[kind(site.second)] << "\t";
+      for (size_t t = 0; t < site.second.count; t++)
+        out << (t > 0 ? "," : "") << vm.getTypeName(site.second.types[t]);
+      out << "\n";
+      count++;
+    }
+  }
+  out.flush();
+  if (!out)
+    return DumpResult::Err("failed writing " + path);
+  return DumpResult::Ok(count);
+}
+
+ReadResult read(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    return ReadResult::Err("cannot open " + path);
+
+  Profile profile;
+  std::string line;
+  for (size_t num = 1; std::getline(in, line); num++) {
+    if (line.empty())
+      continue;
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    for (std::string field; std::getline(ss, field, '\t');)
+      fields.push_back(field);
+    if (fields.size() == 4)
+      fields.push_back("");
+    auto fail = [&](const std::string &msg) {
+      return ReadResult::Err(path + ":" + std::to_string(num) + ": " + msg);
+    };
+    if (fields.size() != 5)
+      return fail("expected 5 fields, found " + std::to_string(fields.size()));
+
+    Site site{0, _OpLast, _KindLast, {}};
+    char *end = nullptr;
+    site.idx = strtoull(fields[1].c_str(), &end, 10);
+    if (fields[1].empty() || *end != '\0')
+      return fail("invalid position '" + fields[1] + "'");
+    for (size_t op = 0; op < _OpLast; op++) {
+      if (fields[2] == OpCodeStrs[op])
+        site.op = (OpCodes)op;
+    }
+    if (site.op == _OpLast || !records(site.op))
+      return fail("unknown op '" + fields[2] + "'");
+    for (size_t k = 0; k < _KindLast; k++) {
+      if (fields[3] == KindStrs[k])
+        site.kind = (Kind)k;
+    }
+    if (site.kind == _KindLast)
+      return fail("unknown kind '" + fields[3] + "'");
+    std::stringstream types(fields[4]);
+    for (std::string type; std::getline(types, type, ',');)
+      site.types.push_back(type);
+    profile[fields[0]].push_back(std::move(site));
+  }
+
+  for (auto &src : profile) {
+    std::sort(src.second.begin(), src.second.end(),
+              [](const Site &a, const Site &b) {
+                return before(a, b.idx, b.op);
+              });
+  }
+  return ReadResult::Ok(std::move(profile));
+}
+
+} // namespace feedback
+
+} // namespace june
@@ -0,0 +1,191 @@
+#include "VM/Gc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace june {
+namespace gc {
+
+static std::mutex GcLock;
+static std::unordered_set<VarBase *> Tracked;
+static std::atomic<size_t> Allocated(0);
+static std::atomic<size_t> Threshold(kThresholdDefault);
+
+static std::mutex DeferLock;
+static std::vector<VarBase *> Deferred;
+static std::atomic<size_t> DeferredCount(0);
+static thread_local size_t FreeDepth = 0;
+// values released inline since the outermost `release` of the chain began
+static thread_local size_t FreeSpent = 0;
+
+void track(VarBase *var) {
+  std::lock_guard<std::mutex> lock(GcLock);
+  Tracked.insert(var);
+  Allocated.fetch_add(1, std::memory_order_relaxed);
+}
+
+void untrack(VarBase *var) {
+  std::lock_guard<std::mutex> lock(GcLock);
+  Tracked.erase(var);
+}
+
+void setThreshold(const size_t &threshold) { Threshold = threshold; }
+
+bool pending() {
+  size_t threshold = Threshold.load(std::memory_order_relaxed);
+  return threshold != 0 &&
+         Allocated.load(std::memory_order_relaxed) >= threshold;
+}
+
+// subtracts the references held by tracked containers from each other
+class DecrementVisitor : public GcVisitor {
+  std::unordered_map<VarBase *, size_t> &_refs;
+  std::unordered_set<const void *> _seen;
+
+public:
+  DecrementVisitor(std::unordered_map<VarBase *, size_t> &refs)
+      : _refs(refs) {}
+
+  bool enter(const void *storage) { return _seen.insert(storage).second; }
+  void visit(VarBase *child) {
+    auto it = _refs.find(child);
+    if (it != _refs.end() && it->second > 0)
+      it->second--;
+  }
+};
+
+// marks everything reachable from externally referenced containers
+class ReachVisitor : public GcVisitor {
+  std::unordered_map<VarBase *, size_t> &_refs;
+  std::unordered_set<VarBase *> &_reachable;
+  std::vector<VarBase *> &_queue;
+  std::unordered_set<const void *> _seen;
+
+public:
+  ReachVisitor(std::unordered_map<VarBase *, size_t> &refs,
+               std::unordered_set<VarBase *> &reachable,
+               std::vector<VarBase *> &queue)
+      : _refs(refs), _reachable(reachable), _queue(queue) {}
+
+  bool enter(const void *storage) { return _seen.insert(storage).second; }
+  void visit(VarBase *child) {
+    if (_refs.find(child) == _refs.end())
+      return;
+    if (_reachable.insert(child).second)
+      _queue.push_back(child);
+  }
+};
+
+Stats collect() {
+  // queued values still count as references to whatever they point at
+  reclaim(0);
+
+  std::vector<VarBase *> objs;
+  {
+    std::lock_guard<std::mutex> lock(GcLock);
+    objs.assign(Tracked.begin(), Tracked.end());
+    Allocated = 0;
+  }
+
+  std::unordered_map<VarBase *, size_t> refs;
+  refs.reserve(objs.size());
+  for (auto &obj : objs) {
+    if (!obj->isImmortal())
+      refs[obj] = obj->refCount();
+  }
+
+  DecrementVisitor decrement(refs);
+  for (auto &obj : objs)
+    obj->traverse(decrement);
+
+  std::unordered_set<VarBase *> reachable;
+  std::vector<VarBase *> queue;
+  for (auto &obj : objs) {
+    auto it = refs.find(obj);
+    if (it == refs.end() || it->second > 0) {
+      reachable.insert(obj);
+      queue.push_back(obj);
+    }
+  }
+
+  ReachVisitor reach(refs, reachable, queue);
+  while (!queue.empty()) {
+    VarBase *obj = queue.back();
+    queue.pop_back();
+    obj->traverse(reach);
+  }
+
+  std::vector<VarBase *> garbage;
+  for (auto &obj : objs) {
+    if (reachable.find(obj) == reachable.end())
+      garbage.push_back(obj);
+  }
+
+  // hold every unreachable container while the cycles are broken so none of
+  // them is freed halfway through, then let them go
+  for (auto &obj : garbage)
+    obj->iref();
+  for (auto &obj : garbage)
+    obj->clearRefs();
+  for (auto &obj : garbage)
+    varDref(obj);
+
+  return {objs.size(), garbage.size()};
+}
+
+void release(std::vector<VarBase *> &vals) {
+  // nested containers spend from what the ones holding them left, so a
+  // structure costs the budget once however it is split up
+  size_t inlined = 0;
+  if (FreeDepth < kFreeDepth && FreeSpent < kFreeBudget)
+    inlined = std::min(vals.size(), kFreeBudget - FreeSpent);
+  FreeSpent += inlined;
+  if (inlined < vals.size()) {
+    std::lock_guard<std::mutex> lock(DeferLock);
+    Deferred.insert(Deferred.end(), vals.begin() + inlined, vals.end());
+    DeferredCount.store(Deferred.size(), std::memory_order_relaxed);
+  }
+  ++FreeDepth;
+  for (size_t i = 0; i < inlined; i++)
+    varDref(vals[i]);
+  if (--FreeDepth == 0)
+    FreeSpent = 0;
+  vals.clear();
+}
+
+bool deferred() { return DeferredCount.load(std::memory_order_relaxed) > 0; }
+
+size_t reclaim(const size_t &budget) {
+  size_t released = 0;
+  std::vector<VarBase *> batch;
+  while (budget == 0 || released < budget) {
+    {
+      std::lock_guard<std::mutex> lock(DeferLock);
+      if (Deferred.empty())
+        break;
+      size_t n = Deferred.size();
+      if (budget != 0 && n > budget - released)
+        n = budget - released;
+      batch.assign(Deferred.end() - n, Deferred.end());
+      Deferred.resize(Deferred.size() - n);
+      DeferredCount.store(Deferred.size(), std::memory_order_relaxed);
+    }
+    // freeing a batch may queue more values, they are picked up by the next
+    // iteration instead of recursing. The batch is one release chain, what
+    // its values hold past the budget is queued as well
+    ++FreeDepth;
+    for (auto &v : batch)
+      varDref(v);
+    if (--FreeDepth == 0)
+      FreeSpent = 0;
+    released += batch.size();
+  }
+  return released;
+}
+
+} // namespace gc
+} // namespace june
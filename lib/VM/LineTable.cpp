@@ -0,0 +1,73 @@
+#include "VM/LineTable.hpp"
+#include "VM/Varint.hpp"
+
+#include <algorithm>
+
+namespace june {
+
+LineTable::LineTable() : _count(0), _lastEnd(0) {}
+
+void LineTable::add(const size_t &begin, const size_t &end) {
+  if (_count % kBlockLines == 0) {
+    _blockBegin.push_back(begin);
+    _blockOffset.push_back(_deltas.size());
+  }
+  varint::write(_deltas, begin >= _lastEnd ? begin - _lastEnd : 0);
+  varint::write(_deltas, end >= begin ? end - begin : 0);
+  _lastEnd = end;
+  _count++;
+}
+
+void LineTable::clear() {
+  _count = 0;
+  _lastEnd = 0;
+  _deltas.clear();
+  _blockBegin.clear();
+  _blockOffset.clear();
+}
+
+bool LineTable::find(const size_t &idx, size_t &line, size_t &begin,
+                     size_t &end) const {
+  auto it = std::upper_bound(_blockBegin.begin(), _blockBegin.end(), idx);
+  if (it == _blockBegin.begin())
+    return false;
+  size_t block = (it - _blockBegin.begin()) - 1;
+
+  size_t pos = _blockOffset[block];
+  size_t prevEnd = _blockBegin[block];
+  size_t first = block * kBlockLines;
+  size_t last = std::min(first + kBlockLines, _count);
+  for (size_t i = first; i < last; i++) {
+    size_t gap, len;
+    varint::read(_deltas.data(), _deltas.size(), pos, gap);
+    varint::read(_deltas.data(), _deltas.size(), pos, len);
+    // the first line of a block starts at the recorded block start
+    begin = i == first ? _blockBegin[block] : prevEnd + gap;
+    end = begin + len;
+    if (idx < begin)
+      return false;
+    if (idx < end) {
+      line = i;
+      return true;
+    }
+    prevEnd = end;
+  }
+  return false;
+}
+
+bool LineTable::decode(const std::uint8_t *data, const size_t &size,
+                       const size_t &count, LineTable &table) {
+  table.clear();
+  size_t pos = 0, prevEnd = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t gap, len;
+    if (!varint::read(data, size, pos, gap) || !varint::read(data, size, pos, len))
+      return false;
+    size_t begin = prevEnd + gap;
+    table.add(begin, begin + len);
+    prevEnd = begin + len;
+  }
+  return pos == size;
+}
+
+} // namespace june
@@ -1,7 +1,9 @@
 #include "VM/OpCodes.hpp"
 #include "Common.hpp"
-#include "VM/Memory.hpp"
+#include "VM/Vars/Base.hpp"
+#include "VM/Verify.hpp"
 #include "c/OpCodes.h"
+#include <algorithm>
 #include <sstream>
 #include <string>
 
@@ -12,7 +14,8 @@ const char *june::OpCodeStrs[_OpLast] = {
     "JumpTrue",   "JumpFalse", "JumpTruePop",   "JumpFalsePop", "JumpNil",
     "BodyMarker", "MakeFunc",  "BlkA",          "BlkR",         "Call",
     "MemberCall", "Attr",      "Return",        "PushLoop",     "PopLoop",
-    "Continue",   "PushJump",  "PushJumpNamed", "PopJump",
+    "Continue",   "Break",     "PushJump",      "PushJumpNamed", "PopJump",
+    "GuardFn",
 };
 
 const char *june::OpDataTypeStrs[_OdtLast] = {
@@ -55,17 +58,263 @@ std::string june::opAsString(Op op) {
   return ss.str();
 }
 
-june::Bytecode::~Bytecode() {
-  using namespace june::mem;
-  
-  for (auto &op : bytecode) {
-    if (op.type != OdtSize && op.type != OdtBool && op.type != OdtNil) {
-      mem::free(op.data.s,
-                      mem::mult8_roundup(strlen(op.data.s) + 1));
+bool june::hasOpTarget(const OpCodes op) {
+  switch (op) {
+  case OpJump:
+  case OpJumpTrue:
+  case OpJumpFalse:
+  case OpJumpTruePop:
+  case OpJumpFalsePop:
+  case OpJumpNil:
+  case OpBodyMarker:
+  case OpContinue:
+  case OpBreak:
+  case OpPushJump:
+  case OpGuardFn:
+    return true;
+  default:
+    return false;
+  }
+}
+
+char *june::Bytecode::intern(const char *str) {
+  if (!strings)
+    strings = std::make_shared<StringArena>();
+  return (char *)strings->intern(str);
+}
+
+void june::Bytecode::assign(std::vector<Op> &&ops,
+                            std::shared_ptr<const fs::MappedFile> file,
+                            std::vector<fs::Const> &&consts,
+                            std::vector<fs::CodeBlock> &&pending) {
+  bytecode = std::move(ops);
+  backing = std::move(file);
+  strings.reset();
+  this->consts = std::move(consts);
+  this->pending = std::move(pending);
+  handlers.clear();
+  handlersBuilt = false;
+  verifiedFor = -1;
+  compiled = nullptr;
+  compiledCount = 0;
+}
+
+bool june::Bytecode::decodeBody(const size_t &begin) {
+  if (pending.empty())
+    return true;
+  auto it = std::lower_bound(
+      pending.begin(), pending.end(), begin,
+      [](const fs::CodeBlock &b, const size_t &pos) { return b.begin < pos; });
+  if (it == pending.end() || it->begin != begin)
+    return true;
+  // the file was only checked for what it decoded on load
+  if (!fs::intact(*it) || !fs::decodeOps(it->data, it->size, it->count,
+                                         consts, bytecode.data() + it->begin))
+    return false;
+  // ops belong to the source their body marker was loaded into
+  for (size_t i = 0; i < it->count; i++)
+    bytecode[it->begin + i].srcId = bytecode[it->begin - 1].srcId;
+  size_t end = bytecode[it->begin - 1].data.sz;
+  pending.erase(it);
+  // the body's `or` regions were not known yet, none of the table begins in it
+  if (handlersBuilt) {
+    std::vector<Handler> found;
+    stripRegions(begin, end, begin, found);
+    auto at = std::lower_bound(
+        handlers.begin(), handlers.end(), begin,
+        [](const Handler &h, const size_t &pos) { return h.begin < pos; });
+    handlers.insert(at, found.begin(), found.end());
+  }
+  if (verifiedFor == bytecode.size())
+    verifyFn(begin, end);
+  return true;
+}
+
+bool june::Bytecode::decodeAll() {
+  while (!pending.empty()) {
+    if (!decodeBody(pending.back().begin))
+      return false;
+  }
+  return true;
+}
+
+bool june::Bytecode::erase(const std::vector<bool> &dead) {
+  return rewrite(dead, {});
+}
+
+bool june::Bytecode::rewrite(const std::vector<bool> &dead,
+                             std::vector<Splice> &&splices) {
+  if (!pending.empty() || handlersBuilt)
+    return false;
+  // where each op lands, a removed one where the op after it does, and where
+  // each splice begins
+  std::vector<size_t> moved(bytecode.size() + 1);
+  std::vector<size_t> spliced(splices.size());
+  size_t live = 0, s = 0;
+  for (size_t i = 0; i <= bytecode.size(); i++) {
+    for (; s < splices.size() && splices[s].at == i; s++) {
+      spliced[s] = live;
+      live += splices[s].ops.size();
+    }
+    moved[i] = live;
+    if (i < bytecode.size() && !dead[i])
+      live++;
+  }
+  if (live == bytecode.size() && splices.empty())
+    return true;
+
+  std::vector<Op> ops;
+  ops.reserve(live);
+  s = 0;
+  for (size_t i = 0; i <= bytecode.size(); i++) {
+    for (; s < splices.size() && splices[s].at == i; s++) {
+      for (size_t k = 0; k < splices[s].ops.size(); k++) {
+        Op op = splices[s].ops[k];
+        if (hasOpTarget(op.op))
+          op.data.sz = splices[s].local[k] ? spliced[s] + op.data.sz
+                                           : moved[op.data.sz];
+        else if (op.type != OdtSize && op.type != OdtBool &&
+                 op.type != OdtNil &&
+                 !(backing && backing->contains(op.data.s)))
+          op.data.s = intern(op.data.s);
+        ops.push_back(op);
+      }
     }
+    if (i == bytecode.size())
+      break;
+    Op &op = bytecode[i];
+    if (dead[i])
+      continue;
+    if (hasOpTarget(op.op) && op.data.sz <= bytecode.size())
+      op.data.sz = moved[op.data.sz];
+    ops.push_back(op);
+  }
+  bytecode.swap(ops);
+  verifiedFor = -1;
+  return true;
+}
+
+// no frame has serial 0, an empty cache never hits
+june::LookupCache::LookupCache() : val(nullptr), frame(0), epoch(0) {}
+
+june::LookupCache::LookupCache(const LookupCache &other)
+    : val(other.val), frame(other.frame), epoch(other.epoch),
+      name(other.name) {
+  varIref(val);
+}
+
+june::LookupCache &june::LookupCache::operator=(const LookupCache &other) {
+  varIref(other.val);
+  varDref(val);
+  val = other.val;
+  frame = other.frame;
+  epoch = other.epoch;
+  name = other.name;
+  return *this;
+}
+
+june::LookupCache::~LookupCache() { varDref(val); }
+
+void june::LookupCache::drop() {
+  varDref(val);
+  val = nullptr;
+  frame = 0;
+}
+
+void june::Bytecode::verify() {
+  verified.clear();
+  handlerDepths.clear();
+  lookupAt.assign(bytecode.size(), 0);
+  lookups.clear();
+  verifiedFor = bytecode.size();
+  verifyFn(0, bytecode.size());
+  for (size_t i = 0; i < bytecode.size(); i++) {
+    if (bytecode[i].op != OpBodyMarker)
+      continue;
+    // bodies still encoded hold placeholders
+    if (isPending(i + 1))
+      continue;
+    if (bytecode[i].data.sz > i && bytecode[i].data.sz <= bytecode.size())
+      verifyFn(i + 1, bytecode[i].data.sz);
+  }
+}
+
+void june::Bytecode::verifyFn(const size_t &begin, const size_t &end) {
+  auto res = verify::function(*this, begin, end);
+  if (res.isErr()) {
+    DebugLog << "function at " << begin << " left unverified: "
+             << res.unwrapErr() << std::endl;
+    return;
+  }
+  verified[begin] = res.unwrap().maxDepth;
+  for (auto &h : res.unwrap().handlers)
+    handlerDepths[h.first] = h.second;
+  for (auto &pos : res.unwrap().lookups) {
+    lookups.emplace_back();
+    lookupAt[pos] = lookups.size();
+  }
+}
+
+bool june::Bytecode::verifiedDepth(const size_t &begin, size_t &depth) const {
+  if (verifiedFor != bytecode.size())
+    return false;
+  auto it = verified.find(begin);
+  if (it == verified.end())
+    return false;
+  depth = it->second;
+  return true;
+}
+
+bool june::Bytecode::handlerDepth(const size_t &pushJump, size_t &depth) const {
+  auto it = handlerDepths.find(pushJump);
+  if (it == handlerDepths.end())
+    return false;
+  depth = it->second;
+  return true;
+}
+
+june::LookupCache *june::Bytecode::lookupCache(const size_t &pos) const {
+  if (verifiedFor != bytecode.size() || lookupAt[pos] == 0)
+    return nullptr;
+  return &lookups[lookupAt[pos] - 1];
+}
+
+void june::Bytecode::eachCached(
+    const std::function<void(VarBase *)> &fn) const {
+  for (auto &cache : lookups) {
+    if (cache.val)
+      fn(cache.val);
   }
 }
 
+void june::Bytecode::dropCached() {
+  for (auto &cache : lookups)
+    cache.drop();
+}
+
+june::TypeFeedback &june::Bytecode::feedbackAt(const size_t &pos) const {
+  if (feedback.size() != bytecode.size())
+    feedback.assign(bytecode.size(), TypeFeedback{{}, 0, false});
+  return feedback[pos];
+}
+
+void june::Bytecode::assignCompiled(const CompiledBody *bodies,
+                                    const size_t &count) {
+  compiled = bodies;
+  compiledCount = count;
+}
+
+const june::CompiledBody *
+june::Bytecode::compiledAt(const size_t &begin) const {
+  const CompiledBody *end = compiled + compiledCount;
+  const CompiledBody *it = std::lower_bound(
+      compiled, end, begin,
+      [](const CompiledBody &body, const size_t &begin) {
+        return body.begin < begin;
+      });
+  return it != end && it->begin == begin ? it : nullptr;
+}
+
 void june::Bytecode::add(const size_t &idx, const OpCodes op) {
   this->bytecode.push_back(Op{0, idx, op, OdtNil, {.s = nullptr}});
 }
@@ -77,7 +326,7 @@ void june::Bytecode::adds(const size_t &idx, const OpCodes op,
          idx,
          op,
          dtype,
-         {.s = (char *)june::string::duplicateAsCString(data)}});
+         {.s = intern(data.c_str())}});
 }
 
 void june::Bytecode::addb(const size_t &idx, const OpCodes op,
@@ -100,6 +349,155 @@ void june::Bytecode::updatesz(const size_t &pos, const size_t &value) {
   this->bytecode.at(pos).data.sz = value;
 }
 
+bool june::Bytecode::isPending(const size_t &begin) const {
+  auto it = std::lower_bound(
+      pending.begin(), pending.end(), begin,
+      [](const fs::CodeBlock &b, const size_t &pos) { return b.begin < pos; });
+  return it != pending.end() && it->begin == begin;
+}
+
+// appends the regions marked in the decoded ops of [from, to) to `found`, the
+// ones outside of nested bodies belong to `owner`, then removes the markers.
+// Body markers and body ends stay where they are, the ops between two of them
+// move up and are followed by jumps to the next one, so nothing outside of
+// [from, to) nor in bodies still encoded moves
+void june::Bytecode::stripRegions(const size_t &from, const size_t &to,
+                                  const size_t &owner,
+                                  std::vector<Handler> &found) {
+  struct BodySpan {
+    size_t begin;
+    size_t end;
+  };
+  std::vector<size_t> open;
+  std::vector<BodySpan> bodies;
+  std::vector<bool> fixed(to - from + 1, false);
+  size_t first = found.size();
+
+  fixed[0] = fixed[to - from] = true;
+  for (size_t i = from; i < to; i++) {
+    while (!bodies.empty() && i >= bodies.back().end)
+      bodies.pop_back();
+
+    const Op &op = bytecode[i];
+    switch (op.op) {
+    case OpBodyMarker:
+      fixed[i - from] = fixed[i + 1 - from] = true;
+      if (op.data.sz <= i || op.data.sz > to)
+        break;
+      fixed[op.data.sz - from] = true;
+      if (isPending(i + 1))
+        i = op.data.sz - 1;
+      else
+        bodies.push_back({i + 1, op.data.sz});
+      break;
+    case OpPushJump:
+      open.push_back(found.size());
+      found.push_back({i + 1, to, op.data.sz, nullptr,
+                       bodies.empty() ? owner : bodies.back().begin});
+      break;
+    case OpPushJumpNamed:
+      if (!open.empty())
+        found[open.back()].name = op.data.s;
+      break;
+    case OpPopJump:
+      if (!open.empty()) {
+        found[open.back()].end = i;
+        open.pop_back();
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  if (found.size() == first)
+    return;
+
+  // a removed marker lands where the op after it does
+  std::vector<size_t> moved(to - from + 1);
+  std::vector<size_t> removed;
+  Op marker = bytecode[from];
+  size_t live = from;
+  for (size_t i = from; i <= to; i++) {
+    if (fixed[i - from]) {
+      for (auto &pos : removed)
+        moved[pos - from] = i;
+      removed.clear();
+      for (; live < i; live++)
+        bytecode[live] =
+            Op{marker.srcId, marker.idx, OpJump, OdtSize, {.sz = i}};
+    }
+    if (i == to) {
+      moved[to - from] = to;
+      break;
+    }
+    const Op op = bytecode[i];
+    if (op.op == OpPushJump || op.op == OpPushJumpNamed ||
+        op.op == OpPopJump) {
+      removed.push_back(i);
+      marker = op;
+      continue;
+    }
+    for (auto &pos : removed)
+      moved[pos - from] = live;
+    removed.clear();
+    moved[i - from] = live;
+    bytecode[live++] = op;
+    if (op.op == OpBodyMarker && op.data.sz > i && op.data.sz <= to &&
+        isPending(i + 1)) {
+      for (size_t k = i + 1; k < op.data.sz; k++)
+        moved[k - from] = k;
+      live = op.data.sz;
+      i = op.data.sz - 1;
+    }
+  }
+
+  // bodies still encoded hold placeholders without targets
+  for (size_t i = from; i < to; i++) {
+    Op &op = bytecode[i];
+    if (hasOpTarget(op.op) && op.data.sz >= from && op.data.sz <= to)
+      op.data.sz = moved[op.data.sz - from];
+  }
+  for (size_t h = first; h < found.size(); h++) {
+    found[h].begin = moved[found[h].begin - from];
+    found[h].end = moved[found[h].end - from];
+    if (found[h].target >= from && found[h].target <= to)
+      found[h].target = moved[found[h].target - from];
+  }
+}
+
+void june::Bytecode::buildHandlers() {
+  if (handlersBuilt)
+    return;
+  handlers.clear();
+  stripRegions(0, bytecode.size(), 0, handlers);
+  handlersBuilt = true;
+}
+
+void june::Bytecode::assignHandlers(std::vector<Handler> &&table) {
+  handlers = std::move(table);
+  for (auto &h : handlers) {
+    if (h.name)
+      h.name = intern(h.name);
+  }
+  handlersBuilt = true;
+}
+
+const june::Handler *june::Bytecode::handlerAt(const size_t &pos,
+                                               const size_t &owner) const {
+  // handlers are ordered by where they begin, so walking back from the last
+  // one beginning at or before `pos` finds nested regions before enclosing
+  // ones
+  auto it = std::upper_bound(
+      handlers.begin(), handlers.end(), pos,
+      [](const size_t &pos, const Handler &h) { return pos < h.begin; });
+  while (it != handlers.begin()) {
+    --it;
+    if (pos < it->end && it->owner == owner)
+      return &*it;
+  }
+  return nullptr;
+}
+
 // C API
 
 june::OpCodes COpCodeToOpCode(const ::OpCodes op) {
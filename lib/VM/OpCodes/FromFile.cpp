@@ -1,414 +1,531 @@
 #include "Common.hpp"
 #include "VM/OpCodes.hpp"
+#include "VM/Varint.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <unordered_map>
 
+#include <cerrno>
+#include <unistd.h>
+
 using namespace june;
 
-int hash(const OpDataType type, const OpData data) {
+// the exact type and value of an operand, two operands share a constant only
+// if their keys are equal
+static std::string constKey(const OpDataType type, const OpData data) {
+  std::string key(1, (char)type);
   switch (type) {
-  case OdtSize:
-    return std::hash<size_t>()(data.sz);
+  case OdtInt:
+  case OdtFloat:
   case OdtString:
   case OdtIdent:
-    return std::hash<std::string>()(data.s);
+    key += data.s;
+    break;
+  case OdtSize:
+    key.append((const char *)&data.sz, sizeof(data.sz));
+    break;
   case OdtBool:
-    return std::hash<bool>()(data.b);
+    key += data.b ? '1' : '0';
+    break;
   default:
-    return 0;
+    break;
   }
+  return key;
 }
 
-FileCompatibleBytecode june::compressBytecode(const std::vector<Op> &bytecode) {
-  std::unordered_map<int, std::pair<OpData, OpDataType>> compressedData;
-  FileCompatibleBytecode fcb;
-  fcb.bytecode.reserve(bytecode.size());
-
-  for (auto &op : bytecode) {
-    FileCompatibleOp fco;
-    fco.srcId = op.srcId;
-    fco.idx = op.idx;
-    fco.op = op.op;
-    fco.type = op.type;
-
-    int dataHash = hash(op.type, op.data);
-    auto it = compressedData.find(dataHash);
-    if (it == compressedData.end()) {
-      compressedData[dataHash] = {op.data, op.type};
-      fco.dataIndex = dataHash;
-    } else {
-      fco.dataIndex = it->first;
-    }
+namespace june {
+namespace fs {
+
+using namespace june::fs;
 
-    fcb.bytecode.push_back(fco);
+/**
+ * The format of the file (version 5)
+ *
+ * [header]
+ * [sections]
+ * [section directory]
+ *
+ * header:
+ *
+ * 'J' 'U' 'N' 'E'
+ * [version (u32)]
+ * [op count (u64)]
+ * [section count (u32)]
+ * [section directory offset (u64)]
+ * [checksum (u64)] FNV-1a of the section directory
+ *
+ * section directory, per section:
+ *
+ * [kind (u32)]
+ * [offset (u64)] from the start of the file
+ * [size (u64)]
+ * [begin (u64)]
+ * [count (u64)]
+ * [checksum (u64)] FNV-1a of the section
+ *
+ * sections:
+ *
+ * code: ops outside of function bodies, they go in [begin, begin + count)
+ * func: the ops of one function body, decoded on its first call; they go in
+ *   [begin, begin + count), the body's OpBodyMarker ends the code section
+ *   before it
+ * lines: the line table (see LineTable), `begin` is the line count
+ * strings: NUL terminated strings, referenced by their offset
+ * consts: per operand [data type (u8)] and then
+ *   if data type is string, ident, int, float: [string offset (LEB128)]
+ *   if data type is size: [size (LEB128)]
+ *   if data type is bool: [bool (u8)]
+ *   if data type is nil: nothing
+ *   operands are interned, equal ones are stored once
+ *
+ * code and func sections together cover every op once. Everything but the
+ * header is written in order, so a file can be streamed out in one pass.
+ * Sections are checked against their checksum on load, but for func
+ * sections, which are checked when they are decoded.
+ *
+ * ops:
+ *
+ * [op | data type << 5 (u8)]
+ * [const index (LEB128)]
+ * [idx - previous op's idx (signed LEB128)]
+ *
+ * the first op of every code and func section is relative to 0. Source ids
+ * are not stored, ops take the id of the source they are loaded into.
+ *
+ * unknown sections are skipped
+ */
+
+namespace {
+enum SectionKind : u32 {
+  SecStrings = 1,
+  SecConsts,
+  SecLines,
+  SecCode,
+  SecFunc,
+};
+
+const size_t kHeaderSize = 4 + sizeof(u32) + sizeof(u64) + sizeof(u32) +
+                           sizeof(u64) * 2;
+const size_t kEntrySize = sizeof(u32) + sizeof(u64) * 5;
+// op code and data type share a byte, a constant index and an idx delta of
+// one byte each follow
+const size_t kMinOpSize = 3;
+static_assert(_OpLast <= 32 && _OdtLast <= 8, "op and type no longer fit a u8");
+// the writer never holds more than this much output
+const size_t kWriteBuffer = 64 * 1024;
+
+struct Section {
+  u32 kind;
+  u64 offset;
+  u64 size;
+  u64 begin;
+  u64 count;
+  u64 sum;
+};
+
+// buffered writes to a file descriptor, checksumming what goes through
+class Stream {
+  int _fd;
+  std::vector<u8> _buf;
+  u64 _flushed;
+  std::uint64_t _hash;
+  bool _ok;
+
+public:
+  Stream(int fd)
+      : _fd(fd), _flushed(0), _hash(hash::kFnvInit), _ok(true) {
+    _buf.reserve(kWriteBuffer);
   }
 
-  return fcb;
-}
+  void write(const void *data, size_t size) {
+    const u8 *p = static_cast<const u8 *>(data);
+    hash::fnv1a(_hash, p, size);
+    while (size > 0) {
+      size_t n = std::min(size, kWriteBuffer - _buf.size());
+      _buf.insert(_buf.end(), p, p + n);
+      p += n;
+      size -= n;
+      if (_buf.size() == kWriteBuffer)
+        flush();
+    }
+  }
 
-DecompressResult
-june::decompressBytecode(const FileCompatibleBytecode &bytecode) {
-  std::vector<Op> decompressedBytecode;
-  std::unordered_map<int, OpData> compressedData;
+  template <typename T> void put(const T &v) { write(&v, sizeof(T)); }
 
-  for (auto &data : bytecode.compressedData) {
-    compressedData[hash(data.second, data.first)] = data.first;
+  void putVarint(const u64 &v) {
+    u8 tmp[varint::kMaxBytes];
+    write(tmp, varint::write(tmp, v));
   }
 
-  for (auto &op : bytecode.bytecode) {
-    Op opd;
-    opd.srcId = op.srcId;
-    opd.idx = op.idx;
-    opd.op = op.op;
-    opd.type = op.type;
-
-    auto it = compressedData.find(op.dataIndex);
-    if (it == compressedData.end()) {
-      return DecompressResult::Err(
-          "Invalid compressed bytecode, data index not found");
-    } else {
-      opd.data = it->second;
+  void putSigned(const std::int64_t &v) { putVarint(varint::zigzag(v)); }
+
+  void flush() {
+    size_t done = 0;
+    while (_ok && done < _buf.size()) {
+      ssize_t n = ::write(_fd, _buf.data() + done, _buf.size() - done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        _ok = false;
+      else
+        done += n;
     }
-
-    decompressedBytecode.push_back(opd);
+    _flushed += _buf.size();
+    _buf.clear();
   }
 
-  return DecompressResult::Ok(decompressedBytecode);
+  // each section and the directory have a checksum of their own
+  inline void restartChecksum() { _hash = hash::kFnvInit; }
+  inline u64 offset() const { return _flushed + _buf.size(); }
+  inline u64 hash() const { return _hash; }
+  inline bool ok() const { return _ok; }
+};
+
+void putOp(Stream &out, const Op &op, const u32 &dataIndex, size_t &prevIdx) {
+  out.put<u8>(op.op | op.type << 5);
+  out.putVarint(dataIndex);
+  out.putSigned((std::int64_t)op.idx - (std::int64_t)prevIdx);
+  prevIdx = op.idx;
 }
 
-namespace june {
-namespace fs {
-
-using namespace june::fs;
+// bounds checked reads from a loaded file
+struct Cursor {
+  const u8 *data;
+  size_t size;
+  size_t offset;
+
+  template <typename T> bool read(T &out) {
+    if (size - offset < sizeof(T))
+      return false;
+    memcpy(&out, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+};
+} // namespace
+
+WriteResult writeBytecode(int fd, const std::vector<Op> &bytecode,
+                          const LineTable &lines) {
+  off_t start = lseek(fd, 0, SEEK_CUR);
+  if (start < 0)
+    return WriteResult::Err("cannot write bytecode, output is not seekable");
+
+  Stream out(fd);
+  u8 header[kHeaderSize] = {0};
+  out.write(header, kHeaderSize);
+
+  // operands are interned as the ops are written, ops refer to them by their
+  // dense index
+  std::unordered_map<std::string, u32> constAt;
+  std::vector<Const> constList;
+  auto intern = [&](const Op &op) -> u32 {
+    auto res = constAt.emplace(constKey(op.type, op.data), constList.size());
+    if (res.second)
+      constList.push_back({op.data, op.type});
+    return res.first->second;
+  };
+
+  // top-level code is cut into sections at each function body, bodies get a
+  // section each and nested bodies are part of their enclosing one
+  std::vector<Section> sections;
+  const size_t n = bytecode.size();
+  for (size_t i = 0; i < n;) {
+    Section code{SecCode, out.offset(), 0, i, 0, 0};
+    out.restartChecksum();
+    size_t prevIdx = 0, bodyEnd = 0;
+    while (i < n) {
+      const Op &op = bytecode[i++];
+      putOp(out, op, intern(op), prevIdx);
+      code.count++;
+      if (op.op == OpBodyMarker && op.data.sz > i && op.data.sz <= n) {
+        bodyEnd = op.data.sz;
+        break;
+      }
+    }
+    code.size = out.offset() - code.offset;
+    code.sum = out.hash();
+    sections.push_back(code);
+    if (!bodyEnd)
+      continue;
+
+    Section fn{SecFunc, out.offset(), 0, i, bodyEnd - i, 0};
+    out.restartChecksum();
+    prevIdx = 0;
+    for (; i < bodyEnd; i++)
+      putOp(out, bytecode[i], intern(bytecode[i]), prevIdx);
+    fn.size = out.offset() - fn.offset;
+    fn.sum = out.hash();
+    sections.push_back(fn);
+  }
 
-u8 *writeBytecode(const std::vector<Op> &bytecode,
-                  const std::vector<SrcColRange> &srcRanges) {
-  /**
-   * The format of the file
-   *
-   * bytecode:
-   *
-   * [magic]
-   * [col count (u32)]
-   * [cols]
-   * [data size (u32)]
-   * [data]
-   * [op size (u32)]
-   * [ops]
-   *
-   * magic:
-   *
-   * 'J' 'U' 'N' 'E'
-   * 0x4A, 0x55, 0x4E, 0x45
-   *
-   * cols:
-   * [
-   *
-   * data:
-   *
-   * [data type (u8)]
-   * [inner (size depends on data type, see below)]
-   *
-   * inner:
-   * if data type is string, ident:
-   * [str size (u32)]
-   * [str]
-   * if data type is size:
-   * [size (u64)]
-   * if data type is int:
-   * [int (i64)]
-   * if data type is float:
-   * [float (f64)]
-   * if data type is bool:
-   * [bool (u8)]
-   *
-   * ops:
-   *
-   * [src id len (u32)]
-   * [src id]
-   * [idx (u32)]
-   * [op (u8)]
-   * [type (u8)]
-   * [data index (u32)]
-   */
-
-  u8 *data = nullptr;
-  size_t dataSize = 0;
-  size_t opSize = 0;
-
-  auto compressedBytecode = compressBytecode(bytecode);
-
-  for (auto &d : compressedBytecode.compressedData) {
-    dataSize += sizeof(u8);
-    switch (d.second) {
+  const std::vector<u8> &lineTable = lines.encoded();
+  sections.push_back({SecLines, out.offset(), lineTable.size(), lines.size(),
+                      0, hash::fnv1a(lineTable.data(), lineTable.size())});
+  if (!lineTable.empty())
+    out.write(lineTable.data(), lineTable.size());
+
+  Section strings{SecStrings, out.offset(), 0, 0, 0, 0};
+  out.restartChecksum();
+  std::unordered_map<std::string, u64> stringAt;
+  std::vector<u64> constString(constList.size(), 0);
+  for (size_t i = 0; i < constList.size(); i++) {
+    const Const &c = constList[i];
+    if (c.second > OdtIdent)
+      continue;
+    auto res = stringAt.emplace(c.first.s, out.offset() - strings.offset);
+    if (res.second)
+      out.write(c.first.s, strlen(c.first.s) + 1);
+    constString[i] = res.first->second;
+  }
+  strings.size = out.offset() - strings.offset;
+  strings.sum = out.hash();
+  sections.push_back(strings);
+
+  Section consts{SecConsts, out.offset(), 0, 0, constList.size(), 0};
+  out.restartChecksum();
+  for (size_t i = 0; i < constList.size(); i++) {
+    const Const &c = constList[i];
+    out.put<u8>(c.second);
+    switch (c.second) {
+    case OdtInt:
+    case OdtFloat:
     case OdtString:
     case OdtIdent:
-      dataSize += sizeof(u32);
-      dataSize += strlen(d.first.s);
+      out.putVarint(constString[i]);
       break;
     case OdtSize:
-    case OdtInt:
-    case OdtFloat:
-      dataSize += sizeof(u64);
+      out.putVarint(c.first.sz);
       break;
     case OdtBool:
-      dataSize += sizeof(u8);
+      out.put<u8>(c.first.b);
       break;
     default:
       break;
     }
   }
-
-  for (auto &op : compressedBytecode.bytecode) {
-    opSize += sizeof(u32);
-    opSize += sizeof(u64);
-    opSize += sizeof(u32);
-    opSize += sizeof(u8);
-    opSize += sizeof(u8);
-    opSize += sizeof(u32);
+  consts.size = out.offset() - consts.offset;
+  consts.sum = out.hash();
+  sections.push_back(consts);
+
+  u64 directory = out.offset();
+  out.restartChecksum();
+  for (auto &sec : sections) {
+    out.put<u32>(sec.kind);
+    out.put<u64>(sec.offset);
+    out.put<u64>(sec.size);
+    out.put<u64>(sec.begin);
+    out.put<u64>(sec.count);
+    out.put<u64>(sec.sum);
   }
+  out.flush();
+  if (!out.ok())
+    return WriteResult::Err("failed to write bytecode");
+
+  u8 *h = header;
+  *h++ = 'J';
+  *h++ = 'U';
+  *h++ = 'N';
+  *h++ = 'E';
+  u32 version = kBytecodeVersion;
+  u64 opCount = n, sum = out.hash();
+  u32 sectionCount = sections.size();
+  memcpy(h, &version, sizeof(u32));
+  h += sizeof(u32);
+  memcpy(h, &opCount, sizeof(u64));
+  h += sizeof(u64);
+  memcpy(h, &sectionCount, sizeof(u32));
+  h += sizeof(u32);
+  memcpy(h, &directory, sizeof(u64));
+  h += sizeof(u64);
+  memcpy(h, &sum, sizeof(u64));
+  if (pwrite(fd, header, kHeaderSize, start) != (ssize_t)kHeaderSize)
+    return WriteResult::Err("failed to write bytecode header");
+
+  return WriteResult::Ok(out.offset());
+}
 
-  data = new u8[dataSize + opSize + sizeof(u32) * 2 + sizeof(u8) * 4];
-
-  data[0] = 'J';
-  data[1] = 'U';
-  data[2] = 'N';
-  data[3] = 'E';
-
-  u32 colCount = srcRanges.size();
-  memcpy(data + 4, &colCount, sizeof(u32));
+bool intact(const CodeBlock &block) {
+  return block.sum == hash::fnv1a(block.data, block.size);
+}
 
-  for (u32 i = 0; i < colCount; i++) {
-    u64 colBegin = srcRanges[i].begin;
-    u64 colEnd = srcRanges[i].end;
-    memcpy(data + 8 + i * 8, &colBegin, sizeof(u64));
-    memcpy(data + 8 + i * 8 + 4, &colEnd, sizeof(u64));
+bool decodeOps(const u8 *data, const size_t &size, const size_t &count,
+               const std::vector<Const> &consts, Op *out, size_t *used) {
+  size_t pos = 0;
+  std::int64_t idx = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (pos >= size)
+      return false;
+    u8 op = data[pos] & 0x1f;
+    u8 type = data[pos] >> 5;
+    pos++;
+    u64 dataIndex;
+    std::int64_t delta;
+    if (!varint::read(data, size, pos, dataIndex) ||
+        !varint::readSigned(data, size, pos, delta))
+      return false;
+    idx += delta;
+    if (op >= _OpLast || dataIndex >= consts.size() ||
+        consts[dataIndex].second != type || idx < 0)
+      return false;
+    out[i] = Op{0, (size_t)idx, static_cast<OpCodes>(op),
+                static_cast<OpDataType>(type), consts[dataIndex].first};
   }
+  if (used)
+    *used = pos;
+  return used || pos == size;
+}
 
-  u32 dataSizeU32 = dataSize;
-  memcpy(data + 8 + (colCount * (sizeof(u64) * 2)), &dataSizeU32, sizeof(u32));
+ReadResult readBytecode(const u8 *bytecode, const size_t &size) {
+  // see above for the format
+  Cursor in{bytecode, size, 4};
 
-  u8 offset = 8 + (colCount * (sizeof(u64) * 2)) + sizeof(u32);
-  for (auto &d : compressedBytecode.compressedData) {
-    u8 type = d.second;
-    memcpy(data + offset, &type, sizeof(u8));
-    offset += sizeof(u8);
+  if (size < kHeaderSize || bytecode[0] != 'J' || bytecode[1] != 'U' ||
+      bytecode[2] != 'N' || bytecode[3] != 'E') {
+    return ReadResult::Err("Invalid bytecode, invalid magic");
+  }
 
-    switch (d.second) {
-    case OdtFloat:
-    case OdtInt:
-    case OdtString:
-    case OdtIdent: {
-      u32 strSize = strlen(d.first.s);
-      memcpy(data + offset, &strSize, sizeof(u32));
-      offset += sizeof(u32);
-      memcpy(data + offset, d.first.s, strSize);
-      offset += strSize;
+  u32 version, sectionCount;
+  u64 opCount, directory, sum;
+  in.read(version);
+  in.read(opCount);
+  in.read(sectionCount);
+  in.read(directory);
+  in.read(sum);
+  if (version != kBytecodeVersion)
+    return ReadResult::Err("Unsupported bytecode version " +
+                           std::to_string(version));
+  if (directory < kHeaderSize || directory > size ||
+      (size - directory) / kEntrySize < sectionCount ||
+      opCount > size / kMinOpSize)
+    return ReadResult::Err("Invalid bytecode, truncated section directory");
+  if (sum != hash::fnv1a(bytecode + directory, sectionCount * kEntrySize))
+    return ReadResult::Err("Invalid bytecode, checksum mismatch");
+
+  const u8 *strings = nullptr, *consts = nullptr;
+  size_t stringsSize = 0, constsSize = 0;
+  bool hasConsts = false;
+  std::vector<CodeBlock> code;
+  ValidRead res;
+  in.offset = directory;
+  for (u32 i = 0; i < sectionCount; i++) {
+    u32 kind;
+    u64 offset, secSize, begin, count, secSum;
+    in.read(kind);
+    in.read(offset);
+    in.read(secSize);
+    in.read(begin);
+    in.read(count);
+    in.read(secSum);
+    if (offset > size || size - offset < secSize)
+      return ReadResult::Err("Invalid bytecode, section out of bounds");
+
+    // function bodies are checked once they are first called
+    const u8 *data = bytecode + offset;
+    if (kind >= SecStrings && kind < SecFunc &&
+        secSum != hash::fnv1a(data, secSize))
+      return ReadResult::Err("Invalid bytecode, checksum mismatch");
+    switch (kind) {
+    case SecStrings:
+      strings = data;
+      stringsSize = secSize;
       break;
-    }
-    case OdtSize: {
-      u64 size = d.first.sz;
-      memcpy(data + offset, &size, sizeof(u64));
-      offset += sizeof(u64);
+    case SecConsts:
+      consts = data;
+      constsSize = secSize;
+      hasConsts = true;
       break;
-    }
-    case OdtBool: {
-      u8 b = d.first.b;
-      memcpy(data + offset, &b, sizeof(u8));
-      offset += sizeof(u8);
+    case SecLines:
+      if (begin > UINT32_MAX || !LineTable::decode(data, secSize, begin,
+                                                    res.lines))
+        return ReadResult::Err("Invalid bytecode, malformed line table");
+      break;
+    case SecCode:
+    case SecFunc:
+      if (begin > opCount || opCount - begin < count)
+        return ReadResult::Err("Invalid bytecode, code out of bounds");
+      (kind == SecCode ? code : res.pending)
+          .push_back({begin, count, data, secSize, secSum});
       break;
-    }
     default:
       break;
     }
   }
-
-  u32 opSizeU32 = opSize;
-  memcpy(data + offset, &opSizeU32, sizeof(u32));
-  offset += sizeof(u32);
-
-  for (auto &op : compressedBytecode.bytecode) {
-    memcpy(data + offset, &op.srcId, sizeof(u64));
-    offset += sizeof(u64);
-    memcpy(data + offset, &op.idx, sizeof(u32));
-    offset += sizeof(u32);
-    memcpy(data + offset, &op.op, sizeof(u8));
-    offset += sizeof(u8);
-    memcpy(data + offset, &op.type, sizeof(u8));
-    offset += sizeof(u8);
-    memcpy(data + offset, &op.dataIndex, sizeof(u32));
-    offset += sizeof(u32);
-  }
-
-  return data;
-}
-
-ReadResult readBytecode(const u8 *bytecode) {
-  /**
-   * The format of the file
-   *
-   * bytecode:
-   *
-   * [magic]
-   * [col count (u32)]
-   * [cols]
-   * [data size (u32)]
-   * [data]
-   * [op size (u32)]
-   * [ops]
-   *
-   * magic:
-   *
-   * 'J' 'U' 'N' 'E'
-   * 0x4A, 0x55, 0x4E, 0x45
-   *
-   * data:
-   *
-   * [data type (u8)]
-   * [inner (size depends on data type, see below)]
-   *
-   * inner:
-   * if data type is string, ident:
-   * [str size (u32)]
-   * [str]
-   * if data type is size:
-   * [size (u64)]
-   * if data type is int:
-   * [int (i64)]
-   * if data type is float:
-   * [float (f64)]
-   * if data type is bool:
-   * [bool (u8)]
-   *
-   * ops:
-   *
-   * [src id len (u32)]
-   * [src id]
-   * [idx (u32)]
-   * [op (u8)]
-   * [type (u8)]
-   * [data index (u32)]
-   */
-
-  if (bytecode[0] != 'J' || bytecode[1] != 'U' || bytecode[2] != 'N' ||
-      bytecode[3] != 'E') {
-    return ReadResult::Err("Invalid bytecode, invalid magic");
-  }
-
-  u32 colCount;
-  u32 colSize;
-  u32 dataSize;
-  u32 opSize;
-
-  memcpy(&colCount, bytecode + 4, sizeof(u32));
-  colSize = colCount * (sizeof(u64) * 2);
-
-  memcpy(&dataSize, bytecode + 8 + colSize, sizeof(u32));
-  memcpy(&opSize, bytecode + 8 + colSize + 4 + dataSize, sizeof(u32));
-
-  std::vector<std::pair<OpData, OpDataType>> compressedData;
-  std::vector<FileCompatibleOp> bytecodeOps;
-  std::vector<SrcColRange> srcRanges;
-
-  u8 offset = 8; // magic + colCount
-  for (u32 i = 0; i < colCount; i++) {
-    u64 colBegin;
-    u64 colEnd;
-    memcpy(&colBegin, bytecode + offset, sizeof(u64));
-    offset += sizeof(u64);
-    memcpy(&colEnd, bytecode + offset, sizeof(u64));
-    offset += sizeof(u64);
-    srcRanges.push_back({colBegin, colEnd});
-  }
-
-  offset += sizeof(u32); // skip data size
-  for (u32 i = 0; i < dataSize;) {
+  if (!hasConsts)
+    return ReadResult::Err("Invalid bytecode, missing section");
+  // every string offset then reads a terminated string
+  if (stringsSize > 0 && strings[stringsSize - 1] != '\0')
+    return ReadResult::Err("Invalid bytecode, malformed string table");
+
+  // operands are not copied, strings point into the file
+  Cursor din{consts, constsSize, 0};
+  while (din.offset < din.size) {
     u8 type;
-    memcpy(&type, bytecode + offset, sizeof(u8));
-    offset += sizeof(u8);
-    i += sizeof(u8);
-
+    din.read(type);
     switch (type) {
     case OdtInt:
     case OdtFloat:
     case OdtString:
     case OdtIdent: {
-      u32 strSize;
-      memcpy(&strSize, bytecode + offset, sizeof(u32));
-      offset += sizeof(u32);
-
-      char *str = new char[strSize + 1];
-      memcpy(str, bytecode + offset, strSize);
-      str[strSize] = '\0';
-      offset += strSize;
-      i += strSize + sizeof(u32);
-
-      compressedData.push_back({{.s = str}, static_cast<OpDataType>(type)});
+      u64 at;
+      if (!varint::read(consts, constsSize, din.offset, at) ||
+          at >= stringsSize)
+        return ReadResult::Err("Invalid bytecode, malformed string");
+      res.consts.push_back(
+          {{.s = (char *)(strings + at)}, static_cast<OpDataType>(type)});
       break;
     }
     case OdtSize: {
-      u64 size;
-      memcpy(&size, bytecode + offset, sizeof(u64));
-      offset += sizeof(u64);
-      i += sizeof(u64);
-
-      compressedData.push_back({{.sz = size}, static_cast<OpDataType>(type)});
+      u64 sz;
+      if (!varint::read(consts, constsSize, din.offset, sz))
+        return ReadResult::Err("Invalid bytecode, truncated size");
+      res.consts.push_back({{.sz = sz}, OdtSize});
       break;
     }
     case OdtBool: {
       u8 b;
-      memcpy(&b, bytecode + offset, sizeof(u8));
-      offset += sizeof(u8);
-      i += sizeof(u8);
-      compressedData.push_back(
-          {{.b = static_cast<bool>(b)}, static_cast<OpDataType>(type)});
+      if (!din.read(b))
+        return ReadResult::Err("Invalid bytecode, truncated bool");
+      res.consts.push_back({{.b = b != 0}, OdtBool});
       break;
     }
-    default:
+    case OdtNil:
+      res.consts.push_back({{.s = nullptr}, OdtNil});
       break;
+    default:
+      return ReadResult::Err("Invalid bytecode, unknown data type");
     }
   }
 
-  offset += sizeof(u32); // skip op size
-  for (u32 i = 0; i < opSize;) {
-    u64 srcId;
-    memcpy(&srcId, bytecode + offset, sizeof(u64));
-    offset += sizeof(u64);
-    i += sizeof(u64);
-
-    u32 idx;
-    memcpy(&idx, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-    i += sizeof(u32);
-
-    u8 op;
-    memcpy(&op, bytecode + offset, sizeof(u8));
-    offset += sizeof(u8);
-    i += sizeof(u8);
-
-    u8 type;
-    memcpy(&type, bytecode + offset, sizeof(u8));
-    offset += sizeof(u8);
-    i += sizeof(u8);
-
-    u32 dataIndex;
-    memcpy(&dataIndex, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-    i += sizeof(u32);
-
-    bytecodeOps.push_back(FileCompatibleOp{srcId, idx, static_cast<OpCodes>(op),
-                                           static_cast<OpDataType>(type),
-                                           dataIndex});
+  auto byBegin = [](const CodeBlock &a, const CodeBlock &b) {
+    return a.begin < b.begin;
+  };
+  std::sort(res.pending.begin(), res.pending.end(), byBegin);
+
+  // code and function sections must cover every op exactly once
+  std::vector<CodeBlock> all(code);
+  all.insert(all.end(), res.pending.begin(), res.pending.end());
+  std::sort(all.begin(), all.end(), byBegin);
+  size_t pos = 0;
+  for (auto &block : all) {
+    if (block.begin != pos)
+      return ReadResult::Err("Invalid bytecode, code sections overlap or "
+                             "leave gaps");
+    pos += block.count;
   }
-
-  auto res =
-      decompressBytecode(FileCompatibleBytecode{compressedData, bytecodeOps});
-
-  if (res.isErr()) {
-    return ReadResult::Err(res.unwrapErr());
+  if (pos != opCount)
+    return ReadResult::Err("Invalid bytecode, code sections overlap or "
+                           "leave gaps");
+
+  // bodies not decoded yet return right away should they be run
+  res.bytecode.assign(opCount, Op{0, 0, OpReturn, OdtNil, {.s = nullptr}});
+  for (auto &block : code) {
+    if (!decodeOps(block.data, block.size, block.count, res.consts,
+                   res.bytecode.data() + block.begin))
+      return ReadResult::Err("Invalid bytecode, malformed code");
   }
 
-  return ReadResult::Ok({.bytecode = res.unwrap(), .srcRanges = {}});
+  return ReadResult::Ok(std::move(res));
 }
 
 } // namespace fs
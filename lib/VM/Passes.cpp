@@ -0,0 +1,612 @@
+#include "VM/Passes.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "Common.hpp"
+#include "VM/OpCodes.hpp"
+#include "VM/Verify.hpp"
+
+namespace june {
+
+namespace passes {
+
+namespace {
+
+bool isJump(const OpCodes op) {
+  return hasOpTarget(op) && op != OpBodyMarker && op != OpPushJump &&
+         op != OpGuardFn;
+}
+
+bool isConditional(const OpCodes op) {
+  return op == OpJumpTrue || op == OpJumpFalse || op == OpJumpTruePop ||
+         op == OpJumpFalsePop || op == OpJumpNil;
+}
+
+// ops after which the next one is not run
+bool isTerminator(const OpCodes op) {
+  return op == OpJump || op == OpContinue || op == OpBreak ||
+         op == OpReturn || op == OpBodyMarker;
+}
+
+// constants whose load cannot fail
+bool isConstant(const Op &op) {
+  return op.op == OpLoad &&
+         (op.type == OdtInt || op.type == OdtFloat || op.type == OdtString ||
+          op.type == OdtBool || op.type == OdtNil);
+}
+
+class JumpThreading : public Pass {
+public:
+  const char *name() const override { return "jump-threading"; }
+
+  void run(Function &fn, Stats &stats) override {
+    for (size_t i = fn.begin; i < fn.end; i = fn.next(i)) {
+      Op &op = fn.ops[i];
+      if (!isJump(op.op))
+        continue;
+      // a loop made only of jumps never ends, the hops are bounded for it
+      size_t to = op.data.sz;
+      for (size_t hops = 0; hops < fn.end - fn.begin && fn.owns(to) &&
+                            fn.ops[to].op == OpJump;
+           hops++)
+        to = fn.ops[to].data.sz;
+      if (to != op.data.sz) {
+        op.data.sz = to;
+        stats.rewritten++;
+      }
+      if (op.op == OpJump && to == i + 1) {
+        fn.dead[i] = true;
+        stats.removed++;
+      }
+    }
+  }
+};
+
+class DeadCode : public Pass {
+public:
+  const char *name() const override { return "dead-code"; }
+
+  void run(Function &fn, Stats &stats) override {
+    std::vector<bool> reached(fn.end - fn.begin, false);
+    std::vector<size_t> work;
+    auto reach = [&](const size_t &pos) {
+      if (pos >= fn.end || !fn.owns(pos) || reached[pos - fn.begin])
+        return;
+      reached[pos - fn.begin] = true;
+      work.push_back(pos);
+    };
+    reach(fn.begin);
+
+    while (!work.empty()) {
+      size_t pos = work.back();
+      work.pop_back();
+      const Op &op = fn.ops[pos];
+      if (hasOpTarget(op.op))
+        reach(op.data.sz);
+      if (!isTerminator(op.op))
+        reach(pos + 1);
+    }
+
+    for (size_t i = fn.begin; i < fn.end; i = fn.next(i)) {
+      if (reached[i - fn.begin])
+        continue;
+      // `or` regions are paired by position, and bodies are left whole
+      OpCodes op = fn.ops[i].op;
+      if (op == OpPushJump || op == OpPushJumpNamed || op == OpPopJump ||
+          op == OpBodyMarker)
+        continue;
+      fn.dead[i] = true;
+      stats.removed++;
+    }
+  }
+};
+
+class ConstantConditions : public Pass {
+public:
+  const char *name() const override { return "constant-conditions"; }
+
+  void run(Function &fn, Stats &stats) override {
+    for (size_t i = fn.begin; i + 1 < fn.end; i = fn.next(i)) {
+      const Op &load = fn.ops[i];
+      Op &jump = fn.ops[i + 1];
+      if (!isConstant(load) || !isConditional(jump.op) || fn.targets[i + 1])
+        continue;
+
+      // other constants are converted through their type's `toBool`, which
+      // code may replace
+      bool taken;
+      if (jump.op == OpJumpNil)
+        taken = load.type == OdtNil;
+      else if (load.type != OdtBool)
+        continue;
+      else if (jump.op == OpJumpTrue || jump.op == OpJumpTruePop)
+        taken = load.data.b;
+      else
+        taken = !load.data.b;
+
+      // the value stays on the stack as the interpreter leaves it
+      bool kept = verify::keeps(jump.op, taken);
+      if (taken) {
+        jump.op = OpJump;
+        stats.rewritten++;
+      } else {
+        fn.dead[i + 1] = true;
+        stats.removed++;
+      }
+      if (!kept) {
+        fn.dead[i] = true;
+        stats.removed++;
+      }
+      i++;
+    }
+  }
+};
+
+class EmptyBlocks : public Pass {
+  // a block takes the bindings stashed by a call or a named `or` handler, so
+  // only one opened right after another block on the same path binds nothing
+  static bool flushed(const Function &fn, const size_t &pos) {
+    for (size_t k = pos; k > fn.begin; k--) {
+      if (fn.targets[k])
+        return false;
+      const Op &prev = fn.ops[k - 1];
+      if (!fn.owns(k - 1) || isTerminator(prev.op) ||
+          isConditional(prev.op) || prev.op == OpPushJump)
+        return false;
+      if (prev.op == OpBlkA && !fn.dead[k - 1])
+        return true;
+    }
+    return false;
+  }
+
+  // ops that neither bind nor jump
+  static bool harmless(const OpCodes op) {
+    return op == OpLoad || op == OpUnload || op == OpStore || op == OpAttr ||
+           op == OpCall || op == OpMemberCall;
+  }
+
+public:
+  const char *name() const override { return "empty-blocks"; }
+
+  void run(Function &fn, Stats &stats) override {
+    for (size_t i = fn.begin; i < fn.end; i = fn.next(i)) {
+      if (fn.ops[i].op != OpBlkA || !flushed(fn, i))
+        continue;
+      size_t j = i + 1;
+      while (j < fn.end && !fn.targets[j] && harmless(fn.ops[j].op))
+        j++;
+      if (j == fn.end || fn.targets[j] || fn.ops[j].op != OpBlkR ||
+          fn.ops[j].data.sz != fn.ops[i].data.sz)
+        continue;
+      fn.dead[i] = fn.dead[j] = true;
+      stats.removed += 2;
+      i = j;
+    }
+  }
+};
+
+class UnusedLoads : public Pass {
+public:
+  const char *name() const override { return "unused-loads"; }
+
+  void run(Function &fn, Stats &stats) override {
+    for (size_t i = fn.begin; i + 1 < fn.end; i = fn.next(i)) {
+      if (!isConstant(fn.ops[i]) || fn.ops[i + 1].op != OpUnload ||
+          fn.targets[i + 1])
+        continue;
+      fn.dead[i] = fn.dead[i + 1] = true;
+      stats.removed += 2;
+      i++;
+    }
+  }
+};
+
+class Inliner : public Pass {
+  struct Callee {
+    size_t begin;
+    size_t end;
+    // in the order their arguments are pushed
+    std::vector<std::string> params;
+  };
+
+  // functions created by `fn name(...)`, names bound to more than one are left
+  // out
+  std::unordered_map<std::string, Callee> callees;
+  std::unordered_set<std::string> defined, ambiguous;
+
+  // gets the names the `n` ops before `pos` load, fails if they are not all
+  // string constants
+  static bool namesBefore(const std::vector<Op> &ops, const size_t &pos,
+                          const size_t &n, std::vector<std::string> &names) {
+    if (pos < n)
+      return false;
+    for (size_t k = pos - n; k < pos; k++) {
+      if (ops[k].op != OpLoad || ops[k].type != OdtString)
+        return false;
+      names.push_back(ops[k].data.s);
+    }
+    return true;
+  }
+
+  // names the function binds, or that may be bound in its frame when it runs
+  static bool boundIn(const Function &fn, std::unordered_set<std::string> &bound) {
+    bound.insert("self");
+    if (fn.begin > 0) {
+      const Op &make = fn.ops[fn.end];
+      size_t n = strlen(make.data.s) - 1 + (make.data.s[0] == '1' ? 1 : 0);
+      std::vector<std::string> params;
+      if (!namesBefore(fn.ops, fn.begin - 1, n, params))
+        return false;
+      bound.insert(params.begin(), params.end());
+    }
+    for (size_t i = fn.begin; i < fn.end; i = fn.next(i)) {
+      const Op &op = fn.ops[i];
+      if ((op.op == OpLoad && op.type == OdtString) || op.op == OpPushJumpNamed)
+        bound.insert(op.data.s);
+    }
+    return true;
+  }
+
+  // an argument is loaded where the body loads its parameter
+  static bool simpleArg(const Op &op) {
+    return op.op == OpLoad && op.type != OdtSize;
+  }
+
+  // the stack depth each op of the callee starts with, and its end (-1 if not
+  // reached), fails if it does not return exactly its result
+  static bool depths(const std::vector<Op> &ops, const Callee &callee,
+                     std::vector<long> &depth) {
+    size_t begin = callee.begin, end = callee.end;
+    depth.assign(end - begin + 1, -1);
+    depth[0] = 0;
+    auto flow = [&](const size_t &to, const long &d) {
+      long &known = depth[to - begin];
+      if (known != -1 && known != d)
+        return false;
+      known = d;
+      return true;
+    };
+    for (size_t i = begin; i < end; i++) {
+      const Op &op = ops[i];
+      long d = depth[i - begin];
+      if (d == -1)
+        continue;
+      if (d < (long)verify::pops(op))
+        return false;
+      switch (op.op) {
+      case OpReturn:
+        if (d != (op.data.b ? 1 : 0))
+          return false;
+        break;
+      case OpJump:
+        if (!flow(op.data.sz, d))
+          return false;
+        break;
+      case OpJumpTrue:
+      case OpJumpFalse:
+      case OpJumpTruePop:
+      case OpJumpFalsePop:
+      case OpJumpNil:
+        if (!flow(op.data.sz, d - (verify::keeps(op.op, true) ? 0 : 1)) ||
+            !flow(i + 1, d - (verify::keeps(op.op, false) ? 0 : 1)))
+          return false;
+        break;
+      default:
+        if (!flow(i + 1, d - verify::pops(op) + verify::pushes(op)))
+          return false;
+        break;
+      }
+    }
+    // falling off the end returns nil
+    return depth[end - begin] <= 0;
+  }
+
+  // queues the body of `callee` after the callee's load at `load`, if it can
+  // stand in for the call at `call`
+  bool inlineAt(Function &fn, const Callee &callee, const size_t &load,
+                const size_t &call,
+                const std::unordered_set<std::string> &bound) {
+    const std::vector<Op> &ops = fn.ops;
+    std::vector<size_t> uses(callee.params.size(), 0);
+    for (size_t i = callee.begin; i < callee.end; i++) {
+      const Op &op = ops[i];
+      switch (op.op) {
+      case OpLoad: {
+        if (op.type != OdtIdent)
+          break;
+        auto param = std::find(callee.params.begin(), callee.params.end(),
+                               std::string(op.data.s));
+        if (param != callee.params.end())
+          uses[param - callee.params.begin()]++;
+        else if (bound.find(op.data.s) != bound.end())
+          return false;
+        break;
+      }
+      case OpMemberCall:
+        if (op.data.s[0] != '0')
+          return false;
+        break;
+      case OpJump:
+      case OpJumpTrue:
+      case OpJumpFalse:
+      case OpJumpTruePop:
+      case OpJumpFalsePop:
+      case OpJumpNil:
+        if (op.data.sz <= i || op.data.sz > callee.end)
+          return false;
+        break;
+      case OpUnload:
+      case OpAttr:
+      case OpBlkA:
+      case OpBlkR:
+      case OpReturn:
+        break;
+      default:
+        return false;
+      }
+    }
+    // the arguments must still be loaded once each, in order, before
+    // anything of the call may fail or branch: the body loads each parameter
+    // once, in order, with nothing but constants ahead of them
+    for (size_t k = 0; k < uses.size(); k++) {
+      if (uses[k] != 1)
+        return false;
+    }
+    for (size_t i = callee.begin, k = 0; k < callee.params.size(); i++) {
+      const Op &op = ops[i];
+      if (op.op == OpLoad && op.type == OdtIdent) {
+        if (callee.params[k] != op.data.s)
+          return false;
+        k++;
+      } else if (op.op != OpBlkA && !isConstant(op)) {
+        return false;
+      }
+    }
+    std::vector<long> depth;
+    if (!depths(ops, callee, depth))
+      return false;
+
+    // the guard falls back to the arguments and the call, the copy jumps past
+    // them; its scopes bind nothing and are dropped
+    const Op &at = ops[call];
+    Splice splice{load + 1, {}, {}};
+    auto emit = [&](const Op &op, const bool local) {
+      splice.ops.push_back(op);
+      splice.local.push_back(local);
+    };
+    auto emitOp = [&](const OpCodes code, const size_t &sz, const bool local) {
+      emit(Op{at.srcId, at.idx, code, OdtSize, {.sz = sz}}, local);
+    };
+    emitOp(OpGuardFn, callee.begin, false);
+    emitOp(OpJumpFalsePop, load + 1, false);
+    emit(Op{at.srcId, at.idx, OpUnload, OdtNil, {.s = nullptr}}, false);
+
+    std::vector<size_t> placed(callee.end - callee.begin + 1);
+    for (size_t i = callee.begin; i < callee.end; i++) {
+      const Op &op = ops[i];
+      placed[i - callee.begin] = splice.ops.size();
+      if (op.op == OpBlkA || op.op == OpBlkR)
+        continue;
+      if (op.op == OpReturn) {
+        if (!op.data.b)
+          emit(Op{op.srcId, op.idx, OpLoad, OdtNil, {.s = nullptr}}, false);
+        emit(Op{op.srcId, op.idx, OpJump, OdtSize, {.sz = call + 1}}, false);
+        continue;
+      }
+      if (op.op == OpLoad && op.type == OdtIdent) {
+        auto param = std::find(callee.params.begin(), callee.params.end(),
+                               std::string(op.data.s));
+        if (param != callee.params.end()) {
+          emit(ops[load + 1 + (param - callee.params.begin())], false);
+          continue;
+        }
+      }
+      emit(op, hasOpTarget(op.op));
+    }
+    placed[callee.end - callee.begin] = splice.ops.size();
+    if (depth[callee.end - callee.begin] != -1) {
+      const Op &last = ops[callee.end - 1];
+      emit(Op{last.srcId, last.idx, OpLoad, OdtNil, {.s = nullptr}}, false);
+      emit(Op{last.srcId, last.idx, OpJump, OdtSize, {.sz = call + 1}}, false);
+    }
+    // jumps of the body land where their target was copied to
+    for (size_t k = 0; k < splice.ops.size(); k++) {
+      if (splice.local[k])
+        splice.ops[k].data.sz = placed[splice.ops[k].data.sz - callee.begin];
+    }
+    fn.splices.push_back(std::move(splice));
+    return true;
+  }
+
+public:
+  const char *name() const override { return "inline"; }
+
+  void start(const std::vector<Op> &ops) override {
+    callees.clear();
+    defined.clear();
+    ambiguous.clear();
+    for (size_t i = 0; i < ops.size(); i++) {
+      const Op &marker = ops[i];
+      size_t end = marker.data.sz;
+      if (marker.op != OpBodyMarker || end <= i || end + 2 >= ops.size())
+        continue;
+      const Op &make = ops[end];
+      const Op &name = ops[end + 1];
+      if (make.op != OpMakeFunc || name.op != OpLoad ||
+          name.type != OdtString || ops[end + 2].op != OpCreate ||
+          ops[end + 2].data.b)
+        continue;
+      if (!defined.insert(name.data.s).second) {
+        ambiguous.insert(name.data.s);
+        continue;
+      }
+      Callee callee{i + 1, end, {}};
+      if (make.data.s[0] != '0' || end - i - 1 > kMaxInlineOps ||
+          !namesBefore(ops, i, strlen(make.data.s) - 1, callee.params))
+        continue;
+      callees[name.data.s] = std::move(callee);
+    }
+    for (auto &name : ambiguous)
+      callees.erase(name);
+  }
+
+  void run(Function &fn, Stats &stats) override {
+    if (callees.empty())
+      return;
+    std::unordered_set<std::string> bound;
+    if (!boundIn(fn, bound))
+      return;
+    for (size_t i = fn.begin; i < fn.end; i = fn.next(i)) {
+      const Op &op = fn.ops[i];
+      if (op.op != OpLoad || op.type != OdtIdent)
+        continue;
+      auto it = callees.find(op.data.s);
+      if (it == callees.end())
+        continue;
+      const Callee &callee = it->second;
+      size_t call = i + 1 + callee.params.size();
+      if (call >= fn.end || fn.ops[call].op != OpCall ||
+          fn.ops[call].data.s[0] != '0' ||
+          strlen(fn.ops[call].data.s) != callee.params.size() + 1)
+        continue;
+      bool simple = true;
+      for (size_t k = i + 1; k <= call && simple; k++)
+        simple = fn.owns(k) && !fn.targets[k] &&
+                 (k == call || simpleArg(fn.ops[k]));
+      if (!simple || !inlineAt(fn, callee, i, call, bound))
+        continue;
+      stats.rewritten++;
+      i = call;
+    }
+  }
+};
+
+struct Span {
+  size_t begin;
+  size_t end;
+};
+
+// finds the functions of `ops` and what belongs to each, fails if body
+// markers do not nest
+bool layout(const std::vector<Op> &ops, std::vector<Span> &fns,
+            std::vector<size_t> &owners, std::vector<bool> &targets) {
+  fns.assign(1, {0, ops.size()});
+  owners.assign(ops.size(), 0);
+  targets.assign(ops.size(), false);
+
+  std::vector<Span> open{fns[0]};
+  for (size_t i = 0; i < ops.size(); i++) {
+    while (i >= open.back().end)
+      open.pop_back();
+    owners[i] = open.back().begin;
+
+    const Op &op = ops[i];
+    if (!hasOpTarget(op.op))
+      continue;
+    if (op.data.sz < ops.size())
+      targets[op.data.sz] = true;
+    if (op.op != OpBodyMarker)
+      continue;
+    if (op.data.sz <= i || op.data.sz > open.back().end)
+      return false;
+    fns.push_back({i + 1, op.data.sz});
+    open.push_back(fns.back());
+  }
+  return true;
+}
+
+} // namespace
+
+std::unique_ptr<Pass> jumpThreading() {
+  return std::unique_ptr<Pass>(new JumpThreading());
+}
+std::unique_ptr<Pass> deadCode() {
+  return std::unique_ptr<Pass>(new DeadCode());
+}
+std::unique_ptr<Pass> constantConditions() {
+  return std::unique_ptr<Pass>(new ConstantConditions());
+}
+std::unique_ptr<Pass> emptyBlocks() {
+  return std::unique_ptr<Pass>(new EmptyBlocks());
+}
+std::unique_ptr<Pass> unusedLoads() {
+  return std::unique_ptr<Pass>(new UnusedLoads());
+}
+std::unique_ptr<Pass> inlineCalls() {
+  return std::unique_ptr<Pass>(new Inliner());
+}
+
+void Manager::add(std::unique_ptr<Pass> pass) {
+  _passes.push_back(std::move(pass));
+  _stats.push_back({0, 0});
+}
+
+bool Manager::run(Bytecode &bc, const feedback::Sites *feedback) {
+  if (bc.hasPending())
+    return false;
+
+  std::vector<Span> fns;
+  std::vector<size_t> owners;
+  std::vector<bool> targets, dead;
+  std::vector<Splice> splices;
+  bool changed = false;
+  for (size_t round = 0; round < kMaxRounds; round++) {
+    bool again = false;
+    for (size_t p = 0; p < _passes.size(); p++) {
+      std::vector<Op> &ops = bc.getMut();
+      if (!layout(ops, fns, owners, targets))
+        return changed;
+      dead.assign(ops.size(), false);
+      splices.clear();
+
+      Stats &stats = _stats[p];
+      Stats before = stats;
+      _passes[p]->start(ops);
+      for (auto &span : fns) {
+        Function fn{ops,    span.begin, span.end, owners,
+                    targets, dead,       splices,  feedback};
+        _passes[p]->run(fn, stats);
+      }
+      std::sort(splices.begin(), splices.end(),
+                [](const Splice &a, const Splice &b) { return a.at < b.at; });
+      bc.rewrite(dead, std::move(splices));
+      if (stats.rewritten != before.rewritten ||
+          stats.removed != before.removed)
+        again = true;
+    }
+    changed |= again;
+    if (!again)
+      break;
+  }
+  return changed;
+}
+
+void Manager::print(std::ostream &out) const {
+  for (size_t p = 0; p < _passes.size(); p++) {
+    out << _passes[p]->name() << ": " << _stats[p].rewritten
+        << " ops rewritten, " << _stats[p].removed << " removed" << std::endl;
+  }
+}
+
+Manager &Manager::standard() {
+  static Manager *manager = nullptr;
+  if (!manager) {
+    manager = new Manager();
+    // folded conditions leave jumps to thread and code behind them to drop
+    manager->add(inlineCalls());
+    manager->add(constantConditions());
+    manager->add(jumpThreading());
+    manager->add(deadCode());
+    manager->add(unusedLoads());
+    manager->add(emptyBlocks());
+  }
+  return *manager;
+}
+
+} // namespace passes
+
+} // namespace june
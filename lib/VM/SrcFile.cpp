@@ -13,11 +13,14 @@ static size_t srcId() {
   return sid++;
 }
 
+static bool RetainData = true;
+
 namespace june {
 
 SrcFile::SrcFile(const std::string &dir, const std::string &path,
                  const bool isMain)
-    : _id(srcId()), _dir(dir), _path(path), _isMain(isMain) {}
+    : _id(srcId()), _dir(dir), _path(path), _hash(0), _dataFromFile(false),
+      _dataDropped(false), _isMain(isMain) {}
 
 using namespace err;
 
@@ -36,6 +39,7 @@ Errors SrcFile::loadFile() {
   char magic[4];
   if (fread(magic, 1, 4, fp) != 4) {
     perror("fread");
+    fclose(fp);
     return Errors::Err(err::Error(ErrKind::ErrFileIo, "Failed to read file"));
   }
 
@@ -50,13 +54,13 @@ Errors SrcFile::loadFile() {
   if (!isBytecode) {
     size_t prefixIdx = _data.size();
     std::string code;
-    std::vector<SrcColRange> cols;
+    LineTable lines;
     size_t begin, end;
     while ((read = getline(&line, &len, fp)) != -1) {
       begin = code.size();
       code += line;
       end = code.size();
-      cols.push_back({prefixIdx + begin, prefixIdx + end});
+      lines.add(prefixIdx + begin, prefixIdx + end);
     }
 
     fclose(fp);
@@ -69,51 +73,79 @@ Errors SrcFile::loadFile() {
     }
 
     addData(code);
-    addCols(cols);
+    setLines(lines);
+    // only text that is exactly the file's can be re-read from it later
+    _dataFromFile = prefixIdx == 0;
+    _hash = hash::fnv1a(code.data(), code.size());
   } else {
-    // reset file pointer
-    fseek(fp, 0, SEEK_SET);
-
-    // read all data into a buffer
-    fs::u8 *buffer = NULL;
-    size_t bufferSize = 0;
-
-    // read 4kb at a time
-    while ((read = fread(&buffer, 4 * 1024, 1, fp)) != 0) {
-      bufferSize += read;
-    }
-
     fclose(fp);
+    return loadBytecode(_path);
+  }
 
-    if (bufferSize == 0) {
-      return Errors::Err(
-          err::Error(ErrKind::ErrFileIo, "Encountered empty file"));
-    }
-
-    // create bytecode
-    auto decompressResult = fs::readBytecode(buffer);
-    if (decompressResult.isErr()) {
-      return Errors::Err(
-          err::Error(ErrKind::ErrFileIo, "Failed to decompress file"));
-    }
+  return Errors::Ok();
+}
 
-    auto bytecode = decompressResult.unwrap();
-    addBytecode(bytecode.bytecode);
-    addCols(bytecode.srcRanges);
+Errors SrcFile::loadBytecode(const std::string &path) {
+  // mapped once, ops are decoded in a single pass and their string operands
+  // stay in the mapping; function bodies are decoded on their first call
+  auto mapRes = fs::MappedFile::open(path);
+  if (mapRes.isErr())
+    return Errors::Err(mapRes.unwrapErr());
+  std::shared_ptr<const fs::MappedFile> file = mapRes.unwrap();
+
+  auto readRes = fs::readBytecode(file->data(), file->size());
+  if (readRes.isErr()) {
+    return Errors::Err(err::Error(ErrKind::ErrFileIo,
+                                  "Failed to load bytecode: " +
+                                      readRes.unwrapErr()));
   }
 
+  fs::ValidRead &read = readRes.unwrap();
+  for (auto &op : read.bytecode)
+    op.srcId = _id;
+  _bytecode.assign(std::move(read.bytecode), file, std::move(read.consts),
+                   std::move(read.pending));
+  _bytecode.buildHandlers();
+  _bytecode.verify();
+  setLines(read.lines);
   return Errors::Ok();
 }
 
-void SrcFile::addData(const std::string &data) { _data += data; }
+void SrcFile::addData(const std::string &data) {
+  _data += data;
+  _dataFromFile = false;
+}
+
+void SrcFile::dropData() {
+  if (RetainData || !_dataFromFile || _dataDropped)
+    return;
+  std::string().swap(_data);
+  _dataDropped = true;
+}
+
+void SrcFile::setRetainData(const bool &retain) { RetainData = retain; }
+
+void SrcFile::addCols(const std::vector<SrcColRange> &cols) {
+  _lines.clear();
+  for (auto &col : cols)
+    _lines.add(col.begin, col.end);
+}
 
-void SrcFile::addCols(const std::vector<SrcColRange> &cols) { _cols = cols; }
+void SrcFile::setLines(const LineTable &lines) { _lines = lines; }
 
 void SrcFile::addBytecode(const std::vector<june::Op> &bytecode) {
+  // the handlers of the ops replaced are built again
+  _bytecode.assign({}, nullptr);
   _bytecode.getMut().resize(bytecode.size());
   for (size_t i = 0; i < bytecode.size(); i++) {
-    _bytecode.getMut()[i] = bytecode[i];
+    Op op = bytecode[i];
+    // the operands stay with whoever owns `bytecode`
+    if (op.type != OdtSize && op.type != OdtBool && op.type != OdtNil)
+      op.data.s = _bytecode.intern(op.data.s);
+    _bytecode.getMut()[i] = op;
   }
+  _bytecode.buildHandlers();
+  _bytecode.verify();
 }
 
 void SrcFile::fail(const size_t &idx, const char *msg, ...) const {
@@ -124,20 +156,8 @@ void SrcFile::fail(const size_t &idx, const char *msg, ...) const {
 }
 
 void SrcFile::fail(const size_t &idx, const char *msg, va_list vargs) const {
-  size_t line, colBegin, colEnd, col;
-  bool found = false;
-  for (size_t i = 0; i < _cols.size(); i++) {
-    if (idx >= _cols[i].begin && idx < _cols[i].end) {
-      line = i;
-      colBegin = _cols[i].begin;
-      colEnd = _cols[i].end;
-      col = idx - colBegin;
-      found = true;
-      break;
-    }
-  }
-
-  if (!found) {
+  size_t line, colBegin, colEnd;
+  if (!_lines.find(idx, line, colBegin, colEnd)) {
     std::cerr << "Could not find line and column for index " << idx
               << std::endl;
     std::vfprintf(stderr, msg, vargs);
@@ -146,6 +166,7 @@ void SrcFile::fail(const size_t &idx, const char *msg, va_list vargs) const {
     return;
   }
 
+  size_t col = idx - colBegin;
   std::cerr << june::fs::relativePath(_path, _dir) << ":" << line + 1 << ":"
             << col + 1 << ": ";
   vfprintf(stderr, msg, vargs);
@@ -154,9 +175,24 @@ void SrcFile::fail(const size_t &idx, const char *msg, va_list vargs) const {
   if (_isBytecode)
     return; // source code is not available for bytecode, so we
             // can't print it
+  if (!_dataDropped && colEnd > _data.size())
+    return; // lines without their text, as in compiled programs
 
-  std::string errLine = _data.substr(colBegin, colEnd - colBegin);
-  if (errLine.back() == '\n')
+  std::string errLine;
+  if (!_dataDropped) {
+    errLine = _data.substr(colBegin, colEnd - colBegin);
+  } else {
+    auto readRes = fs::readFile(_path);
+    std::string data = readRes.isOk() ? readRes.unwrap() : std::string();
+    if (readRes.isErr() || hash::fnv1a(data.data(), data.size()) != _hash ||
+        colEnd > data.size()) {
+      std::cerr << "(source not shown, " << june::fs::relativePath(_path, _dir)
+                << " changed since it was loaded)" << std::endl;
+      return;
+    }
+    errLine = data.substr(colBegin, colEnd - colBegin);
+  }
+  if (!errLine.empty() && errLine.back() == '\n')
     errLine.pop_back();
   std::cerr << errLine << std::endl;
 
@@ -1,28 +1,73 @@
 #include "VM/Stack.hpp"
 
+#include <algorithm>
+
 namespace june {
 
-Stack::Stack() {}
+Stack::Stack() : _borrowed(0) {}
 Stack::~Stack() {
-  for (auto &val : _vec) {
-    varDref(val);
+  for (auto &slot : _vec) {
+    if (slot.owned)
+      varDref(slot.val);
   }
 }
 
 void Stack::push(VarBase *val, const bool iref) {
   if (iref)
     varIref(val);
-  _vec.push_back(val);
+  _vec.push_back({val, true});
+}
+
+void Stack::pushBorrowed(VarBase *val) {
+#if JuneMemDebug == true
+  ++stats::borrows;
+#endif
+  ++_borrowed;
+  _vec.push_back({val, false});
 }
 
 VarBase *Stack::pop(const bool dref) {
-  if (_vec.size() == 0)
+  bool owned = false;
+  VarBase *back = popRef(owned);
+  if (back == nullptr)
     return nullptr;
-  VarBase *back = nullptr;
-  back = _vec.back();
-  _vec.pop_back();
-  if (dref)
+  if (dref && owned)
     varDref(back);
+  else if (!dref && !owned)
+    varIref(back);
   return back;
 }
+
+VarBase *Stack::popRef(bool &owned) {
+  if (_vec.size() == 0)
+    return nullptr;
+  StackSlot back = _vec.back();
+  _vec.pop_back();
+  if (!back.owned)
+    --_borrowed;
+  owned = back.owned;
+  return back.val;
+}
+
+void Stack::own() {
+  if (_borrowed == 0)
+    return;
+  for (auto &slot : _vec) {
+    if (slot.owned)
+      continue;
+    varIref(slot.val);
+    slot.owned = true;
+  }
+  _borrowed = 0;
+}
+
+void Stack::trim(const size_t &size) {
+  while (_vec.size() > size)
+    pop();
+}
+
+void Stack::reserve(const size_t &size) {
+  if (_vec.capacity() < size)
+    _vec.reserve(std::max(size, _vec.capacity() * 2));
+}
 } // namespace june
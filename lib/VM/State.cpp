@@ -24,6 +24,16 @@ State::State(const std::string &selfBin, const std::string &selfBase,
       nil(new VarNil(0, 0)), dylib(new Dylib()), stack(new Stack()),
       srcArgs(nullptr), _selfBin(selfBin), _selfBase(selfBase),
       srcLoadCodeFn(nullptr), srcReadCodeFn(nullptr) {
+  immortalize(tru);
+  immortalize(fals);
+  immortalize(nil);
+
+  methodSym("toStr");
+  methodSym("toBool");
+  methodSym("apply");
+  _methodTables.resize(_VtLast);
+  _hasMethods.resize(_VtLast, false);
+
   initTypenames(*this);
 
   std::vector<VarBase *> srcArgsVec;
@@ -45,10 +55,20 @@ State::~State() {
   for (auto &src : allSrcs)
     varDref(src.second);
 
-  varDref(nil);
-  varDref(fals);
-  varDref(tru);
+  // modules importing each other keep one another alive
+  collectCycles();
+
   varDref(srcArgs);
+  gc::reclaim(0);
+
+  for (auto &val : _immortals)
+    delete val;
+
+#if JuneMemDebug == true
+  fprintf(stdout, "Reference counting: %zu irefs, %zu drefs, %zu avoided by "
+                  "borrowing\n",
+          stats::irefs.load(), stats::drefs.load(), stats::borrows.load());
+#endif
 
   for (auto &deInitFn : _modDeInitFns)
     deInitFn.second();
@@ -58,7 +78,11 @@ State::~State() {
 
 void State::pushSrc(SrcFile *src, const size_t &idx) {
   if (allSrcs.find(src->path()) == allSrcs.end()) {
-    allSrcs[src->path()] = new VarSrc(src, new Vars(), src->id(), idx);
+    VarSrc *varSrc = new VarSrc(src, new Vars(), src->id(), idx);
+    allSrcs[src->path()] = varSrc;
+    if (src->id() >= _srcsById.size())
+      _srcsById.resize(src->id() + 1, nullptr);
+    _srcsById[src->id()] = varSrc;
   }
   varIref(allSrcs[src->path()]);
   srcStack.push_back(allSrcs[src->path()]);
@@ -70,11 +94,52 @@ void State::pushSrc(const std::string &srcPath) {
   srcStack.push_back(allSrcs[srcPath]);
 }
 
+void State::pushSrc(VarSrc *src) {
+  varIref(src);
+  srcStack.push_back(src);
+}
+
 void State::popSrc() {
   varDref(srcStack.back());
   srcStack.pop_back();
 }
 
+gc::Stats State::collectCycles() {
+  gc::Stats stats = gc::collect();
+  DebugLog << "cycle collection: " << stats.reclaimed << " of " << stats.tracked
+           << " containers reclaimed" << std::endl;
+  return stats;
+}
+
+void State::immortalize(VarBase *val) {
+  if (val->isImmortal())
+    return;
+  val->setImmortal();
+  _immortals.push_back(val);
+}
+
+std::uint32_t State::methodSym(const std::string &name) {
+  auto it = _methodSyms.find(name);
+  if (it != _methodSyms.end())
+    return it->second;
+  std::uint32_t sym = _methodSyms.size();
+  _methodSyms[name] = sym;
+  return sym;
+}
+
+std::vector<VarBase *> &State::methodTable(const std::uint16_t &slot) {
+  if (slot >= _methodTables.size()) {
+    _methodTables.resize(slot + 1);
+    _hasMethods.resize(slot + 1, false);
+  }
+  if (!_hasMethods[slot]) {
+    // a type's table starts out as a copy of the `VarAll` one
+    _methodTables[slot] = _methodTables[VtAll];
+    _hasMethods[slot] = true;
+  }
+  return _methodTables[slot];
+}
+
 void State::addTypeFn(const std::uintptr_t &type, const std::string &name,
                       VarBase *fn, const bool iref) {
   if (_typeFns.find(type) == _typeFns.end()) {
@@ -84,32 +149,54 @@ void State::addTypeFn(const std::uintptr_t &type, const std::string &name,
   if (_typeFns[type]->exists(name)) {
     this->fail(this->srcStack.back()->srcId(), this->srcStack.back()->idx(),
                "function '%s' for '%s' already exists", name.c_str(),
-               this->getTypeName(type).c_str());
+               failType(type));
     return;
   }
 
   _typeFns[type]->add(name, fn, iref);
+
+  std::uint32_t sym = methodSym(name);
+  std::uint16_t slot = types::index(type);
+  std::vector<VarBase *> &table = methodTable(slot);
+  if (table.size() <= sym)
+    table.resize(sym + 1, nullptr);
+  table[sym] = fn;
+
+  if (slot != VtAll)
+    return;
+  // a new `VarAll` method reaches every type that doesn't define it itself
+  for (size_t i = 0; i < _methodTables.size(); i++) {
+    if (i == VtAll || !_hasMethods[i])
+      continue;
+    auto it = _typeFns.find(types::at(i));
+    if (it != _typeFns.end() && it->second->exists(name))
+      continue;
+    if (_methodTables[i].size() <= sym)
+      _methodTables[i].resize(sym + 1, nullptr);
+    _methodTables[i][sym] = fn;
+  }
 }
 
-VarBase *State::getTypeFn(VarBase *val, const std::string &name) {
-  auto it = _typeFns.find(val->typeFnId());
-  VarBase *res = nullptr;
-  if (it == _typeFns.end()) {
-    if (val->isAttrBased()) {
-      it = _typeFns.find(val->type());
-      if (it == _typeFns.end())
-        return _typeFns[type_id<VarAll>()]->get(name);
-      res = it->second->get(name);
-      if (res)
-        return res;
-      return _typeFns[type_id<VarAll>()]->get(name);
-    }
-    return _typeFns[type_id<VarAll>()]->get(name);
+VarBase *State::getTypeFn(VarBase *val, const std::uint32_t &sym) {
+  // most types use their own type for method lookup, which needs no
+  // translation to a slot
+  std::uintptr_t fnId = val->typeFnId();
+  std::uint16_t slot = fnId == val->type() ? val->typeIdx() : types::index(fnId);
+  if (slot >= _hasMethods.size() || !_hasMethods[slot]) {
+    slot = VtAll;
+    if (val->isAttrBased() && val->typeIdx() < _hasMethods.size() &&
+        _hasMethods[val->typeIdx()])
+      slot = val->typeIdx();
   }
-  res = it->second->get(name);
-  if (res)
-    return res;
-  return _typeFns[type_id<VarAll>()]->get(name);
+  const std::vector<VarBase *> &table = _methodTables[slot];
+  return sym < table.size() ? table[sym] : nullptr;
+}
+
+VarBase *State::getTypeFn(VarBase *val, const std::string &name) {
+  auto it = _methodSyms.find(name);
+  if (it == _methodSyms.end())
+    return nullptr;
+  return getTypeFn(val, it->second);
 }
 
 void State::setTypeName(const std::uintptr_t &type, const std::string &name) {
@@ -131,6 +218,8 @@ void State::globalAdd(const std::string &name, VarBase *val, const bool iref) {
     return;
   if (iref)
     varIref(val);
+  // a global is never replaced, and is only found where no binding of the
+  // module is, so cached lookups still hold
   _globals[name] = val;
 }
 
@@ -452,23 +541,10 @@ err::Errors State::juneModuleLoad(std::string &modStr, const size_t &srcId,
   }
 }
 
-void State::fail(const size_t &srcId, const size_t &idx, const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
-
-  if (fails.empty() || this->exitCalled) {
-    for (auto &src : allSrcs) {
-      if (src.second->src()->id() == srcId) {
-        src.second->src()->fail(idx, fmt, args);
-        break;
-      }
-    }
-  } else {
-    char *err = nullptr;
-    vasprintf(&err, fmt, args);
-    fails.push(new VarString(err, srcId, idx), false);
-  }
-  va_end(args);
+void State::report(const size_t &srcId, const size_t &idx,
+                   const std::string &msg) {
+  if (VarSrc *src = srcById(srcId))
+    src->src()->fail(idx, "%s", msg.c_str());
 }
 
 void State::fail(const size_t &srcId, const size_t &idx, VarBase *val,
@@ -476,19 +552,16 @@ void State::fail(const size_t &srcId, const size_t &idx, VarBase *val,
   if (iref)
     varIref(val);
 
-  if (fails.empty() || this->exitCalled) {
-    for (auto &src : allSrcs) {
-      if (src.second->src()->id() == srcId) {
-        std::string data;
-        val->toStr(*this, data, srcId, idx);
-        varDref(val);
-        if (fmt)
-          src.second->src()->fail(idx, "%s (%s)", fmt, data.c_str());
-        else
-          src.second->src()->fail(idx, data.c_str());
-        break;
-      }
+  if (!fails.caught() || this->exitCalled) {
+    if (VarSrc *src = srcById(srcId)) {
+      std::string data;
+      val->toStr(*this, data, srcId, idx);
+      if (fmt)
+        src->src()->fail(idx, "%s (%s)", fmt, data.c_str());
+      else
+        src->src()->fail(idx, "%s", data.c_str());
     }
+    varDref(val);
   } else {
     fails.push(val, false);
   }
@@ -0,0 +1,45 @@
+#include "VM/StringArena.hpp"
+#include "Common.hpp"
+
+#include <cstring>
+
+namespace june {
+
+size_t StringArena::Hash::operator()(const char *str) const {
+  return hash::fnv1a(str, strlen(str));
+}
+
+bool StringArena::Equal::operator()(const char *a, const char *b) const {
+  return a == b || strcmp(a, b) == 0;
+}
+
+StringArena::StringArena() : _head(nullptr), _left(0), _bytes(0) {}
+
+const char *StringArena::intern(const char *str) {
+  auto it = _strings.find(str);
+  if (it != _strings.end())
+    return *it;
+
+  size_t size = strlen(str) + 1;
+  char *at;
+  if (size > kBlockSize / 4) {
+    // the block being filled keeps its free space
+    _blocks.emplace_back(new char[size]);
+    at = _blocks.back().get();
+  } else {
+    if (size > _left) {
+      _blocks.emplace_back(new char[kBlockSize]);
+      _head = _blocks.back().get();
+      _left = kBlockSize;
+    }
+    at = _head;
+    _head += size;
+    _left -= size;
+  }
+  memcpy(at, str, size);
+  _bytes += size;
+  _strings.insert(at);
+  return at;
+}
+
+} // namespace june
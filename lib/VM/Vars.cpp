@@ -35,12 +35,24 @@ void VarsFrame::rem(const std::string &name, const bool dref) {
   _vars.erase(name);
 }
 
+void VarsFrame::clear() {
+  // detach first, releasing a value may run code that looks at this frame
+  std::unordered_map<std::string, VarBase *> vars;
+  vars.swap(_vars);
+  for (auto &var : vars)
+    varDref(var.second);
+}
+
 void *VarsFrame::operator new(size_t sz) { return mem::alloc(sz); }
 void VarsFrame::operator delete(void *ptr, size_t sz) { mem::free(ptr, sz); }
 
 // VarsStack
 
-VarsStack::VarsStack() : _top(0) { _stack.push_back(new VarsFrame()); }
+static size_t nextSerial = 0;
+
+VarsStack::VarsStack() : _top(0), _serial(++nextSerial) {
+  _stack.push_back(new VarsFrame());
+}
 VarsStack::~VarsStack() {
   for (auto layer = _stack.rbegin(); layer != _stack.rend(); layer++) {
     delete *layer;
@@ -116,9 +128,23 @@ void VarsStack::rem(const std::string &name, const bool dref) {
   }
 }
 
+void VarsStack::each(const std::function<void(VarBase *)> &fn) const {
+  for (auto &layer : _stack) {
+    for (auto &var : layer->vars())
+      fn(var.second);
+  }
+}
+
+void VarsStack::clear() {
+  for (auto &layer : _stack)
+    layer->clear();
+}
+
 // Vars
 
-Vars::Vars() : _fnStack(-1) { _fnVars[0] = new VarsStack(); }
+Vars::Vars() : _fnStack(-1), _frame(0), _epoch(0) {
+  _fnVars[0] = new VarsStack();
+}
 Vars::~Vars() {
   assert(_fnStack == 0 || _fnStack == -1);
   delete _fnVars[0];
@@ -145,6 +171,16 @@ VarBase *Vars::get(const std::string &name) {
   return res;
 }
 
+VarBase *Vars::get(const std::string &name, bool &fromFn) {
+  assert(_fnStack != -1);
+  VarBase *res = _fnVars[_fnStack]->get(name);
+  fromFn = res != nullptr && _fnStack != 0;
+  if (res == nullptr && _fnStack != 0) {
+    res = _fnVars[0]->get(name);
+  }
+  return res;
+}
+
 void Vars::blkAdd(const size_t &count) {
   _fnVars[_fnStack]->incTop(count);
   for (auto &s : _stash) {
@@ -157,9 +193,9 @@ void Vars::blkRem(const size_t &count) { _fnVars[_fnStack]->decTop(count); }
 
 void Vars::pushFn() {
   ++_fnStack;
-  if (_fnStack == 0)
-    return;
-  _fnVars[_fnStack] = new VarsStack();
+  if (_fnStack != 0)
+    _fnVars[_fnStack] = new VarsStack();
+  _frame = _fnVars[_fnStack]->serial();
 }
 
 void Vars::popFn() {
@@ -168,6 +204,7 @@ void Vars::popFn() {
   delete _fnVars[_fnStack];
   _fnVars.erase(_fnStack);
   --_fnStack;
+  _frame = _fnVars[_fnStack]->serial();
 }
 
 void Vars::stash(const std::string &name, VarBase *val, const bool &iref) {
@@ -183,15 +220,35 @@ void Vars::unstash() {
 }
 
 void Vars::add(const std::string &name, VarBase *val, const bool &iref) {
+  // bindings of inner scopes are made by the ops of the function they belong
+  // to, the module's own are seen by all of its functions
+  if (_fnStack == 0 && _fnVars[0]->top() == 0)
+    bumpEpoch();
   _fnVars[_fnStack]->add(name, val, iref);
 }
 
 void Vars::addm(const std::string &name, VarBase *val, const bool &iref) {
+  bumpEpoch();
   _fnVars[0]->add(name, val, iref);
 }
 
 void Vars::rem(const std::string &name, const bool &dref) {
+  bumpEpoch();
   _fnVars[_fnStack]->rem(name, dref);
 }
 
+void Vars::each(const std::function<void(VarBase *)> &fn) const {
+  for (auto &s : _stash)
+    fn(s.second);
+  for (auto &stack : _fnVars)
+    stack.second->each(fn);
+}
+
+void Vars::clear() {
+  bumpEpoch();
+  unstash();
+  for (auto &stack : _fnVars)
+    stack.second->clear();
+}
+
 } // namespace june
@@ -2,11 +2,150 @@
 #include "VM/Memory.hpp"
 #include "VM/State.hpp"
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 namespace june {
 
+#if JuneMemDebug == true
+namespace stats {
+std::atomic<size_t> irefs(0);
+std::atomic<size_t> drefs(0);
+std::atomic<size_t> borrows(0);
+} // namespace stats
+#endif
+
+namespace origins {
+struct Origin {
+  size_t srcId;
+  size_t idx;
+};
+
+struct OriginHash {
+  size_t operator()(const std::pair<size_t, size_t> &o) const {
+    return std::hash<size_t>()(o.first) ^ (std::hash<size_t>()(o.second) << 1);
+  }
+};
+
+// the table is append-only and never moves: chunk `c` holds the
+// `kFirstChunk << c` origins following those of the chunks before it, enough
+// chunks to index every uint32. Entries are written under the lock before
+// the count is raised past them, `get` reads them without it
+static const size_t kFirstChunk = 1024;
+static const size_t kChunks = 23;
+
+static std::mutex OriginLock;
+static std::unique_ptr<Origin[]> OriginOwned[kChunks];
+static std::atomic<Origin *> OriginChunks[kChunks];
+static std::atomic<std::uint32_t> OriginCount(1);
+static std::unordered_map<std::pair<size_t, size_t>, std::uint32_t, OriginHash>
+    OriginIndex = {{{0, 0}, 0}};
+
+// finds the chunk of `origin` and its position in it
+static inline void locate(const std::uint32_t &origin, size_t &chunk,
+                          size_t &at) {
+  size_t pos = (size_t)origin + kFirstChunk;
+  chunk = 0;
+  while (pos >= kFirstChunk << (chunk + 1))
+    chunk++;
+  at = pos - (kFirstChunk << chunk);
+}
+
+std::uint32_t intern(const size_t &srcId, const size_t &idx) {
+  if (srcId == 0 && idx == 0)
+    return 0;
+
+  // most values are created in runs from the same instruction
+  thread_local Origin last = {0, 0};
+  thread_local std::uint32_t lastOrigin = 0;
+  if (lastOrigin != 0 && last.srcId == srcId && last.idx == idx)
+    return lastOrigin;
+
+  std::lock_guard<std::mutex> lock(OriginLock);
+  auto it = OriginIndex.find({srcId, idx});
+  if (it == OriginIndex.end()) {
+    std::uint32_t origin = OriginCount.load(std::memory_order_relaxed);
+    assert(origin < UINT32_MAX);
+    size_t chunk, at;
+    locate(origin, chunk, at);
+    if (!OriginOwned[chunk]) {
+      OriginOwned[chunk].reset(new Origin[kFirstChunk << chunk]);
+      OriginChunks[chunk].store(OriginOwned[chunk].get(),
+                                std::memory_order_release);
+    }
+    OriginOwned[chunk][at] = {srcId, idx};
+    OriginCount.store(origin + 1, std::memory_order_release);
+    it = OriginIndex.insert({{srcId, idx}, origin}).first;
+  }
+  last = {srcId, idx};
+  lastOrigin = it->second;
+  return lastOrigin;
+}
+
+void get(const std::uint32_t &origin, size_t &srcId, size_t &idx) {
+  if (origin == 0 || origin >= OriginCount.load(std::memory_order_acquire)) {
+    srcId = 0;
+    idx = 0;
+    return;
+  }
+  size_t chunk, at;
+  locate(origin, chunk, at);
+  const Origin &found =
+      OriginChunks[chunk].load(std::memory_order_acquire)[at];
+  srcId = found.srcId;
+  idx = found.idx;
+}
+} // namespace origins
+
+namespace types {
+static std::mutex TypeLock;
+static std::uintptr_t TypeTable[kMaxTypes];
+static std::unordered_map<std::uintptr_t, std::uint16_t> TypeIndex;
+static std::uint16_t TypeCount = _VtLast;
+
+static bool initBuiltins() {
+  TypeTable[VtAll] = type_id<VarAll>();
+  TypeTable[VtNil] = type_id<VarNil>();
+  TypeTable[VtTypeId] = type_id<VarTypeId>();
+  TypeTable[VtBool] = type_id<VarBool>();
+  TypeTable[VtInt] = type_id<VarInt>();
+  TypeTable[VtFloat] = type_id<VarFloat>();
+  TypeTable[VtString] = type_id<VarString>();
+  TypeTable[VtVec] = type_id<VarVec>();
+  TypeTable[VtFunc] = type_id<VarFunc>();
+  TypeTable[VtSrc] = type_id<VarSrc>();
+  TypeTable[VtFailure] = type_id<VarFailure>();
+  return true;
+}
+
+std::uint16_t index(const std::uintptr_t &type) {
+  static const bool init = initBuiltins();
+  (void)init;
+
+  for (std::uint16_t i = VtAll; i < _VtLast; i++) {
+    if (TypeTable[i] == type)
+      return i;
+  }
+
+  std::lock_guard<std::mutex> lock(TypeLock);
+  auto it = TypeIndex.find(type);
+  if (it != TypeIndex.end())
+    return it->second;
+  assert(TypeCount < kMaxTypes);
+  TypeTable[TypeCount] = type;
+  TypeIndex[type] = TypeCount;
+  return TypeCount++;
+}
+
+std::uintptr_t at(const std::uint16_t &index) { return TypeTable[index]; }
+} // namespace types
+
 VarBase::VarBase(const std::uintptr_t &type, const size_t &srcId,
                  const size_t &idx, const bool &callable, const bool &attrBased)
-    : _type(type), _srcId(srcId), _idx(idx), _refCount(1), _info('\0') {
+    : _refCount(1), _origin(origins::intern(srcId, idx)),
+      _typeIdx(types::index(type)), _info('\0') {
+  _tag = _typeIdx < _VtLast ? (VarTag)_typeIdx : VtOther;
   if (callable)
     _info |= ViCallable;
   if (attrBased)
@@ -14,12 +153,16 @@ VarBase::VarBase(const std::uintptr_t &type, const size_t &srcId,
 }
 VarBase::~VarBase() {}
 
-std::uintptr_t VarBase::typeFnId() const { return _type; }
+std::uintptr_t VarBase::typeFnId() const { return type(); }
 
 bool VarBase::toStr(State &vm, std::string &data, const size_t &srcId,
                     const size_t &idx) {
-  if (this->isa<VarString>()) {
-    data = this->as<VarString>()->get();
+  if (_tag == VtString) {
+    data = AsString(this)->view();
+    return true;
+  }
+  if (_tag == VtFailure) {
+    data = AsFailure(this)->msg();
     return true;
   }
   
@@ -27,12 +170,12 @@ bool VarBase::toStr(State &vm, std::string &data, const size_t &srcId,
   if (this->isAttrBased())
     strFn = this->attrGet("toStr");
   else
-    strFn = vm.getTypeFn(this, "toStr");
+    strFn = vm.getTypeFn(this, MsToStr);
 
   if (!strFn) {
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `str`: no `toStr` method/attribute",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return false;
   }
 
@@ -46,7 +189,7 @@ bool VarBase::toStr(State &vm, std::string &data, const size_t &srcId,
   if (!strFn->call(vm, {this}, srcId, idx)) {
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `str`: call to `toStr` failed",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return false;
   }
 
@@ -55,21 +198,21 @@ bool VarBase::toStr(State &vm, std::string &data, const size_t &srcId,
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `str`: `toStr` returned non-string "
             "(found %s)",
-            vm.getTypeName(this->type()).c_str(),
-            vm.getTypeName(str->type()).c_str());
+            failType(this),
+            failType(str));
     varDref(str);
     return false;
   }
 
-  data = str->as<VarString>()->get();
+  data = str->as<VarString>()->view();
   varDref(str);
   return true;
 }
 
 bool VarBase::toBool(State &vm, bool &data, const size_t &srcId,
                      const size_t &idx) {
-  if (this->isa<VarBool>()) {
-    data = this->as<VarBool>()->get();
+  if (_tag == VtBool) {
+    data = AsBool(this)->get();
     return true;
   }
 
@@ -77,12 +220,12 @@ bool VarBase::toBool(State &vm, bool &data, const size_t &srcId,
   if (this->isAttrBased())
     boolFn = this->attrGet("toBool");
   else
-    boolFn = vm.getTypeFn(this, "toBool");
+    boolFn = vm.getTypeFn(this, MsToBool);
 
   if (!boolFn) {
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `bool`: no `toBool` method/attribute",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return false;
   }
 
@@ -96,7 +239,7 @@ bool VarBase::toBool(State &vm, bool &data, const size_t &srcId,
   if (!boolFn->call(vm, {this}, srcId, idx)) {
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `bool`: call to `toBool` failed",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return false;
   }
 
@@ -105,8 +248,8 @@ bool VarBase::toBool(State &vm, bool &data, const size_t &srcId,
     vm.fail(this->srcId(), this->idx(),
             "Unable to convert %s to type `bool`: `toBool` returned non-bool "
             "(found %s)",
-            vm.getTypeName(this->type()).c_str(),
-            vm.getTypeName(boolVal->type()).c_str());
+            failType(this),
+            failType(boolVal));
     varDref(boolVal);
     return false;
   }
@@ -118,17 +261,17 @@ bool VarBase::toBool(State &vm, bool &data, const size_t &srcId,
 
 VarBase *VarBase::call(State &vm, const std::vector<VarBase *> &args,
                        const size_t &srcId, const size_t &idx) {
-  VarBase *applyFn = vm.getTypeFn(this, "apply");
+  VarBase *applyFn = vm.getTypeFn(this, MsApply);
   if (!applyFn) {
     vm.fail(this->srcId(), this->idx(), "%s is not a callable object",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return nullptr;
   }
 
   if (!applyFn->call(vm, args, srcId, idx)) {
     vm.fail(this->srcId(), this->idx(),
             "Unable to call %s: call to `apply` failed",
-            vm.getTypeName(this->type()).c_str());
+            failType(this));
     return nullptr;
   }
 
@@ -139,6 +282,9 @@ bool VarBase::attrExists(const std::string &attr) const { return false; }
 VarBase *VarBase::attrGet(const std::string &attr) { return nullptr; }
 void VarBase::attrSet(const std::string &attr, VarBase *val, const bool iref) {}
 
+void VarBase::traverse(GcVisitor &visitor) {}
+void VarBase::clearRefs() {}
+
 void *VarBase::operator new(size_t size) {
   return mem::alloc(size);
 }
@@ -150,6 +296,7 @@ void VarBase::operator delete(void *ptr, size_t sz) {
 void initTypenames(State &vm) {
   vm.registerType<VarAll>("All");
   vm.registerType<VarBool>("bool");
+  vm.registerType<VarFailure>("Failure");
   vm.registerType<VarFloat>("float");
   vm.registerType<VarFunc>("Func");
   vm.registerType<VarInt>("int");
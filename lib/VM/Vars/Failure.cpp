@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstring>
+
+#include "VM/State.hpp"
+#include "VM/Vars/Base.hpp"
+
+namespace june {
+
+FailType failType(const VarBase *val) { return {val->type()}; }
+
+template <typename T>
+static void appendf(std::string &out, const std::string &spec, const T &val) {
+  int len = snprintf(nullptr, 0, spec.c_str(), val);
+  if (len <= 0)
+    return;
+  size_t pos = out.size();
+  out.resize(pos + len + 1);
+  snprintf(&out[pos], len + 1, spec.c_str(), val);
+  out.resize(pos + len);
+}
+
+static std::string argAsString(State &vm, const FailArg &arg) {
+  switch (arg.kind) {
+  case FailArg::FaInt:
+    return std::to_string(arg.i);
+  case FailArg::FaUInt:
+    return std::to_string(arg.u);
+  case FailArg::FaFloat:
+    return std::to_string(arg.f);
+  case FailArg::FaStr:
+    return arg.s;
+  case FailArg::FaType:
+    return vm.getTypeName(arg.type);
+  }
+  return "";
+}
+
+std::string failRender(State &vm, const char *fmt,
+                       const std::vector<FailArg> &args) {
+  std::string out;
+  size_t next = 0;
+  for (const char *p = fmt; *p; ++p) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      ++p;
+      continue;
+    }
+
+    // flags, width and precision are kept, length modifiers are replaced
+    // by the ones matching how the argument was recorded
+    std::string spec = "%";
+    ++p;
+    while (*p && strchr("-+ #0123456789.", *p))
+      spec += *p++;
+    while (*p && strchr("hlLqjzt", *p))
+      ++p;
+    if (!*p)
+      break;
+    char conv = *p;
+    if (next >= args.size())
+      continue;
+    const FailArg &arg = args[next++];
+
+    if (strchr("dic", conv)) {
+      long long v = arg.kind == FailArg::FaInt     ? arg.i
+                    : arg.kind == FailArg::FaUInt  ? (long long)arg.u
+                    : arg.kind == FailArg::FaFloat ? (long long)arg.f
+                                                   : 0;
+      if (arg.kind == FailArg::FaStr || arg.kind == FailArg::FaType)
+        out += argAsString(vm, arg);
+      else if (conv == 'c')
+        appendf(out, spec + 'c', (int)v);
+      else
+        appendf(out, spec + "lld", v);
+    } else if (strchr("ouxX", conv)) {
+      unsigned long long v = arg.kind == FailArg::FaUInt ? arg.u
+                             : arg.kind == FailArg::FaInt
+                                 ? (unsigned long long)arg.i
+                             : arg.kind == FailArg::FaFloat
+                                 ? (unsigned long long)arg.f
+                                 : 0;
+      if (arg.kind == FailArg::FaStr || arg.kind == FailArg::FaType)
+        out += argAsString(vm, arg);
+      else
+        appendf(out, spec + "ll" + conv, v);
+    } else if (strchr("eEfFgGaA", conv)) {
+      double v = arg.kind == FailArg::FaFloat  ? arg.f
+                 : arg.kind == FailArg::FaInt  ? (double)arg.i
+                 : arg.kind == FailArg::FaUInt ? (double)arg.u
+                                               : 0;
+      if (arg.kind == FailArg::FaStr || arg.kind == FailArg::FaType)
+        out += argAsString(vm, arg);
+      else
+        appendf(out, spec + conv, v);
+    } else if (conv == 'p' && arg.kind == FailArg::FaUInt) {
+      appendf(out, spec + 'p', (void *)(std::uintptr_t)arg.u);
+    } else {
+      appendf(out, spec + 's', argAsString(vm, arg).c_str());
+    }
+  }
+  return out;
+}
+
+VarFailure::VarFailure(State &vm, const char *fmt, std::vector<FailArg> &&args,
+                       const size_t &srcId, const size_t &idx)
+    : VarBase(type_id<VarFailure>(), srcId, idx, false, true), _vm(&vm),
+      _fmt(fmt), _args(std::move(args)), _rendered(false) {}
+
+VarBase *VarFailure::copy(const size_t &srcId, const size_t &idx) {
+  std::vector<FailArg> args = _args;
+  VarFailure *res = new VarFailure(*_vm, _fmt, std::move(args), srcId, idx);
+  res->_msg = _msg;
+  res->_rendered = _rendered;
+  return res;
+}
+
+void VarFailure::set(VarBase *from) {
+  if (!from->isa<VarFailure>())
+    return;
+  VarFailure *other = AsFailure(from);
+  _fmt = other->_fmt;
+  _args = other->_args;
+  _msg = other->_msg;
+  _rendered = other->_rendered;
+}
+
+bool VarFailure::attrExists(const std::string &attr) const {
+  return attr == "msg";
+}
+
+void VarFailure::attrSet(const std::string &attr, VarBase *val,
+                         const bool iref) {
+  // failures are read-only
+}
+
+VarBase *VarFailure::attrGet(const std::string &attr) {
+  if (attr == "msg")
+    return make_all<VarString>(msg(), srcId(), idx());
+  return nullptr;
+}
+
+const std::string &VarFailure::msg() {
+  if (!_rendered) {
+    _msg = failRender(*_vm, _fmt, _args);
+    _args.clear();
+    _rendered = true;
+  }
+  return _msg;
+}
+
+} // namespace june
@@ -1,60 +1,68 @@
+#include "VM/Memory.hpp"
 #include "VM/State.hpp"
 #include "VM/Vars/Base.hpp"
-#include <unordered_set>
 
 namespace june {
 
+void *FnProto::operator new(size_t sz) { return mem::alloc(sz); }
+void FnProto::operator delete(void *ptr, size_t sz) { mem::free(ptr, sz); }
+
+FnProto::FnProto(const std::string &srcName, const std::string &varArg,
+                 const std::vector<std::string> &args, const FnBody &body,
+                 const bool isNative, VarSrc *src)
+    : refs(1), srcName(srcName), varArg(varArg), args(args), body(body),
+      isNative(isNative), src(src) {}
+
 VarFunc::VarFunc(const std::string &srcName, const std::string &varArg,
              const std::vector<std::string> &args, const FnBody &body,
              const bool isNative, const size_t &srcId, const size_t &idx)
-    : VarBase(type_id<VarFunc>(), srcId, idx, true, false), _srcName(srcName),
-      _args(args), _body(body), _isNative(isNative), _varArg(varArg) {}
+    : VarBase(type_id<VarFunc>(), srcId, idx, true, false),
+      _proto(new FnProto(srcName, varArg, args, body, isNative)) {}
+
+VarFunc::VarFunc(FnProto *proto, const size_t &srcId, const size_t &idx)
+    : VarBase(type_id<VarFunc>(), srcId, idx, true, false), _proto(proto) {}
+
+VarFunc::~VarFunc() { release(_proto); }
+
+void VarFunc::release(FnProto *proto) {
+  if (proto->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete proto;
+}
 
 VarBase *VarFunc::copy(const size_t &srcId, const size_t &idx) {
-  // should we be able to even copy this?
-  // return nullptr;
-  return new VarFunc(_srcName, _varArg, _args, _body, _isNative, srcId,
-                   idx);
+  _proto->refs.fetch_add(1, std::memory_order_relaxed);
+  return new VarFunc(_proto, srcId, idx);
 }
 
 void VarFunc::set(VarBase *from) {
+  FnProto *proto;
   if (from->isa<VarFunc>()) {
-    _srcName = from->as<VarFunc>()->srcName();
-    _args = from->as<VarFunc>()->args();
-    _body = from->as<VarFunc>()->body();
-    _isNative = from->as<VarFunc>()->isNative();
+    proto = AsFunc(from)->_proto;
+    proto->refs.fetch_add(1, std::memory_order_relaxed);
   } else {
-    _srcName = "";
-    _args.clear();
-    _body.native = nullptr;
-    _isNative = false;
+    proto = new FnProto("", "", {}, {.native = nullptr}, false);
   }
+  release(_proto);
+  _proto = proto;
 }
 
-bool VarFunc::isNative() const { return _isNative; }
-bool VarFunc::isJune() const { return !_isNative; }
-
-std::string &VarFunc::srcName() { return _srcName; }
-std::string &VarFunc::varArg() { return _varArg; }
-std::vector<std::string> &VarFunc::args() { return _args; }
-FnBody &VarFunc::body() { return _body; }
-
 VarBase *VarFunc::call(State &vm, const std::vector<VarBase *> &args,
                      const size_t &srcId, const size_t &idx) {
-  if (args.size() - 1 < _args.size()) {
+  FnProto *proto = _proto;
+  if (args.size() - 1 < proto->arity()) {
     vm.fail(this->srcId(), this->idx(),
             "too few arguments to function: found %zu, expected %zu",
-            args.size() - 1, _args.size());
+            args.size() - 1, proto->arity());
     return nullptr;
-  } else if (args.size() - 1 > _args.size() && _varArg.empty()) {
+  } else if (args.size() - 1 > proto->arity() && proto->varArg.empty()) {
     vm.fail(this->srcId(), this->idx(),
             "too many arguments to function: found %zu, expected %zu",
-            args.size() - 1, _args.size());
+            args.size() - 1, proto->arity());
     return nullptr;
   }
 
-  if (_isNative) {
-    VarBase *res = _body.native(vm, FnData{srcId, idx, args});
+  if (proto->isNative) {
+    VarBase *res = proto->body.native(vm, FnData{srcId, idx, args});
     if (res == nullptr)
       return nullptr;
     if (res->refCount() == 0)
@@ -63,22 +71,33 @@ VarBase *VarFunc::call(State &vm, const std::vector<VarBase *> &args,
     return vm.nil;
   }
 
-  vm.pushSrc(_srcName);
-  Vars *vars = vm.currentSource()->vars();
+  if (!proto->src) {
+    auto it = vm.allSrcs.find(proto->srcName);
+    assert(it != vm.allSrcs.end());
+    proto->src = it->second;
+  }
+  // bodies loaded from a .junec are decoded on their first call
+  if (!proto->src->src()->bytecode().decodeBody(proto->body.june.begin)) {
+    vm.fail(this->srcId(), this->idx(),
+            "damaged or malformed function body in '%s'",
+            proto->srcName.c_str());
+    return nullptr;
+  }
+  vm.pushSrc(proto->src);
+  Vars *vars = proto->src->vars();
   if (args[0] != nullptr) {
     vars->stash("self", args[0]);
   }
 
-  std::unordered_set<std::string> foundArgs;
   size_t i = 1;
-  for (auto &a : _args) {
+  for (auto &a : proto->args) {
     if (i == args.size())
       break;
     vars->stash(a, args[i++]);
-    foundArgs.insert(a);
   }
 
-  if (vm::exec(vm, nullptr, _body.june.begin, _body.june.end).isErr()) {
+  if (vm::exec(vm, nullptr, proto->body.june.begin, proto->body.june.end)
+          .isErr()) {
     vars->unstash();
     vm.popSrc();
     return nullptr;
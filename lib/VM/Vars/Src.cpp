@@ -1,3 +1,4 @@
+#include "VM/Gc.hpp"
 #include "VM/SrcFile.hpp"
 #include "VM/State.hpp"
 #include "VM/Vars/Base.hpp"
@@ -7,9 +8,12 @@ namespace june {
 VarSrc::VarSrc(SrcFile *src, Vars *vars, const size_t &srcId, const size_t &idx,
                const bool owner)
     : VarBase(type_id<VarSrc>(), srcId, idx, false, true), _src(src),
-      _vars(vars), _owner(owner) {}
+      _vars(vars), _owner(owner) {
+  gc::track(this);
+}
 
 VarSrc::~VarSrc() {
+  gc::untrack(this);
   if (_owner) {
     if (_vars)
       delete _vars;
@@ -40,11 +44,29 @@ bool VarSrc::attrExists(const std::string &name) const {
 }
 
 void VarSrc::attrSet(const std::string &name, VarBase *val, const bool iref) {
+  // the module may be inside one of its functions
+  _vars->bumpEpoch();
   _vars->add(name, val, iref);
 }
 
 VarBase *VarSrc::attrGet(const std::string &name) { return _vars->get(name); }
 
+void VarSrc::traverse(GcVisitor &visitor) {
+  if (!_vars || !visitor.enter(_vars))
+    return;
+  _vars->each([&](VarBase *val) { visitor.visit(val); });
+  if (_src)
+    _src->bytecode().eachCached([&](VarBase *val) { visitor.visit(val); });
+}
+
+void VarSrc::clearRefs() {
+  // copies only borrow the owner's scopes
+  if (_owner && _vars)
+    _vars->clear();
+  if (_owner && _src)
+    _src->bytecode().dropCached();
+}
+
 void VarSrc::addNativeFn(const std::string &name, NativeFnPtr fn,
                          const size_t &argsCount, const bool &isVarArgs) {
   _vars->add(name,
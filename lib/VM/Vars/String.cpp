@@ -1,25 +1,61 @@
+#include "VM/Memory.hpp"
 #include "VM/Vars/Base.hpp"
 
 namespace june {
 
+void *VarString::Buf::operator new(size_t sz) { return mem::alloc(sz); }
+void VarString::Buf::operator delete(void *ptr, size_t sz) {
+  mem::free(ptr, sz);
+}
+
 VarString::VarString(const std::string &val, const size_t &srcId,
                      const size_t &idx)
-    : VarBase(type_id<VarString>(), srcId, idx, false, false), _data(val) {}
+    : VarBase(type_id<VarString>(), srcId, idx, false, false),
+      _buf(new Buf{{1}, val}) {}
+
+VarString::VarString(Buf *buf, const size_t &srcId, const size_t &idx)
+    : VarBase(type_id<VarString>(), srcId, idx, false, false), _buf(buf) {
+  _buf->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+VarString::~VarString() {
+  if (_buf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete _buf;
+}
+
+void VarString::unshare() {
+  if (!isShared())
+    return;
+  Buf *buf = new Buf{{1}, _buf->data};
+  if (_buf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete _buf;
+  _buf = buf;
+}
 
 VarBase *VarString::copy(const size_t &srcId, const size_t &idx) {
-  return new VarString(_data, srcId, idx);
+  return new VarString(_buf, srcId, idx);
+}
+
+std::string &VarString::get() {
+  unshare();
+  return _buf->data;
 }
-std::string &VarString::get() { return _data; }
 
 void VarString::set(VarBase *from) {
   if (from->isa<VarString>()) {
-    _data = AsString(from)->get();
+    Buf *buf = AsString(from)->_buf;
+    if (buf == _buf)
+      return;
+    buf->refs.fetch_add(1, std::memory_order_relaxed);
+    if (_buf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete _buf;
+    _buf = buf;
   } else if (from->isa<VarInt>()) {
-    _data = std::to_string(AsInt(from)->get());
+    get() = std::to_string(AsInt(from)->get());
   } else if (from->isa<VarBool>()) {
-    _data = std::to_string(AsBool(from)->get());
+    get() = std::to_string(AsBool(from)->get());
   } else {
-    _data = "";
+    get() = "";
   }
 }
 
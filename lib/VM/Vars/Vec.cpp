@@ -1,58 +1,108 @@
+#include "VM/Gc.hpp"
+#include "VM/Memory.hpp"
 #include "VM/State.hpp"
 #include "VM/Vars/Base.hpp"
 #include <vector>
 
 namespace june {
 
+void *VarVec::Buf::operator new(size_t sz) { return mem::alloc(sz); }
+void VarVec::Buf::operator delete(void *ptr, size_t sz) { mem::free(ptr, sz); }
+
 VarVec::VarVec(const std::vector<VarBase *> &val, const bool &refs,
                const size_t &srcId, const size_t &idx)
-    : VarBase(type_id<VarVec>(), srcId, idx, refs, false), _data(val),
-      _refs(refs) {}
+    : VarBase(type_id<VarVec>(), srcId, idx, refs, false),
+      _buf(new Buf{{1}, val}), _refs(refs) {
+  gc::track(this);
+}
+
+VarVec::VarVec(Buf *buf, const bool &refs, const size_t &srcId,
+               const size_t &idx)
+    : VarBase(type_id<VarVec>(), srcId, idx, refs, false), _buf(buf),
+      _refs(refs) {
+  _buf->refs.fetch_add(1, std::memory_order_relaxed);
+  gc::track(this);
+}
 
 VarVec::~VarVec() {
-  for (auto &v : _data)
-    varDref(v);
+  gc::untrack(this);
+  release(_buf);
 }
 
-VarBase *VarVec::copy(const size_t &srcId, const size_t &idx) {
-  std::vector<VarBase *> newVec;
-  if (_refs) {
-    for (auto &v : _data) {
+void VarVec::release(Buf *buf) {
+  if (buf->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+  gc::release(buf->data);
+  delete buf;
+}
+
+void VarVec::unshare() {
+  if (!isShared())
+    return;
+  // a vector of values gets its own elements, a vector of references keeps
+  // pointing at the same ones
+  Buf *buf = new Buf{{1}, {}};
+  buf->data.reserve(_buf->data.size());
+  for (auto &v : _buf->data) {
+    if (_refs) {
       varIref(v);
-      newVec.push_back(v);
+      buf->data.push_back(v);
+    } else {
+      buf->data.push_back(varCopy(v, v->srcId(), v->idx()));
     }
-  } else {
-    for (auto &v : _data)
-      newVec.push_back(v->copy(srcId, idx));
   }
-  return new VarVec(newVec, _refs, srcId, idx);
+  release(_buf);
+  _buf = buf;
+}
+
+VarBase *VarVec::copy(const size_t &srcId, const size_t &idx) {
+  return new VarVec(_buf, _refs, srcId, idx);
 }
 
-std::vector<VarBase *> &VarVec::get() { return _data; }
+std::vector<VarBase *> &VarVec::get() {
+  unshare();
+  return _buf->data;
+}
 
 bool VarVec::isRefVec() { return _refs; }
 void VarVec::set(VarBase *from) {
   if (from->isa<VarVec>()) {
-    _data.clear();
-    for (auto &v : AsVec(from)->get()) {
-      varIref(v);
-      _data.push_back(v);
-    }
+    Buf *buf = AsVec(from)->_buf;
     _refs = AsVec(from)->isRefVec();
+    if (buf == _buf)
+      return;
+    buf->refs.fetch_add(1, std::memory_order_relaxed);
+    release(_buf);
+    _buf = buf;
   } else {
-    _data.clear();
+    release(_buf);
+    _buf = new Buf{{1}, {}};
   }
 }
 
 VarBase *VarVec::attrGet(const std::string &attr) {
   if (attr == "size")
-    return make_all<VarInt>((long long)_data.size(), this->srcId(), this->idx());
+    return make_all<VarInt>((long long)view().size(), this->srcId(),
+                            this->idx());
   return nullptr;
 }
 
 void VarVec::attrSet(const std::string &attr, VarBase *val, const bool iref) {
   // currently no attributes
-  // todo: implement attributes
+  // todo: implement attributes, mutating ones must go through `get()`
+}
+
+void VarVec::traverse(GcVisitor &visitor) {
+  if (!visitor.enter(_buf))
+    return;
+  for (auto &v : _buf->data)
+    visitor.visit(v);
+}
+
+void VarVec::clearRefs() {
+  Buf *buf = _buf;
+  _buf = new Buf{{1}, {}};
+  release(buf);
 }
 
 bool VarVec::attrExists(const std::string &attr) const {
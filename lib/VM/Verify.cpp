@@ -0,0 +1,408 @@
+#include "VM/Verify.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Common.hpp"
+#include "VM/OpCodes.hpp"
+
+namespace june {
+
+namespace verify {
+
+namespace {
+
+// `OpCall`/`OpMemberCall`/`OpMakeFunc` operands: a flag, '0' or '1', then a
+// character per argument
+bool validArgs(const Op &op) {
+  if (op.data.s == nullptr || (op.data.s[0] != '0' && op.data.s[0] != '1'))
+    return false;
+  // a vector to unpack must be there
+  return op.data.s[0] == '0' || op.op == OpMakeFunc || op.data.s[1] != '\0';
+}
+
+size_t argCount(const Op &op) { return strlen(op.data.s) - 1; }
+
+// the stack as seen by an op: its depth, which slots are known to hold a
+// string constant, and how many marked bodies wait for their OpMakeFunc
+struct Frame {
+  std::vector<bool> strs;
+  size_t bodies;
+
+  inline size_t depth() const { return strs.size(); }
+  inline bool strAt(const size_t &fromTop) const {
+    return strs[strs.size() - 1 - fromTop];
+  }
+};
+
+class Checker {
+  const Bytecode &bc;
+  const std::vector<Op> &ops;
+  size_t begin, end;
+
+  // whether each op belongs to the function rather than to a nested body,
+  // and the frame each reached op starts with
+  std::vector<bool> own;
+  std::vector<bool> reached;
+  std::vector<Frame> frames;
+  std::vector<size_t> work;
+  size_t maxDepth;
+  // the function's `or` regions, and the handlers entered from each op a
+  // region begins at
+  std::vector<const Handler *> regions;
+  std::unordered_map<size_t, std::vector<size_t>> entered;
+
+  std::string error;
+
+  bool fail(const size_t &pos, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    char *msg = nullptr;
+    if (vasprintf(&msg, fmt, args) < 0)
+      msg = nullptr;
+    va_end(args);
+    const char *name =
+        ops[pos].op < _OpLast ? OpCodeStrs[ops[pos].op] : "invalid";
+    error = "op " + std::to_string(pos) + " (" + name + "): " +
+            (msg ? msg : fmt);
+    ::free(msg);
+    return false;
+  }
+
+  bool target(const size_t &pos, const size_t &to) {
+    if (to == end || (to >= begin && to < end && own[to - begin]))
+      return true;
+    return fail(pos, "jump target %zu is not an op of the function", to);
+  }
+
+  // merges `frame` into the one `to` starts with, queueing `to` if it changed
+  bool flow(const size_t &from, const size_t &to, const Frame &frame) {
+    if (to == end)
+      return true;
+    size_t at = to - begin;
+    if (!reached[at]) {
+      reached[at] = true;
+      frames[at] = frame;
+      work.push_back(to);
+      return true;
+    }
+    Frame &known = frames[at];
+    if (known.depth() != frame.depth())
+      return fail(from, "stack depth %zu differs from %zu at op %zu",
+                  frame.depth(), known.depth(), to);
+    if (known.bodies != frame.bodies)
+      return fail(from, "%zu marked bodies differ from %zu at op %zu",
+                  frame.bodies, known.bodies, to);
+    bool changed = false;
+    for (size_t i = 0; i < known.strs.size(); i++) {
+      if (known.strs[i] && !frame.strs[i]) {
+        known.strs[i] = false;
+        changed = true;
+      }
+    }
+    if (changed)
+      work.push_back(to);
+    return true;
+  }
+
+  bool operands(const size_t &pos) {
+    const Op &op = ops[pos];
+    switch (op.op) {
+    case OpLoad:
+      if (op.type == OdtSize || op.type >= _OdtLast)
+        return fail(pos, "cannot load a constant of this type");
+      if (op.type != OdtBool && op.type != OdtNil && op.data.s == nullptr)
+        return fail(pos, "missing operand");
+      return true;
+    case OpCall:
+    case OpMemberCall:
+    case OpMakeFunc:
+      if (!validArgs(op))
+        return fail(pos, "malformed argument list");
+      return true;
+    case OpAttr:
+    case OpPushJumpNamed:
+      if (op.data.s == nullptr)
+        return fail(pos, "missing name");
+      return true;
+    case OpBodyMarker:
+      if (op.data.sz <= pos || op.data.sz > end)
+        return fail(pos, "body end %zu is outside of the function",
+                    op.data.sz);
+      return true;
+    case OpJump:
+    case OpJumpTrue:
+    case OpJumpFalse:
+    case OpJumpTruePop:
+    case OpJumpFalsePop:
+    case OpJumpNil:
+    case OpContinue:
+    case OpBreak:
+    case OpPushJump:
+      return target(pos, op.data.sz);
+    case OpGuardFn:
+      if (op.data.sz == 0 || op.data.sz >= ops.size() ||
+          ops[op.data.sz - 1].op != OpBodyMarker)
+        return fail(pos, "%zu is not the start of a function body",
+                    op.data.sz);
+      return true;
+    case _OpLast:
+      return fail(pos, "invalid op");
+    default:
+      return op.op < _OpLast ? true : fail(pos, "invalid op");
+    }
+  }
+
+  // runs the ops from `pos` up to the end of its block
+  bool walk(size_t pos) {
+    Frame frame = frames[pos - begin];
+    for (;;) {
+      const Op &op = ops[pos];
+      // a handler starts with the stack its region began with, see `run`
+      auto handlers = entered.find(pos);
+      if (handlers != entered.end()) {
+        for (auto &to : handlers->second) {
+          if (!flow(pos, to, frame))
+            return false;
+        }
+      }
+
+      size_t taken = pops(op);
+      if (frame.depth() < taken)
+        return fail(pos, "stack has %zu values, expected at least %zu",
+                    frame.depth(), taken);
+
+      switch (op.op) {
+      case OpCreate:
+        if (!frame.strAt(0))
+          return fail(pos, "variable name is not a string constant");
+        break;
+      case OpMemberCall:
+        if (!frame.strAt(argCount(op)))
+          return fail(pos, "member name is not a string constant");
+        break;
+      case OpMakeFunc:
+        for (size_t i = 0; i < taken; i++) {
+          if (!frame.strAt(i))
+            return fail(pos, "parameter name is not a string constant");
+        }
+        if (frame.bodies == 0)
+          return fail(pos, "no body was marked for the function");
+        frame.bodies--;
+        break;
+      default:
+        break;
+      }
+
+      size_t next = pos + 1;
+      switch (op.op) {
+      case OpJump:
+      case OpContinue:
+      case OpBreak:
+        return flow(pos, op.data.sz, frame);
+      case OpBodyMarker:
+        frame.bodies++;
+        return flow(pos, op.data.sz, frame);
+      case OpReturn:
+        if (op.data.b && frame.depth() == 0)
+          return fail(pos, "no value to return");
+        return true;
+      case OpJumpTrue:
+      case OpJumpFalse:
+      case OpJumpTruePop:
+      case OpJumpFalsePop:
+      case OpJumpNil: {
+        Frame jumped = frame;
+        if (!keeps(op.op, true))
+          jumped.strs.pop_back();
+        if (!flow(pos, op.data.sz, jumped))
+          return false;
+        if (!keeps(op.op, false))
+          frame.strs.pop_back();
+        break;
+      }
+      default:
+        frame.strs.resize(frame.depth() - taken);
+        for (size_t i = 0; i < pushes(op); i++)
+          frame.strs.push_back(op.op == OpLoad && op.type == OdtString);
+        break;
+      }
+
+      maxDepth = std::max(maxDepth, frame.depth());
+      if (next == end || reached[next - begin])
+        return flow(pos, next, frame);
+      pos = next;
+      reached[pos - begin] = true;
+      frames[pos - begin] = frame;
+    }
+  }
+
+  // a name is bound through the string constant holding it, or by an `or`
+  // handler
+  void loopLookups(std::vector<size_t> &sites) {
+    std::unordered_set<std::string> bound;
+    for (size_t i = begin; i < end; i++) {
+      const Op &op = ops[i];
+      if (own[i - begin] && op.op == OpLoad && op.type == OdtString)
+        bound.insert(op.data.s);
+    }
+    for (auto &region : regions) {
+      if (region->name)
+        bound.insert(region->name);
+    }
+    size_t loops = 0;
+    for (size_t i = begin; i < end; i++) {
+      if (!own[i - begin])
+        continue;
+      const Op &op = ops[i];
+      if (op.op == OpPushLoop)
+        loops++;
+      else if (op.op == OpPopLoop && loops > 0)
+        loops--;
+      if (loops == 0 || !reached[i - begin])
+        continue;
+      if ((op.op == OpLoad && op.type == OdtIdent &&
+           bound.find(op.data.s) == bound.end()) ||
+          op.op == OpAttr || op.op == OpMemberCall)
+        sites.push_back(i);
+    }
+  }
+
+public:
+  Checker(const Bytecode &bc, const size_t &begin, const size_t &end)
+      : bc(bc), ops(bc.get()), begin(begin), end(end), maxDepth(0) {}
+
+  Result run() {
+    if (begin > end || end > ops.size())
+      return Result::Err("function is outside of the bytecode");
+    size_t count = end - begin;
+    own.assign(count, false);
+    reached.assign(count, false);
+    frames.assign(count, Frame{{}, 0});
+
+    // nested bodies are jumped over by their marker
+    for (size_t i = begin; i < end;) {
+      own[i - begin] = true;
+      if (ops[i].op != OpBodyMarker)
+        i++;
+      else if (!operands(i))
+        return Result::Err(error);
+      else
+        i = ops[i].data.sz;
+    }
+    for (size_t i = begin; i < end; i++) {
+      if (own[i - begin] && !operands(i))
+        return Result::Err(error);
+    }
+    // regions left empty cover nothing and are never entered
+    for (auto &h : bc.handlerTable()) {
+      if (h.owner != begin || h.begin >= h.end)
+        continue;
+      if (h.begin < begin || h.end > end || !own[h.begin - begin])
+        return Result::Err("`or` region at " + std::to_string(h.begin) +
+                           " is not in the function");
+      if (!target(h.begin, h.target))
+        return Result::Err(error);
+      if (h.target == end)
+        return Result::Err("`or` handler at " + std::to_string(h.begin) +
+                           " is past the end of the function");
+      regions.push_back(&h);
+      entered[h.begin].push_back(h.target);
+    }
+
+    if (count > 0) {
+      reached[0] = true;
+      work.push_back(begin);
+    }
+    while (!work.empty()) {
+      size_t pos = work.back();
+      work.pop_back();
+      if (!walk(pos))
+        return Result::Err(error);
+    }
+
+    // a failure jumps to the innermost handler of the op with the values the
+    // op did not pop yet, the stack is cut back to the depth the region began
+    // at so none of them may be below it
+    FnInfo info{maxDepth, {}};
+    for (size_t i = begin; i < end; i++) {
+      if (!own[i - begin] || !reached[i - begin])
+        continue;
+      const Handler *handler = bc.handlerAt(i, begin);
+      if (!handler)
+        continue;
+      if (!reached[handler->begin - begin])
+        return Result::Err("op " + std::to_string(i) +
+                           " is in an `or` region entered past its start");
+      size_t depth = frames[handler->begin - begin].depth();
+      if (frames[i - begin].depth() - pops(ops[i]) < depth)
+        return Result::Err("op " + std::to_string(i) +
+                           " pops values pushed before its `or` region");
+    }
+    for (auto &region : regions) {
+      if (reached[region->begin - begin])
+        info.handlers.push_back(
+            {region->begin, frames[region->begin - begin].depth()});
+    }
+    loopLookups(info.lookups);
+    return Result::Ok(std::move(info));
+  }
+};
+
+} // namespace
+
+size_t pushes(const Op &op) {
+  switch (op.op) {
+  case OpLoad:
+  case OpStore:
+  case OpMakeFunc:
+  case OpCall:
+  case OpMemberCall:
+  case OpAttr:
+  case OpGuardFn:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+size_t pops(const Op &op) {
+  switch (op.op) {
+  case OpUnload:
+  case OpAttr:
+  case OpJumpTrue:
+  case OpJumpFalse:
+  case OpJumpTruePop:
+  case OpJumpFalsePop:
+  case OpJumpNil:
+    return 1;
+  case OpStore:
+    return 2;
+  case OpCreate:
+    return op.data.b ? 3 : 2;
+  case OpCall:
+  case OpMemberCall:
+  case OpMakeFunc:
+    if (!validArgs(op))
+      return 0;
+    // names, then the callee (or the member's name and its object)
+    if (op.op == OpMakeFunc)
+      return argCount(op) + (op.data.s[0] == '1' ? 1 : 0);
+    return argCount(op) + (op.op == OpMemberCall ? 2 : 1);
+  default:
+    return 0;
+  }
+}
+
+Result function(const Bytecode &bc, const size_t &begin, const size_t &end) {
+  return Checker(bc, begin, end).run();
+}
+
+} // namespace verify
+
+} // namespace june
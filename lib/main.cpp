@@ -1,7 +1,13 @@
 #include "Common.hpp"
 #include "JuneConfig.hpp"
+#include "VM/Aot.hpp"
+#include "VM/Cache.hpp"
+#include "VM/Feedback.hpp"
+#include "VM/Passes.hpp"
 #include "VM/State.hpp"
 #include <cctype>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <vector>
 
@@ -10,6 +16,9 @@ using namespace june::args;
 using namespace june::err;
 using namespace june::fs;
 
+// type feedback of an earlier run the passes optimize with
+static feedback::Profile Profile;
+
 err::Errors JuneReadCode(const SrcFile *src, const std::string &srcDir,
                          const std::string &srcPath, Bytecode &bc,
                          const bool isMainSrc, const bool exprOnly,
@@ -39,24 +48,94 @@ SrcFile *JuneLoadCode(const std::string &srcFile, const std::string &srcDir,
     return nullptr;
   }
 
-  auto loadRes = JuneReadCode(src, src->dir(), src->path(), src->bytecode(),
-                              isMainSrc, false, beginIdx, endIdx);
-  if (loadRes.isErr()) {
-    loadRes.getErr()->print(std::cerr);
-    delete src;
-    return nullptr;
+  const feedback::Sites *sites = nullptr;
+  auto recorded = Profile.find(src->path());
+  if (recorded != Profile.end())
+    sites = &recorded->second;
+
+  // unchanged sources are not compiled again. No pass reads the feedback yet,
+  // so what a profile compiles to is what a run without it would cache
+  if (!src->isBytecode() && !cache::fetch(*src)) {
+    auto loadRes = JuneReadCode(src, src->dir(), src->path(), src->bytecode(),
+                                isMainSrc, false, beginIdx, endIdx);
+    if (loadRes.isErr()) {
+      loadRes.getErr()->print(std::cerr);
+      delete src;
+      return nullptr;
+    }
+
+    for (auto &bc : src->bytecode().getMut()) {
+      bc.srcId = src->id();
+    }
+    passes::Manager::standard().run(src->bytecode(), sites);
+    // stored with its `or` regions still marked, building the handlers strips
+    // them
+    cache::store(*src);
+    src->bytecode().buildHandlers();
+    src->bytecode().verify();
   }
+  src->dropData();
+
+  return src;
+}
 
-  for (auto &bc : src->bytecode().getMut()) {
-    bc.srcId = src->id();
+// loads a program compiled by --compile, null if `path` is not one
+SrcFile *JuneLoadCompiled(State &vm, const std::string &path) {
+  if (!vm.dylib->load(path))
+    return nullptr;
+  using ModuleFn = const aot::Module *(*)();
+  auto moduleFn = (ModuleFn)vm.dylib->get(path, "june_aot_module");
+  if (moduleFn == nullptr) {
+    std::cerr << path << " is not a compiled June program" << std::endl;
+    return nullptr;
+  }
+  auto src = aot::source(*moduleFn(), true);
+  if (src.isErr()) {
+    std::cerr << src.unwrapErr() << std::endl;
+    return nullptr;
   }
+  return src.unwrap();
+}
 
-  return src;
+// writes the bytecode of `src` as C++ next to `soPath` and builds it there
+bool JuneCompile(State &vm, SrcFile &src, const std::string &soPath) {
+  std::string cppPath = soPath + ".cpp";
+  std::ofstream out(cppPath);
+  auto emitted = aot::emit(src, out);
+  out.close();
+  auto res = emitted.isOk() ? aot::build(vm.selfBase(), cppPath, soPath)
+                            : emitted;
+  if (res.isErr()) {
+    std::cerr << "Failed to compile " << src.path() << ": "
+              << res.unwrapErr() << std::endl;
+    return false;
+  }
+  std::remove(cppPath.c_str());
+  return true;
 }
 
 int main(int argc, char **argv) {
   ArgsAddArgument("help", "-h", "--help", "Print this help message");
   ArgsAddArgument("version", "-v", "--version", "Print the version");
+  ArgsAddArgument("drop-source", "-s", "--drop-source",
+                  "Release source text after compiling, diagnostics re-read "
+                  "it from disk");
+  ArgsAddArgument("no-cache", "-n", "--no-cache",
+                  "Compile every source instead of using the bytecode cache");
+  ArgsAddArgument("pass-stats", "-p", "--pass-stats",
+                  "Print what the bytecode optimization passes did on exit");
+  ArgsAddArgument("feedback", "-f", "--feedback",
+                  "Record the types each op sees, written to the given file "
+                  "on exit",
+                  true);
+  ArgsAddArgument("use-feedback", "-u", "--use-feedback",
+                  "Optimize with the types recorded by --feedback in an "
+                  "earlier run",
+                  true);
+  ArgsAddArgument("compile", "-c", "--compile",
+                  "Compile the main file to the given shared object instead "
+                  "of running it, run it with `june <object>`",
+                  true);
   ArgsParseArguments(argc, argv);
 
   if (!ArgsAnyArgumentExists()) {
@@ -73,6 +152,20 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  SrcFile::setRetainData(!ArgsArgumentExists("drop-source"));
+  if (ArgsArgumentExists("no-cache"))
+    cache::setEnabled(false);
+  feedback::setRecording(ArgsArgumentExists("feedback"));
+  if (ArgsArgumentExists("use-feedback")) {
+    auto profile = feedback::read(ArgsGetArgument("use-feedback").value);
+    if (profile.isErr()) {
+      std::cerr << "Failed to read feedback: " << profile.unwrapErr()
+                << std::endl;
+      return 1;
+    }
+    Profile = profile.unwrap();
+  }
+
   std::string juneBase, juneBin;
   juneBin = fs::absPath(env::getProcPath(), &juneBase, true);
   State vm(juneBin, juneBase, ArgsGetCodeArgs());
@@ -87,7 +180,22 @@ int main(int argc, char **argv) {
   std::string mainFile = fs::absPath(mainFileArg.value, &mainDir);
 
   err::Errors err = Errors::Ok();
-  auto mainSrc = JuneLoadCode(mainFile, mainDir, true, err, 0, 0);
+  SrcFile *mainSrc = nullptr;
+  if (string::endsWith(mainFile, nativeModuleExt()))
+    mainSrc = JuneLoadCompiled(vm, mainFile);
+  else
+    mainSrc = JuneLoadCode(mainFile, mainDir, true, err, 0, 0);
+  if (mainSrc == nullptr) {
+    std::cerr << "Failed to load main file" << std::endl;
+    return 1;
+  }
+
+  if (ArgsArgumentExists("compile")) {
+    auto soPath = ArgsGetArgument("compile").value;
+    bool compiled = JuneCompile(vm, *mainSrc, soPath);
+    delete mainSrc;
+    return compiled ? 0 : 1;
+  }
 
   if (err.isErr()) {
     err.getErr()->print(std::cerr);
@@ -106,6 +214,14 @@ int main(int argc, char **argv) {
 
   auto execErr = vm::exec(vm);
   vm.popSrc();
+  if (ArgsArgumentExists("pass-stats"))
+    passes::Manager::standard().print(std::cerr);
+  if (ArgsArgumentExists("feedback")) {
+    auto written = feedback::dump(vm, ArgsGetArgument("feedback").value);
+    if (written.isErr())
+      std::cerr << "Failed to write feedback: " << written.unwrapErr()
+                << std::endl;
+  }
   if (execErr.isErr()) {
     execErr.getErr()->print(std::cerr);
     std::cerr << "Failed to execute main file" << std::endl;
@@ -0,0 +1,272 @@
+#include "Test.hpp"
+
+#include <fstream>
+#include <unistd.h>
+
+#include "VM/Aot.hpp"
+#include "VM/Dylib.hpp"
+#include "VM/SrcFile.hpp"
+
+using namespace june;
+
+// a directory the shared objects are built in, removed with them
+struct TempDir {
+  char path[32] = "/tmp/june-aotXXXXXX";
+
+  TempDir() { mkdtemp(path); }
+  ~TempDir() {
+    unlink(file("mod.cpp").c_str());
+    unlink(file("mod.so").c_str());
+    rmdir(path);
+  }
+
+  std::string file(const char *name) const {
+    return std::string(path) + "/" + name;
+  }
+};
+
+// true for the first three calls of each program
+static size_t turns = 0;
+static VarBase *more(State &vm, const FnData &fd) {
+  return ++turns <= 3 ? vm.tru : vm.fals;
+}
+
+static void addNatives(State &vm) {
+  turns = 0;
+  vm.globalAdd("more",
+               new VarFunc("aot.june", "", {}, {.native = more}, true, 0, 0),
+               false);
+}
+
+// compiles `code` to a shared object and runs it as a module through its
+// `june_init`, `compiled` gets the first ops of the functions compiled
+static bool runCompiled(const char *code, std::vector<size_t> &compiled) {
+  test::Program prog;
+  addNatives(prog.vm());
+  TempDir dir;
+  SrcFile *src = prog.source("aot.june", code);
+  std::ofstream out(dir.file("mod.cpp"));
+  bool emitted = Expect(aot::emit(*src, out).isOk());
+  out.close();
+  size_t size = src->bytecode().size();
+  delete src;
+  if (!emitted)
+    return false;
+
+  setenv("JUNE_INCLUDE_DIR", JUNE_TEST_INCLUDE_DIR, 0);
+  setenv("CXX", JUNE_TEST_CXX, 0);
+  std::string so = dir.file("mod.so");
+  auto built = aot::build(".", dir.file("mod.cpp"), so);
+  if (!Expect(built.isOk()))
+    return false;
+  ModInitFn init = nullptr;
+  if (prog.vm().dylib->load(so))
+    init = (ModInitFn)prog.vm().dylib->get(so, "june_init");
+  if (!Expect(init != nullptr))
+    return false;
+  bool ok = init(prog.vm(), 0, 0);
+
+  auto mod = prog.vm().allSrcs.find("aot.june");
+  if (!Expect(mod != prog.vm().allSrcs.end()))
+    return ok;
+  const Bytecode &bc = mod->second->src()->bytecode();
+  compiled.clear();
+  for (size_t begin = 0; begin < size; begin++) {
+    if (bc.compiledAt(begin))
+      compiled.push_back(begin);
+  }
+  return ok;
+}
+
+// runs `code` through the interpreter, then compiled; both must write the
+// same and succeed alike
+static std::string runBoth(const char *code, const bool &ok,
+                           std::vector<size_t> &compiled) {
+  std::string out;
+  {
+    test::Program prog;
+    addNatives(prog.vm());
+    SrcFile *src = prog.source("aot.june", code);
+    test::load(src->bytecode());
+    ExpectEq(prog.run(src), ok);
+    out = test::output();
+  }
+  ExpectEq(runCompiled(code, compiled), ok);
+  ExpectEq(test::output(), out);
+  return out;
+}
+
+static std::string runBoth(const char *code, const bool &ok = true) {
+  std::vector<size_t> compiled;
+  std::string out = runBoth(code, ok, compiled);
+  Expect(!compiled.empty() && compiled[0] == 0);
+  return out;
+}
+
+JuneTest(callsAndBranches) {
+  // `fn sel(a) { if a { return 1 } return 2 }`, called three times
+  std::vector<size_t> compiled;
+  ExpectEq(runBoth(R"(
+Load String a
+BodyMarker 9
+BlkA 1
+Load Ident a
+JumpFalsePop 7
+Load Int 1
+Return true
+Load Int 2
+Return true
+MakeFunc 00
+Load String sel
+Create false
+Load Ident print
+Load Ident sel
+Load true
+Call 00
+Load Ident sel
+Load false
+Call 00
+Load Ident sel
+Load true
+Call 00
+Call 0000
+Unload
+)",
+                   true, compiled),
+           "1 2 1\n");
+  if (ExpectEq(compiled.size(), 2))
+    ExpectEq(compiled[1], 2);
+}
+
+JuneTest(loops) {
+  // `while more() { print("x"); if more() { continue }; print("y") }`
+  ExpectEq(runBoth(R"(
+PushLoop
+Load Ident more
+Call 0
+JumpFalsePop 16
+Load Ident print
+Load String x
+Call 00
+Unload
+Load Ident more
+Call 0
+JumpFalsePop 12
+Continue 1
+Load Ident print
+Load String y
+Call 00
+Unload
+PopLoop
+)"),
+           "x\nx\ny\n");
+}
+
+JuneTest(orHandlers) {
+  // `print(gone or f())` with `fn f() { return missing or 3 }`
+  ExpectEq(runBoth(R"(
+BodyMarker 8
+BlkA 1
+PushJump 6
+Load Ident missing
+PopJump
+Return true
+Load Int 3
+Return true
+MakeFunc 0
+Load String f
+Create false
+Load Ident print
+PushJump 16
+Load Ident gone
+PopJump
+Jump 17
+Load Ident f
+Call 0
+Call 00
+Unload
+)"),
+           "3\n");
+}
+
+JuneTest(namedOr) {
+  // `missing or e { print(e) }`
+  ExpectEq(runBoth(R"(
+PushJump 5
+PushJumpNamed e
+Load Ident missing
+PopJump
+Jump 11
+BlkA 1
+Load Ident print
+Load Ident e
+Call 00
+Unload
+BlkR 1
+)"),
+           "variable 'missing' does not exist\n");
+}
+
+JuneTest(deepRecursionCaught) {
+  // `fn f() { return f() or 1 }`, the innermost call fails on the call stack
+  // size, its handler too, and the call before it takes its handler
+  ExpectEq(runBoth(R"(
+BodyMarker 8
+PushJump 6
+Load Ident f
+Call 0
+PopJump
+Return true
+Load Int 1
+Return true
+MakeFunc 0
+Load String f
+Create false
+Load Ident print
+Load Ident f
+Call 0
+Call 00
+Unload
+)"),
+           "1\n");
+}
+
+JuneTest(failuresEndTheModule) {
+  ExpectEq(runBoth(R"(
+Load Ident print
+Load Int 1
+Call 00
+Unload
+Load Ident missing
+Unload
+Load Ident print
+Load Int 2
+Call 00
+Unload
+)",
+                   false),
+           "1\n");
+}
+
+JuneTest(unverifiedBodiesInterpreted) {
+  // the body unloads more than it loaded, it is never called
+  std::vector<size_t> compiled;
+  ExpectEq(runBoth(R"(
+BodyMarker 3
+Unload
+Return false
+MakeFunc 0
+Load String f
+Create false
+Load Ident print
+Load Int 1
+Call 00
+Unload
+)",
+                   true, compiled),
+           "1\n");
+  if (ExpectEq(compiled.size(), 1))
+    ExpectEq(compiled[0], 0);
+}
+
+int main() { return test::run(); }
@@ -0,0 +1,225 @@
+#include "Test.hpp"
+
+#include <cstring>
+
+using namespace june;
+
+// flags the ops at `at` of a bytecode of `size` ops
+static std::vector<bool> flagged(const size_t &size,
+                                 const std::vector<size_t> &at) {
+  std::vector<bool> dead(size, false);
+  for (auto &pos : at)
+    dead[pos] = true;
+  return dead;
+}
+
+JuneTest(eraseRetargets) {
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Int 1
+PushJump 7
+Load Ident x
+Unload
+PopJump
+Jump 8
+Load Int 0
+Unload
+Load nil
+BodyMarker 12
+Load Int 2
+Return true
+MakeFunc 0
+)");
+  Expect(bc.erase(flagged(bc.size(), {0, 6, 8, 10})));
+  // a jump to a removed op lands on the op that followed it
+  ExpectEq(test::listing(bc), R"(PushJump 5
+Load Ident x
+Unload
+PopJump
+Jump 6
+Unload
+BodyMarker 8
+Return true
+MakeFunc 0
+)");
+
+  // the markers go once the table is built, jumps fill in for them up to the
+  // body marker
+  bc.buildHandlers();
+  ExpectEq(test::listing(bc), R"(Load Ident x
+Unload
+Jump 6
+Unload
+Jump 6
+Jump 6
+BodyMarker 8
+Return true
+MakeFunc 0
+)");
+  const Handler *handler = bc.handlerAt(0, 0);
+  if (Expect(handler != nullptr)) {
+    ExpectEq(handler->begin, 0);
+    ExpectEq(handler->end, 2);
+    ExpectEq(handler->target, 3);
+  }
+  Expect(bc.handlerAt(1, 0) == handler);
+  Expect(bc.handlerAt(2, 0) == nullptr);
+  // and the ops are not rewritten past that
+  Expect(!bc.erase(flagged(bc.size(), {3})));
+}
+
+JuneTest(eraseBodyHandlers) {
+  // regions of a body belong to it wherever the body moved
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Int 1
+Unload
+BodyMarker 8
+PushJump 7
+Load Ident x
+PopJump
+Return true
+Return false
+MakeFunc 0
+)");
+  Expect(bc.erase(flagged(bc.size(), {0, 1})));
+  ExpectEq(test::listing(bc), R"(BodyMarker 6
+PushJump 5
+Load Ident x
+PopJump
+Return true
+Return false
+MakeFunc 0
+)");
+  bc.buildHandlers();
+  ExpectEq(test::listing(bc), R"(BodyMarker 6
+Load Ident x
+Return true
+Return false
+Jump 6
+Jump 6
+MakeFunc 0
+)");
+  const Handler *handler = bc.handlerAt(1, 1);
+  if (Expect(handler != nullptr)) {
+    ExpectEq(handler->owner, 1);
+    ExpectEq(handler->end, 2);
+    ExpectEq(handler->target, 3);
+  }
+  Expect(bc.handlerAt(1, 0) == nullptr);
+  Expect(bc.handlerAt(2, 1) == nullptr);
+}
+
+JuneTest(strippedRegionsCatch) {
+  // `print(gone or f())` with `fn f() { return missing or 3 }`, run as loaded
+  // and verified, then as is
+  const char *code = R"(
+BodyMarker 8
+BlkA 1
+PushJump 6
+Load Ident missing
+PopJump
+Return true
+Load Int 3
+Return true
+MakeFunc 0
+Load String f
+Create false
+Load Ident print
+PushJump 16
+Load Ident gone
+PopJump
+Jump 17
+Load Ident f
+Call 0
+Call 00
+Unload
+)";
+  for (int verified = 0; verified < 2; verified++) {
+    test::Program prog;
+    SrcFile *src = prog.source("or.june", code);
+    size_t depth = 0;
+    if (verified) {
+      test::load(src->bytecode());
+      Expect(src->bytecode().verifiedDepth(0, depth));
+      Expect(src->bytecode().verifiedDepth(1, depth));
+    }
+    Expect(prog.run(src));
+    ExpectEq(test::output(), "3\n");
+    ExpectEq(src->bytecode().handlerTable().size(), 2);
+    size_t markers = 0;
+    for (auto &op : src->bytecode().get())
+      markers += op.op == OpPushJump || op.op == OpPopJump;
+    ExpectEq(markers, 0);
+  }
+}
+
+JuneTest(namedOrBindsMessage) {
+  // `missing or e { print(e) }`, the name is the message as a string
+  test::Program prog;
+  SrcFile *src = prog.source("or.june", R"(
+PushJump 5
+PushJumpNamed e
+Load Ident missing
+PopJump
+Jump 11
+BlkA 1
+Load Ident print
+Load Ident e
+Call 00
+Unload
+BlkR 1
+)");
+  Expect(prog.run(src));
+  ExpectEq(test::output(), "variable 'missing' does not exist\n");
+}
+
+JuneTest(rewriteSplices) {
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Int 1
+JumpTruePop 3
+Load Int 2
+Return false
+)");
+  // the operand is the bytecode's own copy once spliced in
+  std::string name = "s";
+  Splice splice{2, {}, {}};
+  splice.ops.push_back(Op{0, 0, OpLoad, OdtBool, {.b = true}});
+  splice.ops.push_back(Op{0, 0, OpJumpFalsePop, OdtSize, {.sz = 3}});
+  splice.ops.push_back(Op{0, 0, OpLoad, OdtString, {.s = &name[0]}});
+  splice.ops.push_back(Op{0, 0, OpJump, OdtSize, {.sz = 3}});
+  splice.local = {false, true, false, false};
+  std::vector<Splice> splices;
+  splices.push_back(std::move(splice));
+  Expect(bc.rewrite(flagged(bc.size(), {}), std::move(splices)));
+
+  // jumps to the op a splice is inserted before skip the splice, its local
+  // jumps stay in it
+  ExpectEq(test::listing(bc), R"(Load Int 1
+JumpTruePop 7
+Load true
+JumpFalsePop 5
+Load String s
+Jump 7
+Load Int 2
+Return false
+)");
+  Expect(bc.get()[4].data.s != &name[0]);
+}
+
+JuneTest(rewritePending) {
+  // bodies left encoded cannot be rewritten
+  Bytecode bc;
+  test::assemble(bc, R"(
+BodyMarker 2
+Return false
+Unload
+)");
+  std::vector<Op> ops = bc.get();
+  bc.assign(std::move(ops), nullptr, {}, {fs::CodeBlock{1, 1, nullptr, 0}});
+  Expect(!bc.erase(flagged(bc.size(), {2})));
+  ExpectEq(bc.size(), 3);
+}
+
+int main() { return test::run(); }
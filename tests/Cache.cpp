@@ -0,0 +1,142 @@
+#include "Test.hpp"
+
+#include <fstream>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "VM/Cache.hpp"
+#include "VM/Passes.hpp"
+
+using namespace june;
+
+// a cache directory of its own holding the source `mod.june`, removed with
+// the entries written to it
+struct TempCache {
+  char path[32] = "/tmp/june-cacheXXXXXX";
+
+  TempCache() {
+    mkdtemp(path);
+    setenv("JUNE_CACHE_DIR", path, 1);
+    cache::setEnabled(true);
+  }
+  ~TempCache() {
+    nftw(
+        path,
+        [](const char *file, const struct stat *, int, struct FTW *) {
+          return remove(file);
+        },
+        8, FTW_DEPTH | FTW_PHYS);
+  }
+
+  std::string source() const { return std::string(path) + "/mod.june"; }
+
+  void write(const char *text) const {
+    std::ofstream out(source(), std::ios::trunc);
+    out << text;
+  }
+};
+
+// `print(1)` as the frontend would compile it
+static const char *kCode = R"(
+Load Ident print
+Load Int 1
+Call 00
+Unload
+)";
+
+// stores the ops of `kCode` as what `src` compiled to
+static bool store(SrcFile &src) {
+  test::assemble(src.bytecode(), kCode);
+  return cache::store(src);
+}
+
+JuneTest(hashesLikeSha256) {
+  ExpectEq(hash::sha256(""),
+           "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  ExpectEq(hash::sha256("abc"),
+           "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  // the padding takes a block of its own
+  ExpectEq(hash::sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnop"
+                        "nopq"),
+           "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+JuneTest(keyedByCompiler) {
+  TempCache tmp;
+  std::string dir = cache::dir();
+  Expect(dir.find(JuneGitRev) != std::string::npos);
+  Expect(string::endsWith(dir, "-p" + std::to_string(passes::kVersion)));
+}
+
+JuneTest(hitsUnchangedSource) {
+  TempCache tmp;
+  tmp.write("print(1)\n");
+  {
+    SrcFile src(tmp.path, tmp.source(), true);
+    if (!Expect(src.loadFile().isOk()))
+      return;
+    Expect(!cache::fetch(src));
+    Expect(store(src));
+  }
+  SrcFile src(tmp.path, tmp.source(), true);
+  Expect(src.loadFile().isOk());
+  Expect(cache::fetch(src));
+  Bytecode bc;
+  test::assemble(bc, kCode);
+  ExpectEq(test::listing(src.bytecode()), test::listing(bc));
+}
+
+JuneTest(missesChangedSource) {
+  // as long as the old text, an entry keyed by its length alone would match
+  TempCache tmp;
+  tmp.write("print(1)\n");
+  std::string before;
+  {
+    SrcFile src(tmp.path, tmp.source(), true);
+    Expect(src.loadFile().isOk());
+    Expect(store(src));
+    before = cache::entryPath(src);
+  }
+  tmp.write("print(2)\n");
+  SrcFile src(tmp.path, tmp.source(), true);
+  Expect(src.loadFile().isOk());
+  Expect(cache::entryPath(src) != before);
+  Expect(!cache::fetch(src));
+  ExpectEq(src.bytecode().size(), 0);
+}
+
+JuneTest(rejectsDamagedEntry) {
+  TempCache tmp;
+  tmp.write("print(1)\n");
+  std::string path;
+  {
+    SrcFile src(tmp.path, tmp.source(), true);
+    Expect(src.loadFile().isOk());
+    Expect(store(src));
+    path = cache::entryPath(src);
+  }
+  // the last byte is in the section directory, which the header checksums
+  std::vector<char> data;
+  {
+    std::ifstream in(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+  if (!Expect(!data.empty()))
+    return;
+  data.back() ^= 1;
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+  }
+  SrcFile src(tmp.path, tmp.source(), true);
+  Expect(src.loadFile().isOk());
+  Expect(!cache::fetch(src));
+
+  // nor is a truncated one read
+  Expect(truncate(path.c_str(), data.size() / 2) == 0);
+  Expect(!cache::fetch(src));
+  ExpectEq(src.bytecode().size(), 0);
+}
+
+int main() { return test::run(); }
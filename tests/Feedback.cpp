@@ -0,0 +1,133 @@
+#include "Test.hpp"
+
+#include <unistd.h>
+
+#include "VM/Feedback.hpp"
+
+using namespace june;
+
+// a file name of its own, removed once done with
+struct TempPath {
+  char path[32] = "/tmp/june-fbXXXXXX";
+
+  TempPath() { close(mkstemp(path)); }
+  ~TempPath() { unlink(path); }
+};
+
+// true for the first five calls of each test
+static size_t turns = 0;
+static VarBase *more(State &vm, const FnData &fd) {
+  return ++turns <= 5 ? vm.tru : vm.fals;
+}
+
+// an int or a string, in turn
+static VarBase *two(State &vm, const FnData &fd) {
+  if (turns % 2)
+    return make_all<VarInt>(1, fd.srcId, fd.idx);
+  return make_all<VarString>("s", fd.srcId, fd.idx);
+}
+
+// a value of another type each turn
+static VarBase *five(State &vm, const FnData &fd) {
+  switch (turns) {
+  case 1:
+    return make_all<VarInt>(1, fd.srcId, fd.idx);
+  case 2:
+    return make_all<VarString>("s", fd.srcId, fd.idx);
+  case 3:
+    return vm.tru;
+  case 4:
+    return make_all<VarFloat>(1.5, fd.srcId, fd.idx);
+  default:
+    return vm.nil;
+  }
+}
+
+JuneTest(classifiesByTypesSeen) {
+  TypeFeedback slot{{}, 0, false};
+  ExpectEq(feedback::kind(slot), feedback::KindUnseen);
+  feedback::observe(slot, 1);
+  feedback::observe(slot, 1);
+  ExpectEq(feedback::kind(slot), feedback::KindMonomorphic);
+  for (std::uintptr_t type = 2; type <= TypeFeedback::kMaxTypes; type++)
+    feedback::observe(slot, type);
+  ExpectEq(slot.count, size_t(TypeFeedback::kMaxTypes));
+  ExpectEq(feedback::kind(slot), feedback::KindPolymorphic);
+  // types seen already do not count again
+  feedback::observe(slot, 1);
+  ExpectEq(feedback::kind(slot), feedback::KindPolymorphic);
+  feedback::observe(slot, TypeFeedback::kMaxTypes + 1);
+  ExpectEq(feedback::kind(slot), feedback::KindMegamorphic);
+}
+
+JuneTest(dumpReadsBack) {
+  // while more() { two() ?? nil; five() ?? nil }
+  test::Program prog;
+  for (auto &fn : {std::make_pair("more", more), std::make_pair("two", two),
+                   std::make_pair("five", five)}) {
+    prog.vm().globalAdd(fn.first,
+                        new VarFunc("fb.june", "", {}, {.native = fn.second},
+                                    true, 0, 0),
+                        false);
+  }
+  SrcFile *src = prog.source("fb.june", R"(
+PushLoop
+Load Ident more
+Call 0
+JumpFalsePop 13
+Load Ident two
+Call 0
+JumpNil 8
+Unload
+Load Ident five
+Call 0
+JumpNil 12
+Unload
+Continue 1
+PopLoop
+)");
+  test::load(src->bytecode());
+  turns = 0;
+  feedback::setRecording(true);
+  Expect(prog.run(src));
+  feedback::setRecording(false);
+
+  TempPath tmp;
+  auto dumped = feedback::dump(prog.vm(), tmp.path);
+  if (!Expect(dumped.isOk()))
+    return;
+  auto read = feedback::read(tmp.path);
+  if (!Expect(read.isOk()))
+    return;
+  feedback::Profile profile = read.unwrap();
+  ExpectEq(profile.size(), 1);
+  const feedback::Sites &sites = profile["fb.june"];
+  // three calls, the loop condition and two nil checks
+  ExpectEq(sites.size(), dumped.unwrap());
+  ExpectEq(sites.size(), 6);
+
+  // ops take the line they are written on as their position
+  const feedback::Site *call = feedback::find(sites, 3, OpCall);
+  if (Expect(call != nullptr)) {
+    ExpectEq(call->kind, feedback::KindMonomorphic);
+    if (ExpectEq(call->types.size(), 1))
+      ExpectEq(call->types[0],
+               prog.vm().getTypeName(prog.vm().globalGet("more")));
+  }
+  const feedback::Site *cond = feedback::find(sites, 4, OpJumpFalsePop);
+  if (Expect(cond != nullptr))
+    ExpectEq(cond->kind, feedback::KindMonomorphic);
+  const feedback::Site *poly = feedback::find(sites, 7, OpJumpNil);
+  if (Expect(poly != nullptr)) {
+    ExpectEq(poly->kind, feedback::KindPolymorphic);
+    ExpectEq(poly->types.size(), 2);
+  }
+  const feedback::Site *mega = feedback::find(sites, 11, OpJumpNil);
+  if (Expect(mega != nullptr)) {
+    ExpectEq(mega->kind, feedback::KindMegamorphic);
+    ExpectEq(mega->types.size(), size_t(TypeFeedback::kMaxTypes));
+  }
+  Expect(feedback::find(sites, 8, OpUnload) == nullptr);
+}
+
+int main() { return test::run(); }
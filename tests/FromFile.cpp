@@ -0,0 +1,214 @@
+#include "Test.hpp"
+
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace june;
+
+// a file of its own, removed once done with
+struct TempFile {
+  char path[32] = "/tmp/june-testXXXXXX";
+  int fd;
+
+  TempFile() : fd(mkstemp(path)) {}
+  ~TempFile() {
+    close(fd);
+    unlink(path);
+  }
+
+  std::vector<fs::u8> contents() const {
+    std::vector<fs::u8> data(lseek(fd, 0, SEEK_END));
+    if (pread(fd, data.data(), data.size(), 0) != (ssize_t)data.size())
+      data.clear();
+    return data;
+  }
+};
+
+// reads `data` back whole, decoding the bodies it left encoded
+static bool readAll(const std::vector<fs::u8> &data, fs::ValidRead &out) {
+  fs::ReadResult res = fs::readBytecode(data.data(), data.size());
+  if (!Expect(res.isOk()))
+    return false;
+  out = std::move(res.unwrap());
+  for (auto &block : out.pending) {
+    if (!Expect(fs::intact(block)) ||
+        !Expect(fs::decodeOps(block.data, block.size, block.count, out.consts,
+                              out.bytecode.data() + block.begin)))
+      return false;
+  }
+  return true;
+}
+
+JuneTest(roundTripsLargeModule) {
+  // more operands than a byte indexes, more idx than a byte spans and more
+  // output than the write buffer holds
+  Bytecode bc;
+  LineTable lines;
+  size_t line = 0;
+  auto next = [&]() {
+    lines.add(line * 48, line * 48 + 47);
+    return line++ * 48;
+  };
+  for (size_t i = 0; i < 4000; i++) {
+    size_t idx = next();
+    bc.adds(idx, OpLoad, OdtInt, std::to_string(i * 7919));
+    bc.adds(idx + 10, OpLoad, OdtString,
+            "a string long enough to spread the strings " + std::to_string(i));
+    bc.adds(idx + 20, OpLoad, OdtString, "name" + std::to_string(i));
+    bc.addb(idx + 30, OpCreate, false);
+    if (i % 1000 == 500) {
+      size_t marker = bc.size();
+      bc.addsz(next(), OpBodyMarker, 0);
+      bc.addsz(next(), OpBlkA, 1);
+      bc.adds(next(), OpLoad, OdtIdent, "name" + std::to_string(i));
+      bc.addb(next(), OpReturn, true);
+      bc.updatesz(marker, bc.size());
+      bc.adds(next(), OpMakeFunc, OdtString, "0");
+      bc.add(next(), OpUnload);
+    }
+  }
+
+  TempFile file;
+  fs::WriteResult written = fs::writeBytecode(file.fd, bc.get(), lines);
+  if (!Expect(written.isOk()))
+    return;
+  std::vector<fs::u8> data = file.contents();
+  ExpectEq(written.unwrap(), data.size());
+  Expect(data.size() > 64 * 1024);
+
+  fs::ValidRead res;
+  if (!readAll(data, res))
+    return;
+  ExpectEq(res.pending.size(), 4);
+  ExpectEq(test::listing(res.bytecode), test::listing(bc));
+  size_t sameIdx = 0;
+  for (size_t i = 0; i < bc.size() && i < res.bytecode.size(); i++)
+    sameIdx += res.bytecode[i].idx == bc.get()[i].idx;
+  ExpectEq(sameIdx, bc.size());
+  ExpectEq(res.lines.size(), lines.size());
+  size_t found, begin, end;
+  Expect(res.lines.find(line * 48 - 30, found, begin, end));
+  ExpectEq(found, line - 1);
+}
+
+JuneTest(writesFromCurrentPosition) {
+  // the size written leaves out what the file held before
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Int 1
+Unload
+)");
+  TempFile file;
+  Expect(write(file.fd, "#!", 2) == 2);
+  fs::WriteResult written =
+      fs::writeBytecode(file.fd, bc.get(), LineTable());
+  if (!Expect(written.isOk()))
+    return;
+  std::vector<fs::u8> data = file.contents();
+  ExpectEq(written.unwrap() + 2, data.size());
+
+  data.erase(data.begin(), data.begin() + 2);
+  fs::ValidRead res;
+  if (readAll(data, res))
+    ExpectEq(test::listing(res.bytecode), test::listing(bc));
+}
+
+JuneTest(checksumsBodiesOnDecode) {
+  // a damaged body is only found once decoded, the rest is checked on load
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Int 1
+Unload
+BodyMarker 6
+BlkA 1
+Load Int 2
+Return true
+MakeFunc 0
+Unload
+)");
+  TempFile file;
+  if (!Expect(fs::writeBytecode(file.fd, bc.get(), LineTable()).isOk()))
+    return;
+  const std::vector<fs::u8> data = file.contents();
+  fs::ReadResult res = fs::readBytecode(data.data(), data.size());
+  if (!Expect(res.isOk()) || !Expect(res.unwrap().pending.size() == 1))
+    return;
+  const fs::CodeBlock &body = res.unwrap().pending[0];
+  size_t bodyAt = body.data - data.data();
+
+  // each byte of the body, of the code before it and of the directory
+  std::vector<size_t> damaged = {bodyAt, bodyAt + body.size - 1, bodyAt - 1,
+                                 data.size() - 1};
+  for (size_t i = 0; i < damaged.size(); i++) {
+    std::vector<fs::u8> copy = data;
+    copy[damaged[i]] ^= 0x40;
+    fs::ReadResult read = fs::readBytecode(copy.data(), copy.size());
+    if (i >= 2) {
+      Expect(read.isErr());
+      continue;
+    }
+    if (!Expect(read.isOk()))
+      continue;
+    fs::ValidRead &valid = read.unwrap();
+    Expect(!fs::intact(valid.pending[0]));
+    Bytecode loaded;
+    loaded.assign(std::move(valid.bytecode), nullptr, std::move(valid.consts),
+                  std::move(valid.pending));
+    Expect(!loaded.decodeBody(3));
+    Expect(loaded.hasPending());
+  }
+}
+
+JuneTest(decodedBodiesAddHandlers) {
+  // the regions of a body are known and stripped once it is decoded
+  Bytecode bc;
+  test::assemble(bc, R"(
+PushJump 3
+Load Ident x
+PopJump
+BodyMarker 10
+BlkA 1
+PushJump 8
+PushJumpNamed e
+Load Ident y
+PopJump
+Return true
+MakeFunc 0
+)");
+  TempFile file;
+  if (!Expect(fs::writeBytecode(file.fd, bc.get(), LineTable()).isOk()))
+    return;
+  const std::vector<fs::u8> data = file.contents();
+  fs::ReadResult res = fs::readBytecode(data.data(), data.size());
+  if (!Expect(res.isOk()))
+    return;
+  fs::ValidRead &read = res.unwrap();
+  Bytecode loaded;
+  loaded.assign(std::move(read.bytecode), nullptr, std::move(read.consts),
+                std::move(read.pending));
+  loaded.buildHandlers();
+  ExpectEq(loaded.handlerTable().size(), 1);
+  Expect(loaded.decodeBody(4));
+  ExpectEq(test::listing(loaded), R"(Load Ident x
+Jump 3
+Jump 3
+BodyMarker 10
+BlkA 1
+Load Ident y
+Return true
+Jump 10
+Jump 10
+Jump 10
+MakeFunc 0
+)");
+  ExpectEq(loaded.handlerTable().size(), 2);
+  const Handler *handler = loaded.handlerAt(5, 4);
+  if (Expect(handler != nullptr)) {
+    ExpectEq(handler->begin, 5);
+    ExpectEq(handler->end, 6);
+    ExpectEq(handler->target, 6);
+    ExpectEq(handler->name, "e");
+  }
+}
+
+int main() { return test::run(); }
@@ -0,0 +1,188 @@
+#include "Test.hpp"
+
+#include "VM/Gc.hpp"
+#include "VM/SrcFile.hpp"
+
+using namespace june;
+
+// a vector holding `outer` vectors of `inner` integers
+static VarVec *nested(const size_t &outer, const size_t &inner) {
+  std::vector<VarBase *> vecs;
+  for (size_t i = 0; i < outer; i++) {
+    std::vector<VarBase *> ints;
+    for (size_t k = 0; k < inner; k++)
+      ints.push_back(new VarInt((long long)k, 0, 0));
+    vecs.push_back(new VarVec(ints, false, 0, 0));
+  }
+  return new VarVec(vecs, false, 0, 0);
+}
+
+JuneTest(smallStructuresFreeInline) {
+  gc::reclaim(0);
+  VarBase *vec = nested(10, 10);
+  varDref(vec);
+  Expect(!gc::deferred());
+}
+
+JuneTest(budgetSpansTheChain) {
+  // every inner vector fits the budget on its own, all of them do not
+  gc::reclaim(0);
+  VarBase *vec = nested(1000, 1000);
+  varDref(vec);
+  Expect(gc::deferred());
+  // the outer vector frees its 1000 vectors, the first of them what is left
+  ExpectEq(gc::reclaim(0), 1000 * 1000 - (gc::kFreeBudget - 1000));
+}
+
+JuneTest(reclaimBatchesShareTheBudget) {
+  // four vectors each holding a vector of a budget of integers
+  gc::reclaim(0);
+  std::vector<VarBase *> vecs;
+  for (size_t i = 0; i < 4; i++)
+    vecs.push_back(nested(1, gc::kFreeBudget));
+  VarBase *outer = new VarVec(vecs, false, 0, 0);
+  // the first inner vector frees what the chain has left of its integers and
+  // queues the rest, the three others are queued whole
+  varDref(outer);
+  // a batch of the last queued: an integer and those three vectors, the first
+  // of which spends the budget of the batch
+  ExpectEq(gc::reclaim(4), 4);
+  ExpectEq(gc::reclaim(0), 4 + 2 * gc::kFreeBudget);
+}
+
+// a vector holding a reference to itself, and held by nothing else
+static VarVec *selfReferencing() {
+  VarVec *vec = new VarVec(std::vector<VarBase *>(), true, 0, 0);
+  vec->get().push_back(vec);
+  return vec;
+}
+
+// a vector holding itself, bound as is rather than copied so the binding holds
+// the cycle
+static VarBase *cyclic(State &vm, const FnData &fd) {
+  VarVec *vec = selfReferencing();
+  vec->setLoadAsRef();
+  return vec;
+}
+
+// the length of the vector it is given
+static VarBase *size(State &vm, const FnData &fd) {
+  return make_all<VarInt>((long long)AsVec(fd.args[1])->get().size(),
+                          fd.srcId, fd.idx);
+}
+
+JuneTest(reclaimsSelfReferencingVec) {
+  gc::collect();
+  VarVec *vec = selfReferencing();
+  varIref(vec);
+  ExpectEq(gc::collect().reclaimed, 0);
+  varDref(vec);
+  ExpectEq(gc::collect().reclaimed, 1);
+}
+
+JuneTest(reclaimsModuleFunctionCycle) {
+  // `fn f() { loop { return mod } }` bound in `mod`, the loop cached the
+  // module it found
+  gc::collect();
+  SrcFile *file = new SrcFile(".", "mod.june", false);
+  test::assemble(file->bytecode(), R"(
+BodyMarker 7
+BlkA 1
+PushLoop
+Load Ident mod
+Return true
+PopLoop
+Return false
+)");
+  test::load(file->bytecode());
+  // entered at module level, as running the source leaves it
+  Vars *vars = new Vars();
+  vars->pushFn();
+  VarSrc *mod = new VarSrc(file, vars, file->id(), 0);
+  mod->addNativeVar("f",
+                    new VarFunc("mod.june", "", {}, {.june = {1, 7}}, false,
+                                file->id(), 0),
+                    false);
+  LookupCache *cache = file->bytecode().lookupCache(3);
+  if (!Expect(cache != nullptr)) {
+    varDref(mod);
+    return;
+  }
+  varIref(mod);
+  cache->val = mod;
+  varDref(mod);
+  ExpectEq(gc::collect().reclaimed, 1);
+}
+
+// runs `print(size(...))` around `code`, which leaves a cyclic vector on the
+// stack that the binding it was loaded from no longer holds. Every op that
+// may collect does so
+static std::string survivesCollection(const char *code) {
+  gc::collect();
+  gc::setThreshold(1);
+  test::Program prog;
+  prog.vm().globalAdd("cyclic",
+                      new VarFunc("gc.june", "", {}, {.native = cyclic}, true,
+                                  0, 0),
+                      false);
+  prog.vm().globalAdd("size",
+                      new VarFunc("gc.june", "", {""}, {.native = size}, true,
+                                  0, 0),
+                      false);
+  std::string listing = std::string(R"(
+Load Ident print
+Load Ident size
+)") + code + R"(
+Call 00
+Call 00
+Unload
+)";
+  SrcFile *src = prog.source("gc.june", listing.c_str());
+  test::load(src->bytecode());
+  Expect(prog.run(src));
+  gc::setThreshold(gc::kThresholdDefault);
+  return test::output();
+}
+
+JuneTest(borrowedSurviveBlockExit) {
+  // binding a copy of `v` to `w` allocates, so leaving the block collects
+  ExpectEq(survivesCollection(R"(
+BlkA 1
+Load Ident cyclic
+Call 0
+Load String v
+Create false
+Load Ident v
+Load Ident v
+Load String w
+Create false
+BlkR 1
+)"),
+           "1\n");
+}
+
+JuneTest(borrowedSurviveReturn) {
+  // `fn f() { v = cyclic(); w = v; return v }`, binding the copy allocates so
+  // the call collects once it returned
+  ExpectEq(survivesCollection(R"(
+BodyMarker 13
+BlkA 1
+Load Ident cyclic
+Call 0
+Load String v
+Create false
+Load Ident v
+Load String w
+Create false
+Load Ident v
+Return true
+MakeFunc 0
+Load String f
+Create false
+Load Ident f
+Call 0
+)"),
+           "1\n");
+}
+
+int main() { return test::run(); }
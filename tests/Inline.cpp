@@ -0,0 +1,307 @@
+#include "Test.hpp"
+
+#include "VM/Passes.hpp"
+
+using namespace june;
+
+// inlines the calls of the ops of `code`, gets how many were
+static size_t inlined(Bytecode &bc) {
+  passes::Manager manager;
+  manager.add(passes::inlineCalls());
+  manager.run(bc);
+  test::load(bc);
+  return manager.stats(0).rewritten;
+}
+
+static size_t inlined(const char *code) {
+  Bytecode bc;
+  test::assemble(bc, code);
+  return inlined(bc);
+}
+
+// runs the ops of `code` as they are, then with calls inlined, the output
+// must be the same
+static std::string runBoth(const char *code, const size_t &calls) {
+  std::string out[2];
+  for (int inlining = 0; inlining < 2; inlining++) {
+    test::Program prog;
+    SrcFile *src = prog.source("inline.june", code);
+    if (inlining)
+      ExpectEq(inlined(src->bytecode()), calls);
+    else
+      test::load(src->bytecode());
+    Expect(prog.run(src));
+    out[inlining] = test::output();
+  }
+  ExpectEq(out[1], out[0]);
+  return out[1];
+}
+
+// `fn sel(a) { if a { return 1 } return 2 }`
+#define SEL                                                                    \
+  "Load String a\n"                                                            \
+  "BodyMarker 9\n"                                                             \
+  "BlkA 1\n"                                                                   \
+  "Load Ident a\n"                                                             \
+  "JumpFalsePop 7\n"                                                           \
+  "Load Int 1\n"                                                               \
+  "Return true\n"                                                              \
+  "Load Int 2\n"                                                               \
+  "Return true\n"                                                              \
+  "MakeFunc 00\n"                                                              \
+  "Load String sel\n"                                                          \
+  "Create false\n"
+
+JuneTest(remapsJumpsAndReturns) {
+  ExpectEq(runBoth(SEL R"(
+Load Ident print
+Load Ident sel
+Load true
+Call 00
+Load Ident sel
+Load false
+Call 00
+Load Ident sel
+Load true
+Call 00
+Call 0000
+Unload
+)",
+                   3),
+           "1 2 1\n");
+}
+
+JuneTest(fallsBackOnceRebound) {
+  // natives do not have the body that was copied
+  static NativeFnPtr answer = [](State &vm, const FnData &fd) -> VarBase * {
+    return make_all<VarInt>(42, fd.srcId, fd.idx);
+  };
+  static NativeFnPtr rebind = [](State &vm, const FnData &fd) -> VarBase * {
+    vm.currentSource()->addNativeVar(
+        "sel", new VarFunc("inline.june", "", {""}, {.native = answer}, true, 0,
+                           0),
+        false, true);
+    return vm.nil;
+  };
+
+  test::Program prog;
+  SrcFile *src = prog.source("inline.june", SEL R"(
+Load Ident print
+Load Ident sel
+Load false
+Call 00
+Call 00
+Unload
+Load Ident rebind
+Call 0
+Unload
+Load Ident print
+Load Ident sel
+Load false
+Call 00
+Call 00
+Unload
+)");
+  ExpectEq(inlined(src->bytecode()), 2);
+  prog.vm().globalAdd("rebind",
+                      new VarFunc("inline.june", "", {}, {.native = rebind},
+                                  true, 0, 0),
+                      false);
+  Expect(prog.run(src));
+  ExpectEq(test::output(), "2\n42\n");
+}
+
+JuneTest(argumentsFailFirst) {
+  // `pick(false, missing)` fails loading `missing`, whether or not `pick`
+  // would use it
+  const char *code = R"(
+Load String a
+Load String b
+BodyMarker 10
+BlkA 1
+Load Ident a
+JumpFalsePop 8
+Load Ident b
+Return true
+Load Int 0
+Return true
+MakeFunc 000
+Load String pick
+Create false
+Load Ident print
+Load Ident pick
+Load false
+Load Ident missing
+Call 000
+Call 00
+Unload
+)";
+  test::Program prog;
+  SrcFile *src = prog.source("inline.june", code);
+  ExpectEq(inlined(src->bytecode()), 0);
+  Expect(!prog.run(src));
+  ExpectEq(test::output(), "");
+}
+
+JuneTest(branchesOnJumpFalse) {
+  // `fn f(a)` gets `a` when it holds and 0 otherwise, OpJumpFalse pops the
+  // tested value where it jumps and leaves it to return where it falls
+  // through
+  ExpectEq(runBoth(R"(
+Load String a
+BodyMarker 8
+BlkA 1
+Load Ident a
+JumpFalse 6
+Return true
+Load Int 0
+Return true
+MakeFunc 00
+Load String f
+Create false
+Load Ident print
+Load Ident f
+Load true
+Call 00
+Load Ident f
+Load false
+Call 00
+Call 000
+Unload
+)",
+                   2),
+           "0 true\n");
+}
+
+JuneTest(rejectsUnbalancedJumpFalse) {
+  // returns two values when `a` holds and none when it does not
+  ExpectEq(inlined(R"(
+Load String a
+BodyMarker 8
+BlkA 1
+Load Ident a
+JumpFalse 7
+Load Int 1
+Return true
+Return true
+MakeFunc 00
+Load String f
+Create false
+Load Ident f
+Load Int 1
+Call 00
+Unload
+)"),
+           0);
+}
+
+JuneTest(rejectsReorderedOrRepeatedParams) {
+  // `fn f(a, b)` loading `b` first would evaluate the arguments out of order
+  ExpectEq(inlined(R"(
+Load String a
+Load String b
+BodyMarker 8
+BlkA 1
+Load Ident b
+Load Ident a
+Unload
+Return true
+MakeFunc 000
+Load String f
+Create false
+Load Ident f
+Load Ident x
+Load Ident y
+Call 000
+Unload
+)"),
+           0);
+  // and loading `a` twice would evaluate it twice
+  ExpectEq(inlined(R"(
+Load String a
+BodyMarker 7
+BlkA 1
+Load Ident a
+Load Ident a
+Unload
+Return true
+MakeFunc 00
+Load String f
+Create false
+Load Ident f
+Load Ident x
+Call 00
+Unload
+)"),
+           0);
+}
+
+JuneTest(rejectsRecursion) {
+  // `fn f(a) { return f(a) }`
+  ExpectEq(inlined(R"(
+Load String a
+BodyMarker 7
+BlkA 1
+Load Ident f
+Load Ident a
+Call 00
+Return true
+MakeFunc 00
+Load String f
+Create false
+Load Ident f
+Load Int 1
+Call 00
+Unload
+)"),
+           0);
+}
+
+JuneTest(rejectsLoops) {
+  ExpectEq(inlined(R"(
+Load String a
+BodyMarker 9
+BlkA 1
+Load Ident a
+Unload
+PushLoop
+Break 7
+PopLoop
+Return false
+MakeFunc 00
+Load String f
+Create false
+Load Ident f
+Load Int 1
+Call 00
+Unload
+)"),
+           0);
+}
+
+JuneTest(rejectsOrRegions) {
+  // `fn f(a) { a; return y or 0 }`
+  ExpectEq(inlined(R"(
+Load String a
+BodyMarker 11
+BlkA 1
+Load Ident a
+Unload
+PushJump 9
+Load Ident y
+PopJump
+Return true
+Load Int 0
+Return true
+MakeFunc 00
+Load String f
+Create false
+Load Ident f
+Load Int 1
+Call 00
+Unload
+)"),
+           0);
+}
+
+int main() { return test::run(); }
@@ -0,0 +1,158 @@
+#include "Test.hpp"
+
+using namespace june;
+
+// true for the first three calls of each test
+static size_t turns = 0;
+static VarBase *more(State &vm, const FnData &fd) {
+  return ++turns <= 3 ? vm.tru : vm.fals;
+}
+
+// true within the first turn only
+static VarBase *first(State &vm, const FnData &fd) {
+  return turns == 1 ? vm.tru : vm.fals;
+}
+
+JuneTest(rebindFromAnotherModule) {
+  test::Program prog;
+  // fn value() { return 1 }
+  // fn callValue() { loop { return value() } }
+  SrcFile *mod = prog.source("mod.june", R"(
+BodyMarker 4
+BlkA 1
+Load Int 1
+Return true
+MakeFunc 0
+Load String value
+Create false
+BodyMarker 15
+BlkA 1
+PushLoop
+Load Ident value
+Call 0
+Return true
+PopLoop
+Return false
+MakeFunc 0
+Load String callValue
+Create false
+)");
+  test::load(mod->bytecode());
+  Expect(prog.run(mod));
+
+  // while more() {
+  //   print(mod.value(), mod.callValue())
+  //   if first() { fn mod.value() { return 2 } }
+  // }
+  SrcFile *main = prog.source("main.june", R"(
+PushLoop
+Load Ident more
+Call 0
+JumpFalsePop 25
+Load Ident print
+Load Ident mod
+Load String value
+MemberCall 0
+Load Ident mod
+Load String callValue
+MemberCall 0
+Call 000
+Unload
+Load Ident first
+Call 0
+JumpFalsePop 24
+BodyMarker 20
+BlkA 1
+Load Int 2
+Return true
+MakeFunc 0
+Load Ident mod
+Load String value
+Create true
+Continue 1
+PopLoop
+)");
+  test::load(main->bytecode());
+  // the lookups of both loops are cached
+  Expect(main->bytecode().lookupCache(7) != nullptr);
+  Expect(mod->bytecode().lookupCache(10) != nullptr);
+
+  turns = 0;
+  prog.vm().globalAdd("more",
+                      new VarFunc("main.june", "", {}, {.native = more}, true,
+                                  0, 0),
+                      false);
+  prog.vm().globalAdd("first",
+                      new VarFunc("main.june", "", {}, {.native = first}, true,
+                                  0, 0),
+                      false);
+  prog.vm().globalAdd("mod", prog.module(mod));
+  Expect(prog.run(main));
+  ExpectEq(test::output(), "1 1\n2 2\n2 2\n");
+}
+
+JuneTest(otherModulesKeepCaches) {
+  // bindings at module level only invalidate the lookups of that module
+  test::Program prog;
+  SrcFile *mod = prog.source("mod.june", R"(
+Load Int 1
+Load String value
+Create false
+)");
+  Expect(prog.run(mod));
+  size_t epoch = prog.module(mod)->vars()->epoch();
+
+  SrcFile *main = prog.source("main.june", R"(
+Load Int 2
+Load String other
+Create false
+)");
+  Expect(prog.run(main));
+  ExpectEq(prog.module(mod)->vars()->epoch(), epoch);
+  Expect(prog.module(main)->vars()->epoch() != 0);
+}
+
+JuneTest(cacheHoldsItsValue) {
+  // what a loop found stays alive while it is cached, even once unbound
+  test::Program prog;
+  SrcFile *mod = prog.source("mod.june", R"(
+Load String x
+Load String value
+Create false
+)");
+  Expect(prog.run(mod));
+
+  SrcFile *main = prog.source("main.june", R"(
+PushLoop
+Load Ident more
+Call 0
+JumpFalsePop 10
+Load Ident print
+Load Ident mod
+Attr value
+Call 00
+Unload
+Continue 1
+PopLoop
+)");
+  test::load(main->bytecode());
+  turns = 0;
+  prog.vm().globalAdd("more",
+                      new VarFunc("main.june", "", {}, {.native = more}, true,
+                                  0, 0),
+                      false);
+  prog.vm().globalAdd("mod", prog.module(mod));
+  Expect(prog.run(main));
+  ExpectEq(test::output(), "x\nx\nx\n");
+
+  LookupCache *cache = main->bytecode().lookupCache(6);
+  if (Expect(cache != nullptr && cache->val != nullptr)) {
+    VarBase *val = cache->val;
+    prog.module(mod)->vars()->rem("value", true);
+    ExpectEq(val->refCount(), 1);
+    main->bytecode().dropCached();
+    Expect(cache->val == nullptr);
+  }
+}
+
+int main() { return test::run(); }
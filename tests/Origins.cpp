@@ -0,0 +1,62 @@
+#include "Test.hpp"
+
+#include <thread>
+
+using namespace june;
+
+JuneTest(internsAcrossChunks) {
+  // past the first few chunks of the table, each origin reads back
+  std::vector<std::uint32_t> interned;
+  for (size_t i = 0; i < 5000; i++)
+    interned.push_back(origins::intern(1000 + i % 7, i));
+  size_t same = 0;
+  for (size_t i = 0; i < interned.size(); i++) {
+    size_t srcId, idx;
+    origins::get(interned[i], srcId, idx);
+    same += srcId == 1000 + i % 7 && idx == i;
+  }
+  ExpectEq(same, interned.size());
+  ExpectEq(origins::intern(1000, 0), interned[0]);
+  size_t srcId = 1, idx = 1;
+  origins::get(0, srcId, idx);
+  Expect(srcId == 0 && idx == 0);
+}
+
+JuneTest(readsWhileInterning) {
+  // readers of origins interned already see them as new ones are added
+  std::vector<std::uint32_t> first;
+  for (size_t i = 0; i < 100; i++)
+    first.push_back(origins::intern(2000, i));
+
+  std::atomic<bool> done(false);
+  std::atomic<size_t> wrong(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&]() {
+      while (!done.load()) {
+        for (size_t i = 0; i < first.size(); i++) {
+          size_t srcId, idx;
+          origins::get(first[i], srcId, idx);
+          if (srcId != 2000 || idx != i)
+            wrong++;
+        }
+      }
+    });
+  }
+  std::thread writer([&]() {
+    for (size_t i = 0; i < 20000; i++) {
+      std::uint32_t origin = origins::intern(3000, i);
+      size_t srcId, idx;
+      origins::get(origin, srcId, idx);
+      if (srcId != 3000 || idx != i)
+        wrong++;
+    }
+  });
+  writer.join();
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  ExpectEq(wrong.load(), 0);
+}
+
+int main() { return test::run(); }
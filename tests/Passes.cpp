@@ -0,0 +1,277 @@
+#include "Test.hpp"
+
+#include "VM/Passes.hpp"
+
+using namespace june;
+
+// runs `pass` alone over the ops of `code`, to a fixed point, and gets the ops
+// left with what the pass did
+static std::string optimize(std::unique_ptr<passes::Pass> pass,
+                            const char *code, passes::Stats &stats) {
+  Bytecode bc;
+  test::assemble(bc, code);
+  passes::Manager manager;
+  manager.add(std::move(pass));
+  manager.run(bc);
+  stats = manager.stats(0);
+  return test::listing(bc);
+}
+
+JuneTest(constantConditionsFoldBranch) {
+  passes::Stats stats;
+  ExpectEq(optimize(passes::constantConditions(), R"(
+Load true
+JumpFalsePop 4
+Load Int 1
+Jump 5
+Load Int 2
+Unload
+)",
+                    stats),
+           R"(Load Int 1
+Jump 3
+Load Int 2
+Unload
+)");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 2);
+}
+
+JuneTest(constantConditionsKeepValue) {
+  // the value is kept where the interpreter keeps it: a taken OpJumpTrue
+  // leaves it, a taken OpJumpFalse or OpJumpNil drops it. Other constants go
+  // through `toBool`, and jumps something jumps to stay
+  passes::Stats stats;
+  ExpectEq(optimize(passes::constantConditions(), R"(
+Load true
+JumpTrue 3
+Unload
+Load false
+JumpFalse 6
+Unload
+Load nil
+JumpNil 9
+Unload
+Load Int 1
+JumpFalsePop 12
+Load true
+JumpTruePop 13
+Return false
+)",
+                    stats),
+           R"(Load true
+Jump 3
+Unload
+Jump 5
+Unload
+Jump 7
+Unload
+Load Int 1
+JumpFalsePop 10
+Load true
+JumpTruePop 11
+Return false
+)");
+  ExpectEq(stats.rewritten, 3);
+  ExpectEq(stats.removed, 2);
+}
+
+JuneTest(constantConditionsRunAlike) {
+  // `print(7)` with a condition folded away between its arguments
+  const char *code = R"(
+Load Ident print
+Load Int 7
+Load false
+JumpFalse 4
+Call 00
+Unload
+)";
+  for (int folded = 0; folded < 2; folded++) {
+    test::Program prog;
+    SrcFile *src = prog.source("fold.june", code);
+    if (folded) {
+      passes::Manager manager;
+      manager.add(passes::constantConditions());
+      manager.run(src->bytecode());
+    }
+    Expect(prog.run(src));
+    ExpectEq(test::output(), "7\n");
+  }
+}
+
+JuneTest(jumpThreadingChains) {
+  passes::Stats stats;
+  ExpectEq(optimize(passes::jumpThreading(), R"(
+Load Int 1
+JumpTruePop 4
+Load Int 2
+Unload
+Jump 6
+Unload
+Jump 7
+Return false
+)",
+                    stats),
+           R"(Load Int 1
+JumpTruePop 6
+Load Int 2
+Unload
+Jump 6
+Unload
+Return false
+)");
+  ExpectEq(stats.rewritten, 2);
+  ExpectEq(stats.removed, 1);
+}
+
+JuneTest(jumpThreadingEndlessLoop) {
+  // jumps only to each other, the hops are bounded
+  passes::Stats stats;
+  ExpectEq(optimize(passes::jumpThreading(), R"(
+Jump 1
+Jump 0
+)",
+                    stats),
+           "Jump 0\n");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 1);
+}
+
+JuneTest(deadCodeUnreached) {
+  passes::Stats stats;
+  ExpectEq(optimize(passes::deadCode(), R"(
+Load Int 1
+JumpTruePop 5
+Load Int 2
+Return true
+Jump 7
+Load Int 3
+Return true
+Load nil
+Return true
+)",
+                    stats),
+           R"(Load Int 1
+JumpTruePop 4
+Load Int 2
+Return true
+Load Int 3
+Return true
+)");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 3);
+}
+
+JuneTest(deadCodeKeepsMarkers) {
+  // `or` regions are paired by position and bodies are functions of their own,
+  // their markers stay even if never reached
+  passes::Stats stats;
+  ExpectEq(optimize(passes::deadCode(), R"(
+Load Int 1
+Return true
+PushJump 5
+Load Int 2
+PopJump
+BodyMarker 8
+Load Int 3
+Return true
+MakeFunc 0
+Unload
+)",
+                    stats),
+           R"(Load Int 1
+Return true
+PushJump 4
+PopJump
+BodyMarker 7
+Load Int 3
+Return true
+)");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 3);
+}
+
+JuneTest(unusedLoadsConstants) {
+  // loading a name may fail, and an unload something jumps to is reached
+  // without the load before it
+  passes::Stats stats;
+  ExpectEq(optimize(passes::unusedLoads(), R"(
+Load Int 1
+Unload
+Load Ident x
+Unload
+Load Int 2
+Jump 7
+Load Int 3
+Unload
+Load nil
+Unload
+)",
+                    stats),
+           R"(Load Ident x
+Unload
+Load Int 2
+Jump 5
+Load Int 3
+Unload
+)");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 4);
+}
+
+JuneTest(emptyBlocksNested) {
+  // the first block takes what a call stashed, and the last one binds a name
+  passes::Stats stats;
+  ExpectEq(optimize(passes::emptyBlocks(), R"(
+BlkA 1
+Load Int 1
+Load String a
+Create false
+BlkA 1
+Load Ident a
+Unload
+BlkR 1
+BlkA 1
+Load Int 2
+Load String b
+Create false
+BlkR 1
+BlkR 1
+)",
+                    stats),
+           R"(BlkA 1
+Load Int 1
+Load String a
+Create false
+Load Ident a
+Unload
+BlkA 1
+Load Int 2
+Load String b
+Create false
+BlkR 1
+BlkR 1
+)");
+  ExpectEq(stats.rewritten, 0);
+  ExpectEq(stats.removed, 2);
+}
+
+JuneTest(emptyBlocksAfterBranch) {
+  // a block opened where a jump lands may be the first on that path
+  passes::Stats stats;
+  const char *code = R"(
+BlkA 1
+Load true
+JumpTruePop 4
+Load Int 1
+BlkA 1
+Load Ident a
+Unload
+BlkR 1
+BlkR 1
+)";
+  ExpectEq(optimize(passes::emptyBlocks(), code, stats), code + 1);
+  ExpectEq(stats.removed, 0);
+}
+
+int main() { return test::run(); }
@@ -0,0 +1,93 @@
+#include "Test.hpp"
+
+#include <unistd.h>
+
+#include "VM/StringArena.hpp"
+
+using namespace june;
+
+JuneTest(storesEachStringOnce) {
+  StringArena arena;
+  std::string a = "name", b = "name";
+  const char *stored = arena.intern(a.c_str());
+  Expect(stored != a.c_str());
+  Expect(arena.intern(b.c_str()) == stored);
+  // a string of the arena is its own copy
+  Expect(arena.intern(stored) == stored);
+  Expect(arena.intern("other") != stored);
+  ExpectEq(arena.size(), 2);
+  ExpectEq(arena.bytes(), 11);
+}
+
+JuneTest(longStringsGetABlockEach) {
+  StringArena arena;
+  const char *first = arena.intern("a");
+  // one past a quarter of a block with its terminator
+  std::string big(StringArena::kBlockSize / 4, 'x');
+  const char *own = arena.intern(big.c_str());
+  ExpectEq(std::string(own), big);
+  Expect(arena.intern(std::string(big).c_str()) == own);
+  // the block being filled keeps its free space
+  const char *second = arena.intern("b");
+  Expect(second == first + 2);
+  // a quarter of a block is still packed
+  std::string quarter(StringArena::kBlockSize / 4 - 1, 'y');
+  Expect(arena.intern(quarter.c_str()) == second + 2);
+  ExpectEq(arena.bytes(), 4 + big.size() + quarter.size() + 2);
+}
+
+JuneTest(mappedOperandsStayBorrowed) {
+  Bytecode bc;
+  test::assemble(bc, R"(
+Load Ident print
+Load String mapped
+Call 00
+Unload
+)");
+  char path[] = "/tmp/june-arenaXXXXXX";
+  int fd = mkstemp(path);
+  bool written = Expect(fs::writeBytecode(fd, bc.get(), LineTable()).isOk());
+  close(fd);
+  auto mapRes = fs::MappedFile::open(path);
+  unlink(path);
+  if (!written || !Expect(mapRes.isOk()))
+    return;
+  std::shared_ptr<const fs::MappedFile> file = mapRes.unwrap();
+  fs::ReadResult read = fs::readBytecode(file->data(), file->size());
+  if (!Expect(read.isOk()))
+    return;
+  fs::ValidRead &valid = read.unwrap();
+  Bytecode loaded;
+  loaded.assign(std::move(valid.bytecode), file, std::move(valid.consts),
+                std::move(valid.pending));
+  const char *print = loaded.get()[0].data.s;
+  const char *mapped = loaded.get()[1].data.s;
+  Expect(file->contains(print) && file->contains(mapped));
+
+  // `print(mapped, mapped, fresh)`: a copy of a loaded op keeps pointing
+  // into the file, an operand from elsewhere is interned
+  std::string fresh = "fresh";
+  Op copied = loaded.get()[1];
+  Op added = copied;
+  added.data.s = &fresh[0];
+  Op call = loaded.get()[2];
+  call.data.s = (char *)"000";
+  std::vector<bool> dead(loaded.size(), false);
+  dead[2] = true;
+  if (!Expect(loaded.rewrite(dead, {{2, {copied, added, call}, {}}})))
+    return;
+  ExpectEq(test::listing(loaded), "Load Ident print\n"
+                                  "Load String mapped\n"
+                                  "Load String mapped\n"
+                                  "Load String fresh\n"
+                                  "Call 000\n"
+                                  "Unload\n");
+  const std::vector<Op> &ops = loaded.get();
+  Expect(ops[0].data.s == print && ops[1].data.s == mapped);
+  Expect(ops[2].data.s == mapped);
+  Expect(!file->contains(ops[3].data.s) && ops[3].data.s != fresh.c_str());
+  Expect(loaded.intern("fresh") == ops[3].data.s);
+  Expect(!file->contains(ops[4].data.s));
+}
+
+int main() { return test::run(); }
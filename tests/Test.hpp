@@ -0,0 +1,251 @@
+#ifndef tests_test_hpp
+#define tests_test_hpp
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "VM/OpCodes.hpp"
+#include "VM/State.hpp"
+
+namespace june {
+
+namespace test {
+
+struct Case {
+  const char *name;
+  void (*fn)();
+};
+
+inline std::vector<Case> &cases() {
+  static std::vector<Case> all;
+  return all;
+}
+
+inline size_t &failures() {
+  static size_t count = 0;
+  return count;
+}
+
+struct Register {
+  Register(const char *name, void (*fn)()) { cases().push_back({name, fn}); }
+};
+
+inline bool expect(const bool &ok, const char *what, const char *file,
+                   const int &line) {
+  if (!ok) {
+    fprintf(stderr, "%s:%d: expected %s\n", file, line, what);
+    failures()++;
+  }
+  return ok;
+}
+
+// listings are shown rather than the expressions making them
+inline bool expectEq(const std::string &got, const std::string &want,
+                     const char *what, const char *file, const int &line) {
+  if (got != want) {
+    fprintf(stderr, "%s:%d: unexpected value\n--- got:\n%s\n--- want:\n%s\n",
+            file, line, got.c_str(), want.c_str());
+    failures()++;
+  }
+  return got == want;
+}
+
+inline bool expectEq(const size_t &got, const size_t &want, const char *what,
+                     const char *file, const int &line) {
+  if (got != want) {
+    fprintf(stderr, "%s:%d: expected %s, got %zu, want %zu\n", file, line,
+            what, got, want);
+    failures()++;
+  }
+  return got == want;
+}
+
+/// @brief Runs every test of the executable, the result is its exit status.
+inline int run() {
+  for (auto &c : cases()) {
+    size_t before = failures();
+    c.fn();
+    printf("%s %s\n", failures() == before ? "ok  " : "FAIL", c.name);
+  }
+  return failures() == 0 ? 0 : 1;
+}
+
+/// @brief Writes `ops` one per line in the form `assemble` reads, string
+///        operands are written as is, and must not hold newlines.
+inline std::string listing(const std::vector<Op> &ops) {
+  std::ostringstream out;
+  for (auto &op : ops) {
+    out << OpCodeStrs[op.op];
+    switch (op.type) {
+    case OdtSize:
+      out << ' ' << op.data.sz;
+      break;
+    case OdtBool:
+      out << (op.data.b ? " true" : " false");
+      break;
+    case OdtNil:
+      if (op.op == OpLoad)
+        out << " nil";
+      break;
+    default:
+      if (op.op == OpLoad)
+        out << ' ' << OpDataTypeStrs[op.type];
+      out << ' ' << op.data.s;
+    }
+    out << '\n';
+  }
+  return out.str();
+}
+
+inline std::string listing(const Bytecode &bc) { return listing(bc.get()); }
+
+/// @brief Appends the ops written one per line in `code` to `bc`, as
+///        `<op> [operand]` where the op is named as in `OpCodeStrs`. Loads
+///        name the type of their constant (`Load Int 5`, `Load Ident x`) but
+///        for `true`, `false` and `nil`. Empty lines and `;` comments are
+///        skipped, each op takes the line it is written on as its `idx`.
+inline void assemble(Bytecode &bc, const char *code) {
+  std::istringstream in(code);
+  std::string line;
+  for (size_t idx = 0; std::getline(in, line); idx++) {
+    size_t comment = line.find(';');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream words(line);
+    std::string name, arg;
+    if (!(words >> name))
+      continue;
+    std::getline(words >> std::ws, arg);
+    while (!arg.empty() && arg.back() == ' ')
+      arg.pop_back();
+
+    size_t op = 0;
+    while (op < _OpLast && name != OpCodeStrs[op])
+      op++;
+    if (op == _OpLast) {
+      fprintf(stderr, "unknown op '%s' on line %zu\n", name.c_str(), idx + 1);
+      abort();
+    }
+    OpCodes code = (OpCodes)op;
+
+    if (code == OpLoad) {
+      if (arg == "nil") {
+        bc.add(idx, code);
+      } else if (arg == "true" || arg == "false") {
+        bc.addb(idx, code, arg == "true");
+      } else {
+        size_t type = 0, space = arg.find(' ');
+        std::string typeName = arg.substr(0, space);
+        while (type < OdtSize && typeName != OpDataTypeStrs[type])
+          type++;
+        if (type == OdtSize || space == std::string::npos) {
+          fprintf(stderr, "bad load '%s' on line %zu\n", arg.c_str(), idx + 1);
+          abort();
+        }
+        bc.adds(idx, code, (OpDataType)type, arg.substr(space + 1));
+      }
+    } else if (hasOpTarget(code) || code == OpBlkA || code == OpBlkR) {
+      bc.addsz(idx, code, strtoull(arg.c_str(), nullptr, 10));
+    } else if (code == OpCreate || code == OpReturn) {
+      bc.addb(idx, code, arg == "true");
+    } else if (arg.empty()) {
+      bc.add(idx, code);
+    } else {
+      bc.adds(idx, code, OdtString, arg);
+    }
+  }
+}
+
+/// @brief Finishes loading `bc` as sources are, its handler table is built
+///        and its ops verified.
+inline void load(Bytecode &bc) {
+  bc.buildHandlers();
+  bc.verify();
+}
+
+/// @brief What the `print` global of a `Program` wrote.
+inline std::string &output() {
+  static std::string out;
+  return out;
+}
+
+// writes its arguments separated by spaces, and a newline
+inline VarBase *print(State &vm, const FnData &fd) {
+  std::string &out = output();
+  for (size_t i = 1; i < fd.args.size(); i++) {
+    VarBase *arg = fd.args[i];
+    if (i > 1)
+      out += ' ';
+    if (arg->isa<VarInt>())
+      out += std::to_string(AsInt(arg)->get());
+    else if (arg->isa<VarString>())
+      out += AsString(arg)->view();
+    else if (arg->isa<VarBool>())
+      out += AsBool(arg)->get() ? "true" : "false";
+    else if (arg->isa<VarNil>())
+      out += "nil";
+    else
+      out += "<" + vm.getTypeName(arg) + ">";
+  }
+  out += '\n';
+  return vm.nil;
+}
+
+/// @brief A VM with a `print` global writing to `output`, running sources
+///        assembled from listings.
+class Program {
+  State _vm;
+
+public:
+  Program() : _vm("june", ".", {}) {
+    output().clear();
+    _vm.globalAdd("print",
+                  new VarFunc("test.june", ".", {}, {.native = print}, true, 0,
+                              0),
+                  false);
+  }
+
+  inline State &vm() { return _vm; }
+
+  /// @brief Creates the source `path` holding the ops of `code`, neither
+  ///        loaded nor verified. The module owns it once it ran.
+  SrcFile *source(const std::string &path, const char *code) {
+    SrcFile *src = new SrcFile(".", path, _vm.allSrcs.empty());
+    assemble(src->bytecode(), code);
+    for (auto &op : src->bytecode().getMut())
+      op.srcId = src->id();
+    return src;
+  }
+
+  /// @brief Runs `src` from its first op, leaving its module loaded. Its
+  ///        handler table is built if it was not.
+  bool run(SrcFile *src) {
+    src->bytecode().buildHandlers();
+    _vm.pushSrc(src, 0);
+    bool ok = vm::exec(_vm).isOk();
+    _vm.popSrc();
+    return ok;
+  }
+
+  /// @brief Gets the module of a source that ran.
+  inline VarSrc *module(SrcFile *src) { return _vm.srcById(src->id()); }
+};
+
+} // namespace test
+
+} // namespace june
+
+#define JuneTest(name)                                                         \
+  static void name();                                                          \
+  static june::test::Register name##Registered(#name, name);                   \
+  static void name()
+
+#define Expect(cond) june::test::expect((cond), #cond, __FILE__, __LINE__)
+#define ExpectEq(got, want)                                                    \
+  june::test::expectEq((got), (want), #got " == " #want, __FILE__, __LINE__)
+
+#endif
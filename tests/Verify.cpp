@@ -0,0 +1,118 @@
+#include "Test.hpp"
+
+#include "VM/Verify.hpp"
+
+using namespace june;
+
+// runs `code` through the checked interpreter, then loaded and verified; both
+// must write the same and succeed alike. Gets whether the top level passed
+// the verifier
+static bool agree(const char *code, const bool &ok) {
+  std::string out;
+  for (int verified = 0; verified < 2; verified++) {
+    test::Program prog;
+    SrcFile *src = prog.source("verify.june", code);
+    if (verified)
+      test::load(src->bytecode());
+    ExpectEq(prog.run(src), ok);
+    if (verified)
+      ExpectEq(test::output(), out);
+    out = test::output();
+  }
+  Bytecode bc;
+  test::assemble(bc, code);
+  test::load(bc);
+  size_t depth = 0;
+  return bc.verifiedDepth(0, depth);
+}
+
+JuneTest(jumpFalsePopsWhenTaken) {
+  // `print(0)` whichever way the condition goes
+  const char *code = R"(
+Load Ident print
+Load Int 0
+Load %s
+JumpFalse 5
+Unload
+Call 00
+Unload
+)";
+  for (const char *cond : {"true", "false"}) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), code, cond);
+    Expect(agree(buf, true));
+    ExpectEq(test::output(), "0\n");
+  }
+}
+
+JuneTest(jumpFalseKeepsOnFallThrough) {
+  // the taken jump leaves `print` alone on the stack, the call underflows
+  Expect(!agree(R"(
+Load Ident print
+Load false
+JumpFalse 5
+Load Int 1
+Jump 5
+Call 00
+Unload
+)",
+                false));
+  ExpectEq(test::output(), "");
+}
+
+JuneTest(jumpTrueKeepsWhenTaken) {
+  // `print(cond or 1)`
+  const char *code = R"(
+Load Ident print
+Load %s
+JumpTrue 4
+Load Int 1
+Call 00
+Unload
+)";
+  const char *conds[] = {"true", "false"};
+  const char *outs[] = {"true\n", "1\n"};
+  for (int i = 0; i < 2; i++) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), code, conds[i]);
+    Expect(agree(buf, true));
+    ExpectEq(test::output(), outs[i]);
+  }
+}
+
+JuneTest(jumpNilPopsWhenTaken) {
+  // `print(x ?? 2)` for a nil `x`
+  Expect(agree(R"(
+Load Ident print
+Load nil
+JumpNil 4
+Jump 5
+Load Int 2
+Call 00
+Unload
+)",
+               true));
+  ExpectEq(test::output(), "2\n");
+}
+
+JuneTest(rejectsUnderflow) {
+  Expect(!agree(R"(
+Load Ident print
+Call 000
+Unload
+)",
+                false));
+}
+
+JuneTest(rejectsComputedNames) {
+  // the name of a binding must be a string constant, the interpreter checks
+  // what it finds instead
+  Expect(!agree(R"(
+Load Int 1
+Load Int 2
+Create false
+)",
+                false));
+}
+
+int main() { return test::run(); }